@@ -1592,6 +1592,11 @@ void device_projection_pop(gs_device_t *device)
 	device->projStack.pop_back();
 }
 
+void device_projection_get(const gs_device_t *device, matrix4 *dst)
+{
+	memcpy(dst, &device->curProjMatrix, sizeof(matrix4));
+}
+
 void gs_swapchain_destroy(gs_swapchain_t *swapchain)
 {
 	if (!swapchain)
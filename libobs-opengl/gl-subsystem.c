@@ -1295,6 +1295,11 @@ void device_projection_pop(gs_device_t *device)
 	da_pop_back(device->proj_stack);
 }
 
+void device_projection_get(const gs_device_t *device, struct matrix4 *dst)
+{
+	matrix4_copy(dst, &device->cur_proj);
+}
+
 void gs_swapchain_destroy(gs_swapchain_t *swapchain)
 {
 	if (!swapchain)
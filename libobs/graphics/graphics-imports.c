@@ -106,6 +106,7 @@ bool load_graphics_imports(struct gs_exports *exports, void *module,
 	GRAPHICS_IMPORT(device_frustum);
 	GRAPHICS_IMPORT(device_projection_push);
 	GRAPHICS_IMPORT(device_projection_pop);
+	GRAPHICS_IMPORT(device_projection_get);
 
 	GRAPHICS_IMPORT(gs_swapchain_destroy);
 
@@ -149,6 +149,8 @@ struct gs_exports {
 			float top, float bottom, float znear, float zfar);
 	void (*device_projection_push)(gs_device_t *device);
 	void (*device_projection_pop)(gs_device_t *device);
+	void (*device_projection_get)(const gs_device_t *device,
+			struct matrix4 *dst);
 
 	void     (*gs_swapchain_destroy)(gs_swapchain_t *swapchain);
 
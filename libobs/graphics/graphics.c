@@ -1636,6 +1636,14 @@ void gs_projection_pop(void)
 	graphics->exports.device_projection_pop(graphics->device);
 }
 
+void gs_projection_get(struct matrix4 *dst)
+{
+	graphics_t *graphics = thread_graphics;
+	if (!graphics) return;
+
+	graphics->exports.device_projection_get(graphics->device, dst);
+}
+
 void gs_swapchain_destroy(gs_swapchain_t *swapchain)
 {
 	graphics_t *graphics = thread_graphics;
@@ -656,6 +656,7 @@ EXPORT void gs_frustum(float left, float right, float top, float bottom,
 
 EXPORT void gs_projection_push(void);
 EXPORT void gs_projection_pop(void);
+EXPORT void gs_projection_get(struct matrix4 *dst);
 
 EXPORT void     gs_swapchain_destroy(gs_swapchain_t *swapchain);
 
@@ -34,6 +34,13 @@ struct audio_input {
 	struct audio_convert_info conversion;
 	audio_resampler_t         *resampler;
 
+	/* inputs with the same conversion as an earlier input (shared) use
+	 * that input's resampled data rather than having a resampler of their
+	 * own */
+	size_t                    shared;
+	struct audio_data         output;
+	bool                      resampled;
+
 	audio_output_callback_t callback;
 	void *param;
 };
@@ -292,9 +299,25 @@ static inline void do_audio_output(struct audio_output *audio,
 
 	for (size_t i = 0; i < mix->inputs.num; i++) {
 		struct audio_input *input = mix->inputs.array+i;
+		struct audio_data  output;
+
+		if (input->shared != DARRAY_INVALID) {
+			struct audio_input *shared =
+				mix->inputs.array + input->shared;
+
+			input->output    = shared->output;
+			input->resampled = shared->resampled;
+		} else {
+			input->output    = data;
+			input->resampled = resample_audio_output(input,
+					&input->output);
+		}
+
+		/* the callback is free to modify its copy */
+		output = input->output;
 
-		if (resample_audio_output(input, &data))
-			input->callback(input->param, mix_idx, &data);
+		if (input->resampled)
+			input->callback(input->param, mix_idx, &output);
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
@@ -434,32 +457,80 @@ static size_t audio_get_input_idx(const audio_t *audio, size_t mix_idx,
 	return DARRAY_INVALID;
 }
 
+static inline bool audio_input_needs_resampler(
+		const struct audio_input *input,
+		const struct audio_output *audio)
+{
+	const struct audio_convert_info *conv = &input->conversion;
+
+	return conv->format          != audio->info.format          ||
+	       conv->samples_per_sec != audio->info.samples_per_sec ||
+	       conv->speakers        != audio->info.speakers;
+}
+
+static inline bool audio_convert_info_equal(
+		const struct audio_convert_info *a,
+		const struct audio_convert_info *b)
+{
+	return a->format          == b->format &&
+	       a->samples_per_sec == b->samples_per_sec &&
+	       a->speakers        == b->speakers;
+}
+
+/* finds an earlier input in the mix with the same conversion, if any */
+static size_t find_shared_input(const struct audio_mix *mix,
+		const struct audio_input *input, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		const struct audio_input *cur = mix->inputs.array+i;
+
+		if (cur->resampler && audio_convert_info_equal(
+					&cur->conversion, &input->conversion))
+			return i;
+	}
+
+	return DARRAY_INVALID;
+}
+
+static void update_shared_inputs(struct audio_mix *mix)
+{
+	for (size_t i = 0; i < mix->inputs.num; i++) {
+		struct audio_input *input = mix->inputs.array+i;
+
+		input->shared = input->resampler ?
+			DARRAY_INVALID : find_shared_input(mix, input, i);
+	}
+}
+
 static inline bool audio_input_init(struct audio_input *input,
-		struct audio_output *audio)
-{
-	if (input->conversion.format          != audio->info.format          ||
-	    input->conversion.samples_per_sec != audio->info.samples_per_sec ||
-	    input->conversion.speakers        != audio->info.speakers) {
-		struct resample_info from = {
-			.format          = audio->info.format,
-			.samples_per_sec = audio->info.samples_per_sec,
-			.speakers        = audio->info.speakers
-		};
-
-		struct resample_info to = {
-			.format          = input->conversion.format,
-			.samples_per_sec = input->conversion.samples_per_sec,
-			.speakers        = input->conversion.speakers
-		};
-
-		input->resampler = audio_resampler_create(&to, &from);
-		if (!input->resampler) {
-			blog(LOG_ERROR, "audio_input_init: Failed to "
-			                "create resampler");
-			return false;
-		}
-	} else {
-		input->resampler = NULL;
+		struct audio_output *audio, struct audio_mix *mix)
+{
+	struct resample_info from;
+	struct resample_info to;
+
+	input->resampler = NULL;
+	input->shared    = DARRAY_INVALID;
+
+	if (!audio_input_needs_resampler(input, audio))
+		return true;
+
+	input->shared = find_shared_input(mix, input, mix->inputs.num);
+	if (input->shared != DARRAY_INVALID)
+		return true;
+
+	from.format          = audio->info.format;
+	from.samples_per_sec = audio->info.samples_per_sec;
+	from.speakers        = audio->info.speakers;
+
+	to.format            = input->conversion.format;
+	to.samples_per_sec   = input->conversion.samples_per_sec;
+	to.speakers          = input->conversion.speakers;
+
+	input->resampler = audio_resampler_create(&to, &from);
+	if (!input->resampler) {
+		blog(LOG_ERROR, "audio_input_init: Failed to "
+		                "create resampler");
+		return false;
 	}
 
 	return true;
@@ -478,6 +549,7 @@ bool audio_output_connect(audio_t *audio, size_t mi,
 	if (audio_get_input_idx(audio, mi, callback, param) == DARRAY_INVALID) {
 		struct audio_mix *mix = &audio->mixes[mi];
 		struct audio_input input;
+		memset(&input, 0, sizeof(input));
 		input.callback = callback;
 		input.param    = param;
 
@@ -498,7 +570,7 @@ bool audio_output_connect(audio_t *audio, size_t mi,
 			input.conversion.samples_per_sec =
 				audio->info.samples_per_sec;
 
-		success = audio_input_init(&input, audio);
+		success = audio_input_init(&input, audio, mix);
 		if (success)
 			da_push_back(mix->inputs, &input);
 	}
@@ -518,8 +590,24 @@ void audio_output_disconnect(audio_t *audio, size_t mix_idx,
 	size_t idx = audio_get_input_idx(audio, mix_idx, callback, param);
 	if (idx != DARRAY_INVALID) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
-		audio_input_free(mix->inputs.array+idx);
+
+		struct audio_input *removed = mix->inputs.array+idx;
+
+		/* hand the resampler over to the first input sharing it, so
+		 * that the remaining inputs continue without a gap */
+		for (size_t i = idx + 1; i < mix->inputs.num; i++) {
+			struct audio_input *input = mix->inputs.array+i;
+
+			if (input->shared == idx) {
+				input->resampler   = removed->resampler;
+				removed->resampler = NULL;
+				break;
+			}
+		}
+
+		audio_input_free(removed);
 		da_erase(mix->inputs, idx);
+		update_shared_inputs(mix);
 	}
 
 	pthread_mutex_unlock(&audio->input_mutex);
@@ -19,18 +19,121 @@
 
 #include "../util/base.h"
 #include "../util/bmem.h"
+#include "../util/darray.h"
+#include "../util/dstr.h"
 #include "../util/platform.h"
+#include "../util/threading.h"
 
 #include <libavformat/avformat.h>
 
+#include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
+/* files are read and written through our own I/O contexts so that the disk
+ * is accessed in large blocks rather than ffmpeg's default 32k */
+#define REMUX_IO_BUFFER_SIZE (4 * 1024 * 1024)
+
+struct remux_file {
+	FILE        *file;
+	AVIOContext *io;
+	uint64_t    bytes;
+};
+
 struct media_remux_job {
 	int64_t in_size;
 	AVFormatContext *ifmt_ctx, *ofmt_ctx;
+	struct remux_file in, out;
 };
 
+/* avformat_find_stream_info opens decoders, which is not thread safe without
+ * a lock manager, so jobs are only ever created one at a time */
+static pthread_mutex_t create_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int file_read(void *opaque, uint8_t *buf, int buf_size)
+{
+	struct remux_file *rf = opaque;
+	size_t size = fread(buf, 1, buf_size, rf->file);
+
+	if (!size)
+		return ferror(rf->file) ? AVERROR(EIO) : AVERROR_EOF;
+
+	rf->bytes += size;
+	return (int)size;
+}
+
+static int file_write(void *opaque, uint8_t *buf, int buf_size)
+{
+	struct remux_file *rf = opaque;
+	size_t size = fwrite(buf, 1, buf_size, rf->file);
+
+	if (size != (size_t)buf_size)
+		return AVERROR(EIO);
+
+	rf->bytes += size;
+	return buf_size;
+}
+
+static int64_t file_seek(void *opaque, int64_t offset, int whence)
+{
+	struct remux_file *rf = opaque;
+
+	if (whence == AVSEEK_SIZE) {
+		int64_t pos = os_ftelli64(rf->file);
+		int64_t size;
+
+		if (os_fseeki64(rf->file, 0, SEEK_END) != 0)
+			return -1;
+		size = os_ftelli64(rf->file);
+		os_fseeki64(rf->file, pos, SEEK_SET);
+		return size;
+	}
+
+	if (os_fseeki64(rf->file, offset, whence & ~AVSEEK_FORCE) != 0)
+		return -1;
+	return os_ftelli64(rf->file);
+}
+
+static bool open_file(struct remux_file *rf, const char *filename,
+		bool write)
+{
+	uint8_t *buf;
+
+	rf->file = os_fopen(filename, write ? "wb" : "rb");
+	if (!rf->file)
+		return false;
+
+	/* the I/O context does all the buffering */
+	setvbuf(rf->file, NULL, _IONBF, 0);
+
+	buf = av_malloc(REMUX_IO_BUFFER_SIZE);
+	if (!buf)
+		return false;
+
+	rf->io = avio_alloc_context(buf, REMUX_IO_BUFFER_SIZE, write, rf,
+			write ? NULL : file_read,
+			write ? file_write : NULL,
+			file_seek);
+	if (!rf->io) {
+		av_free(buf);
+		return false;
+	}
+
+	return true;
+}
+
+static void close_file(struct remux_file *rf)
+{
+	if (rf->io) {
+		av_freep(&rf->io->buffer);
+		av_freep(&rf->io);
+	}
+	if (rf->file) {
+		fclose(rf->file);
+		rf->file = NULL;
+	}
+}
+
 static inline void init_size(media_remux_job_t job, const char *in_filename)
 {
 #ifdef _MSC_VER
@@ -45,7 +148,21 @@ static inline void init_size(media_remux_job_t job, const char *in_filename)
 
 static inline bool init_input(media_remux_job_t job, const char *in_filename)
 {
-	int ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
+	int ret;
+
+	if (!open_file(&job->in, in_filename, false)) {
+		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
+				in_filename);
+		return false;
+	}
+
+	job->ifmt_ctx = avformat_alloc_context();
+	if (!job->ifmt_ctx)
+		return false;
+
+	job->ifmt_ctx->pb = job->in.io;
+
+	ret = avformat_open_input(&job->ifmt_ctx, in_filename, NULL, NULL);
 	if (ret < 0) {
 		blog(LOG_ERROR, "media_remux: Could not open input file '%s'",
 				in_filename);
@@ -103,13 +220,13 @@ static inline bool init_output(media_remux_job_t job, const char *out_filename)
 #endif
 
 	if (!(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE)) {
-		ret = avio_open(&job->ofmt_ctx->pb, out_filename,
-				AVIO_FLAG_WRITE);
-		if (ret < 0) {
+		if (!open_file(&job->out, out_filename, true)) {
 			blog(LOG_ERROR, "media_remux: Failed to open output"
 					" file '%s'", out_filename);
 			return false;
 		}
+
+		job->ofmt_ctx->pb = job->out.io;
 	}
 
 	return true;
@@ -131,6 +248,8 @@ bool media_remux_job_create(media_remux_job_t *job, const char *in_filename,
 
 	init_size(*job, in_filename);
 
+	pthread_mutex_lock(&create_mutex);
+
 	av_register_all();
 
 	if (!init_input(*job, in_filename))
@@ -139,10 +258,13 @@ bool media_remux_job_create(media_remux_job_t *job, const char *in_filename,
 	if (!init_output(*job, out_filename))
 		goto fail;
 
+	pthread_mutex_unlock(&create_mutex);
 	return true;
 
 fail:
+	pthread_mutex_unlock(&create_mutex);
 	media_remux_job_destroy(*job);
+	*job = NULL;
 	return false;
 }
 
@@ -178,7 +300,9 @@ static inline int process_packets(media_remux_job_t job,
 		}
 
 		if (callback != NULL && throttle++ > 10) {
-			float progress = pkt.pos / (float)job->in_size * 100.f;
+			float progress = job->in_size ?
+				job->in.bytes / (float)job->in_size * 100.f :
+				0.f;
 			if (!callback(data, progress))
 				break;
 			throttle = 0;
@@ -229,6 +353,12 @@ bool media_remux_job_process(media_remux_job_t job,
 		success = false;
 	}
 
+	if (job->out.io && job->out.io->error < 0) {
+		blog(LOG_ERROR, "media_remux: Error writing output file: %s",
+				av_err2str(job->out.io->error));
+		success = false;
+	}
+
 	if (callback != NULL)
 		callback(data, 100.f);
 
@@ -241,11 +371,340 @@ void media_remux_job_destroy(media_remux_job_t job)
 		return;
 
 	avformat_close_input(&job->ifmt_ctx);
-
-	if (job->ofmt_ctx && !(job->ofmt_ctx->oformat->flags & AVFMT_NOFILE))
-		avio_close(job->ofmt_ctx->pb);
-
 	avformat_free_context(job->ofmt_ctx);
 
+	close_file(&job->in);
+	close_file(&job->out);
+
 	bfree(job);
 }
+
+/* ------------------------------------------------------------------------- */
+
+/* progress is reported at most this often per job */
+#define QUEUE_REPORT_INTERVAL_NS 250000000ULL
+#define QUEUE_MAX_WORKERS        4
+
+struct queue_job {
+	struct media_remux_queue  *queue;
+	size_t                    id;
+	struct dstr               in_filename;
+	struct dstr               out_filename;
+
+	media_remux_job_t         job;
+	struct media_remux_status status;
+	volatile bool             cancel;
+	uint64_t                  start_time;
+	uint64_t                  last_report;
+};
+
+struct media_remux_queue {
+	pthread_mutex_t                mutex;
+	os_sem_t                       *sem;
+	DARRAY(pthread_t)              workers;
+	DARRAY(struct queue_job*)      jobs;
+	size_t                         next_job;
+	bool                           stop;
+
+	media_remux_queue_callback     *callback;
+	void                           *data;
+};
+
+static void report_status(struct queue_job *qj)
+{
+	struct media_remux_queue  *queue = qj->queue;
+	struct media_remux_status status;
+
+	if (!queue->callback)
+		return;
+
+	pthread_mutex_lock(&queue->mutex);
+	status = qj->status;
+	pthread_mutex_unlock(&queue->mutex);
+
+	queue->callback(queue->data, qj->id, &status);
+}
+
+static bool job_progress(void *data, float percent)
+{
+	struct queue_job *qj  = data;
+	uint64_t         now  = os_gettime_ns();
+	uint64_t         time = now - qj->start_time;
+	uint64_t         bytes;
+
+	if (qj->cancel)
+		return false;
+	if (percent > 0.f && percent < 100.f &&
+	    now - qj->last_report < QUEUE_REPORT_INTERVAL_NS)
+		return true;
+
+	bytes = qj->job ? qj->job->in.bytes : 0;
+
+	pthread_mutex_lock(&qj->queue->mutex);
+	qj->status.percent       = percent;
+	qj->status.bytes_read    = bytes;
+	qj->status.bytes_per_sec = time ?
+		(uint64_t)((double)bytes * 1000000000.0 / (double)time) : 0;
+	pthread_mutex_unlock(&qj->queue->mutex);
+
+	qj->last_report = now;
+	report_status(qj);
+	return !qj->cancel;
+}
+
+static void run_job(struct queue_job *qj)
+{
+	enum media_remux_state state = MEDIA_REMUX_FAILED;
+	bool success = false;
+
+	qj->start_time = os_gettime_ns();
+
+	if (media_remux_job_create(&qj->job, qj->in_filename.array,
+				qj->out_filename.array)) {
+		pthread_mutex_lock(&qj->queue->mutex);
+		qj->status.in_size = (uint64_t)qj->job->in_size;
+		pthread_mutex_unlock(&qj->queue->mutex);
+
+		success = media_remux_job_process(qj->job, job_progress, qj);
+	}
+
+	pthread_mutex_lock(&qj->queue->mutex);
+	if (qj->cancel)
+		state = MEDIA_REMUX_CANCELED;
+	else if (success)
+		state = MEDIA_REMUX_DONE;
+	qj->status.state = state;
+	pthread_mutex_unlock(&qj->queue->mutex);
+
+	if (qj->job) {
+		media_remux_job_destroy(qj->job);
+		qj->job = NULL;
+	}
+
+	blog(state == MEDIA_REMUX_FAILED ? LOG_WARNING : LOG_INFO,
+			"media_remux: '%s' %s (%.1f MB/s)",
+			qj->in_filename.array,
+			state == MEDIA_REMUX_DONE     ? "remuxed" :
+			state == MEDIA_REMUX_CANCELED ? "canceled" : "failed",
+			(double)qj->status.bytes_per_sec / (1024.0 * 1024.0));
+
+	report_status(qj);
+}
+
+static struct queue_job *next_queued_job(struct media_remux_queue *queue)
+{
+	while (queue->next_job < queue->jobs.num) {
+		struct queue_job *qj = queue->jobs.array[queue->next_job++];
+		if (qj->status.state == MEDIA_REMUX_QUEUED)
+			return qj;
+	}
+
+	return NULL;
+}
+
+static void *remux_worker(void *data)
+{
+	struct media_remux_queue *queue = data;
+
+	os_set_thread_name("media-remux: worker");
+
+	for (;;) {
+		struct queue_job *qj;
+
+		if (os_sem_wait(queue->sem) != 0)
+			break;
+
+		pthread_mutex_lock(&queue->mutex);
+		if (queue->stop) {
+			pthread_mutex_unlock(&queue->mutex);
+			break;
+		}
+
+		qj = next_queued_job(queue);
+		if (qj)
+			qj->status.state = MEDIA_REMUX_ACTIVE;
+		pthread_mutex_unlock(&queue->mutex);
+
+		if (qj) {
+			report_status(qj);
+			run_job(qj);
+		}
+	}
+
+	return NULL;
+}
+
+media_remux_queue_t media_remux_queue_create(size_t num_workers,
+		media_remux_queue_callback callback, void *data)
+{
+	struct media_remux_queue *queue;
+
+	if (!num_workers) {
+		int cores = os_get_logical_cores();
+		num_workers = cores > 0 ? (size_t)cores : 1;
+		if (num_workers > QUEUE_MAX_WORKERS)
+			num_workers = QUEUE_MAX_WORKERS;
+	}
+
+	queue = bzalloc(sizeof(struct media_remux_queue));
+	queue->callback = callback;
+	queue->data     = data;
+
+	if (pthread_mutex_init(&queue->mutex, NULL) != 0)
+		goto fail_mutex;
+	if (os_sem_init(&queue->sem, 0) != 0)
+		goto fail_sem;
+
+	for (size_t i = 0; i < num_workers; i++) {
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, remux_worker, queue) != 0)
+			break;
+		da_push_back(queue->workers, &thread);
+	}
+
+	if (!queue->workers.num) {
+		blog(LOG_ERROR, "media_remux: Failed to create worker "
+		                "threads");
+		media_remux_queue_destroy(queue);
+		return NULL;
+	}
+
+	return queue;
+
+fail_sem:
+	pthread_mutex_destroy(&queue->mutex);
+fail_mutex:
+	bfree(queue);
+	return NULL;
+}
+
+void media_remux_queue_destroy(media_remux_queue_t queue)
+{
+	if (!queue)
+		return;
+
+	pthread_mutex_lock(&queue->mutex);
+	queue->stop = true;
+	for (size_t i = 0; i < queue->jobs.num; i++)
+		queue->jobs.array[i]->cancel = true;
+	pthread_mutex_unlock(&queue->mutex);
+
+	for (size_t i = 0; i < queue->workers.num; i++)
+		os_sem_post(queue->sem);
+	for (size_t i = 0; i < queue->workers.num; i++)
+		pthread_join(queue->workers.array[i], NULL);
+
+	for (size_t i = 0; i < queue->jobs.num; i++) {
+		struct queue_job *qj = queue->jobs.array[i];
+		dstr_free(&qj->in_filename);
+		dstr_free(&qj->out_filename);
+		bfree(qj);
+	}
+
+	da_free(queue->jobs);
+	da_free(queue->workers);
+	os_sem_destroy(queue->sem);
+	pthread_mutex_destroy(&queue->mutex);
+	bfree(queue);
+}
+
+size_t media_remux_queue_add(media_remux_queue_t queue,
+		const char *in_filename, const char *out_filename)
+{
+	struct queue_job *qj;
+	size_t           id;
+
+	if (!queue || !in_filename || !out_filename)
+		return MEDIA_REMUX_INVALID_JOB;
+
+	qj = bzalloc(sizeof(struct queue_job));
+	qj->queue = queue;
+	qj->status.state = MEDIA_REMUX_QUEUED;
+	dstr_copy(&qj->in_filename, in_filename);
+	dstr_copy(&qj->out_filename, out_filename);
+
+	pthread_mutex_lock(&queue->mutex);
+	id = qj->id = queue->jobs.num;
+	da_push_back(queue->jobs, &qj);
+	pthread_mutex_unlock(&queue->mutex);
+
+	os_sem_post(queue->sem);
+	return id;
+}
+
+void media_remux_queue_cancel(media_remux_queue_t queue, size_t id)
+{
+	struct queue_job *qj = NULL;
+
+	if (!queue)
+		return;
+
+	pthread_mutex_lock(&queue->mutex);
+	if (id < queue->jobs.num) {
+		qj = queue->jobs.array[id];
+		qj->cancel = true;
+
+		/* queued jobs are skipped, active jobs stop at their next
+		 * progress check */
+		if (qj->status.state != MEDIA_REMUX_QUEUED)
+			qj = NULL;
+		else
+			qj->status.state = MEDIA_REMUX_CANCELED;
+	}
+	pthread_mutex_unlock(&queue->mutex);
+
+	if (qj)
+		report_status(qj);
+}
+
+void media_remux_queue_cancel_all(media_remux_queue_t queue)
+{
+	size_t num;
+
+	if (!queue)
+		return;
+
+	pthread_mutex_lock(&queue->mutex);
+	num = queue->jobs.num;
+	pthread_mutex_unlock(&queue->mutex);
+
+	for (size_t i = 0; i < num; i++)
+		media_remux_queue_cancel(queue, i);
+}
+
+bool media_remux_queue_get_status(media_remux_queue_t queue, size_t id,
+		struct media_remux_status *status)
+{
+	bool success = false;
+
+	if (!queue || !status)
+		return false;
+
+	pthread_mutex_lock(&queue->mutex);
+	if (id < queue->jobs.num) {
+		*status = queue->jobs.array[id]->status;
+		success = true;
+	}
+	pthread_mutex_unlock(&queue->mutex);
+
+	return success;
+}
+
+size_t media_remux_queue_pending(media_remux_queue_t queue)
+{
+	size_t pending = 0;
+
+	if (!queue)
+		return 0;
+
+	pthread_mutex_lock(&queue->mutex);
+	for (size_t i = 0; i < queue->jobs.num; i++) {
+		struct queue_job *qj = queue->jobs.array[i];
+		if (qj->status.state == MEDIA_REMUX_QUEUED ||
+		    qj->status.state == MEDIA_REMUX_ACTIVE)
+			pending++;
+	}
+	pthread_mutex_unlock(&queue->mutex);
+
+	return pending;
+}
@@ -24,6 +24,34 @@ typedef struct media_remux_job *media_remux_job_t;
 
 typedef bool (media_remux_progress_callback)(void *data, float percent);
 
+struct media_remux_queue;
+typedef struct media_remux_queue *media_remux_queue_t;
+
+#define MEDIA_REMUX_INVALID_JOB ((size_t)-1)
+
+enum media_remux_state {
+	MEDIA_REMUX_QUEUED,
+	MEDIA_REMUX_ACTIVE,
+	MEDIA_REMUX_DONE,
+	MEDIA_REMUX_FAILED,
+	MEDIA_REMUX_CANCELED
+};
+
+struct media_remux_status {
+	enum media_remux_state state;
+	float                  percent;
+	uint64_t               in_size;
+	uint64_t               bytes_read;
+	uint64_t               bytes_per_sec;
+};
+
+/**
+ * Called from the worker threads whenever the state of a job changes, and
+ * periodically with its progress while it is active
+ */
+typedef void (media_remux_queue_callback)(void *data, size_t id,
+		const struct media_remux_status *status);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -34,6 +62,33 @@ EXPORT bool media_remux_job_process(media_remux_job_t job,
 		media_remux_progress_callback callback, void *data);
 EXPORT void media_remux_job_destroy(media_remux_job_t job);
 
+/**
+ * Creates a queue that remuxes files on a pool of worker threads.  If
+ * num_workers is 0, a worker count is picked based on the number of cores.
+ */
+EXPORT media_remux_queue_t media_remux_queue_create(size_t num_workers,
+		media_remux_queue_callback callback, void *data);
+
+/** Cancels all jobs and waits for the workers to finish */
+EXPORT void media_remux_queue_destroy(media_remux_queue_t queue);
+
+/**
+ * Adds a file to the queue.  Returns the ID of the job, which is used by the
+ * other queue functions and passed to the callback, or
+ * MEDIA_REMUX_INVALID_JOB on failure.
+ */
+EXPORT size_t media_remux_queue_add(media_remux_queue_t queue,
+		const char *in_filename, const char *out_filename);
+
+EXPORT void media_remux_queue_cancel(media_remux_queue_t queue, size_t id);
+EXPORT void media_remux_queue_cancel_all(media_remux_queue_t queue);
+
+EXPORT bool media_remux_queue_get_status(media_remux_queue_t queue,
+		size_t id, struct media_remux_status *status);
+
+/** Returns the number of jobs that are queued or active */
+EXPORT size_t media_remux_queue_pending(media_remux_queue_t queue);
+
 #ifdef __cplusplus
 }
 #endif
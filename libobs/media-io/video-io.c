@@ -40,6 +40,17 @@ struct video_input {
 	struct video_frame        frame[MAX_CONVERT_BUFFERS];
 	int                       cur_frame;
 
+	/* cascaded inputs are scaled from the frames of the next larger
+	 * cascaded input (source) rather than from the full frame */
+	bool                      cascade;
+	size_t                    source;
+	struct video_scale_info   scaled_from;
+	bool                      scaled;
+
+	/* inputs with the same conversion as an earlier input (shared) use
+	 * that input's scaled frames rather than scaling the frame again */
+	size_t                    shared;
+
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
 };
@@ -107,6 +118,44 @@ static inline bool scale_video_output(struct video_input *input,
 	return success;
 }
 
+static inline bool get_scaled_frame(const struct video_input *input,
+		struct video_data *data)
+{
+	const struct video_frame *frame;
+
+	if (!input->scaled)
+		return false;
+
+	frame = &input->frame[input->cur_frame];
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		data->data[i]     = frame->data[i];
+		data->linesize[i] = frame->linesize[i];
+	}
+
+	return true;
+}
+
+static inline bool get_cascade_source_frame(struct video_output *video,
+		struct video_input *input, struct video_data *data)
+{
+	if (input->source == DARRAY_INVALID)
+		return true;
+
+	return get_scaled_frame(video->inputs.array + input->source, data);
+}
+
+static inline bool get_input_frame(struct video_output *video,
+		struct video_input *input, struct video_data *data)
+{
+	if (input->shared != DARRAY_INVALID)
+		return get_scaled_frame(video->inputs.array + input->shared,
+				data);
+
+	return get_cascade_source_frame(video, input, data) &&
+		scale_video_output(input, data);
+}
+
 static inline bool video_output_cur_frame(struct video_output *video)
 {
 	struct cached_frame_info *frame_info;
@@ -124,11 +173,16 @@ static inline bool video_output_cur_frame(struct video_output *video)
 
 	pthread_mutex_lock(&video->input_mutex);
 
+	/* inputs are sorted from largest to smallest, so cascade sources are
+	 * always scaled before the inputs that are scaled from them, and
+	 * shared inputs always come before the inputs that share them */
 	for (size_t i = 0; i < video->inputs.num; i++) {
 		struct video_input *input = video->inputs.array+i;
 		struct video_data frame = frame_info->frame;
 
-		if (scale_video_output(input, &frame))
+		input->scaled = get_input_frame(video, input, &frame);
+
+		if (input->scaled)
 			input->callback(input->param, &frame);
 	}
 
@@ -275,17 +329,32 @@ static size_t video_get_input_idx(const video_t *video,
 	return DARRAY_INVALID;
 }
 
+static inline bool video_input_needs_scaler(const struct video_input *input,
+		const struct video_output *video)
+{
+	return input->conversion.width  != video->info.width ||
+	       input->conversion.height != video->info.height ||
+	       input->conversion.format != video->info.format;
+}
+
+static inline void get_full_scale_info(const struct video_output *video,
+		struct video_scale_info *info)
+{
+	memset(info, 0, sizeof(*info));
+	info->format = video->info.format;
+	info->width  = video->info.width;
+	info->height = video->info.height;
+}
+
 static inline bool video_input_init(struct video_input *input,
 		struct video_output *video)
 {
-	if (input->conversion.width  != video->info.width ||
-	    input->conversion.height != video->info.height ||
-	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {
-			.format = video->info.format,
-			.width  = video->info.width,
-			.height = video->info.height,
-		};
+	if (video_input_needs_scaler(input, video)) {
+		struct video_scale_info from;
+
+		get_full_scale_info(video, &from);
+		input->scaled_from = from;
+		input->source      = DARRAY_INVALID;
 
 		int ret = video_scaler_create(&input->scaler,
 				&input->conversion, &from,
@@ -311,10 +380,132 @@ static inline bool video_input_init(struct video_input *input,
 	return true;
 }
 
-bool video_output_connect(video_t *video,
+static inline bool can_cascade_from(const struct video_input *source,
+		const struct video_input *input,
+		const struct video_output *video)
+{
+	const struct video_scale_info *src = &source->conversion;
+	const struct video_scale_info *dst = &input->conversion;
+
+	return source->cascade && source->scaler &&
+		source->shared == DARRAY_INVALID &&
+		video_input_needs_scaler(source, video) &&
+		src->format     == dst->format &&
+		src->range      == dst->range &&
+		src->colorspace == dst->colorspace &&
+		src->width      >= dst->width &&
+		src->height     >= dst->height &&
+		(src->width != dst->width || src->height != dst->height);
+}
+
+static inline bool scale_info_equal(const struct video_scale_info *a,
+		const struct video_scale_info *b)
+{
+	return a->format     == b->format &&
+	       a->width      == b->width &&
+	       a->height     == b->height &&
+	       a->range      == b->range &&
+	       a->colorspace == b->colorspace;
+}
+
+/* finds an earlier input that is scaled the same way, if any */
+static size_t find_shared_input(const struct video_output *video, size_t idx)
+{
+	const struct video_input *input = video->inputs.array+idx;
+
+	for (size_t i = 0; i < idx; i++) {
+		const struct video_input *cur = video->inputs.array+i;
+
+		if (cur->scaler && cur->shared == DARRAY_INVALID &&
+		    cur->cascade == input->cascade &&
+		    scale_info_equal(&cur->conversion, &input->conversion))
+			return i;
+	}
+
+	return DARRAY_INVALID;
+}
+
+/* finds the input each input can share scaled frames with, and the smallest
+ * larger cascaded input for each remaining cascaded input, and recreates the
+ * scalers of the inputs whose source changed */
+static void update_cascade(struct video_output *video)
+{
+	for (size_t i = 0; i < video->inputs.num; i++) {
+		struct video_input      *input  = video->inputs.array+i;
+		size_t                  source  = DARRAY_INVALID;
+		struct video_scale_info from;
+		video_scaler_t          *scaler;
+
+		input->shared = DARRAY_INVALID;
+
+		if (!input->scaler)
+			continue;
+
+		input->shared = find_shared_input(video, i);
+		if (input->shared != DARRAY_INVALID) {
+			input->source = DARRAY_INVALID;
+			continue;
+		}
+
+		if (input->cascade) {
+			for (size_t j = i; j > 0; j--) {
+				struct video_input *cur =
+					video->inputs.array + (j - 1);
+
+				if (can_cascade_from(cur, input, video)) {
+					source = j - 1;
+					break;
+				}
+			}
+		}
+
+		if (source != DARRAY_INVALID)
+			from = video->inputs.array[source].conversion;
+		else
+			get_full_scale_info(video, &from);
+
+		input->source = source;
+
+		if (scale_info_equal(&from, &input->scaled_from))
+			continue;
+
+		if (video_scaler_create(&scaler, &input->conversion, &from,
+					VIDEO_SCALE_FAST_BILINEAR) !=
+				VIDEO_SCALER_SUCCESS) {
+			blog(LOG_WARNING, "video-io: Failed to create "
+			                  "cascaded scaler, scaling from the "
+			                  "full frame instead");
+			input->source = DARRAY_INVALID;
+			continue;
+		}
+
+		video_scaler_destroy(input->scaler);
+		input->scaler      = scaler;
+		input->scaled_from = from;
+	}
+}
+
+/* keeps inputs sorted from largest to smallest */
+static size_t get_input_insert_idx(const struct video_output *video,
+		const struct video_scale_info *conversion)
+{
+	uint64_t area = (uint64_t)conversion->width * conversion->height;
+
+	for (size_t i = 0; i < video->inputs.num; i++) {
+		const struct video_scale_info *cur =
+			&video->inputs.array[i].conversion;
+
+		if ((uint64_t)cur->width * cur->height < area)
+			return i;
+	}
+
+	return video->inputs.num;
+}
+
+static bool video_output_connect_internal(video_t *video,
 		const struct video_scale_info *conversion,
 		void (*callback)(void *param, struct video_data *frame),
-		void *param)
+		void *param, bool cascade)
 {
 	bool success = false;
 
@@ -329,6 +520,9 @@ bool video_output_connect(video_t *video,
 
 		input.callback = callback;
 		input.param    = param;
+		input.cascade  = cascade;
+		input.source   = DARRAY_INVALID;
+		input.shared   = DARRAY_INVALID;
 
 		if (conversion) {
 			input.conversion = *conversion;
@@ -344,8 +538,12 @@ bool video_output_connect(video_t *video,
 			input.conversion.height = video->info.height;
 
 		success = video_input_init(&input, video);
-		if (success)
-			da_push_back(video->inputs, &input);
+		if (success) {
+			size_t idx = get_input_insert_idx(video,
+					&input.conversion);
+			da_insert(video->inputs, idx, &input);
+			update_cascade(video);
+		}
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -353,6 +551,24 @@ bool video_output_connect(video_t *video,
 	return success;
 }
 
+bool video_output_connect(video_t *video,
+		const struct video_scale_info *conversion,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param)
+{
+	return video_output_connect_internal(video, conversion, callback,
+			param, false);
+}
+
+bool video_output_connect_cascaded(video_t *video,
+		const struct video_scale_info *conversion,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param)
+{
+	return video_output_connect_internal(video, conversion, callback,
+			param, true);
+}
+
 void video_output_disconnect(video_t *video,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param)
@@ -366,6 +582,7 @@ void video_output_disconnect(video_t *video,
 	if (idx != DARRAY_INVALID) {
 		video_input_free(video->inputs.array+idx);
 		da_erase(video->inputs, idx);
+		update_cascade(video);
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
@@ -103,6 +103,26 @@ static inline bool format_is_yuv(enum video_format format)
 	return false;
 }
 
+static inline bool format_has_alpha(enum video_format format)
+{
+	switch (format) {
+	case VIDEO_FORMAT_RGBA:
+	case VIDEO_FORMAT_BGRA:
+		return true;
+	case VIDEO_FORMAT_NONE:
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_I444:
+		return false;
+	}
+
+	return false;
+}
+
 static inline const char *get_video_format_name(enum video_format format)
 {
 	switch (format) {
@@ -154,6 +174,17 @@ EXPORT bool video_output_connect(video_t *video,
 		const struct video_scale_info *conversion,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param);
+
+/**
+ * Connects an input that is part of a downscale cascade.  Instead of being
+ * scaled from the full resolution frame, its frames are scaled from the
+ * frames of the next larger cascaded input of the same format, so each frame
+ * is only downscaled from full resolution once.
+ */
+EXPORT bool video_output_connect_cascaded(video_t *video,
+		const struct video_scale_info *conversion,
+		void (*callback)(void *param, struct video_data *frame),
+		void *param);
 EXPORT void video_output_disconnect(video_t *video,
 		void (*callback)(void *param, struct video_data *frame),
 		void *param);
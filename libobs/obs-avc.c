@@ -15,9 +15,10 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
-#include "obs.h"
+#include "obs-internal.h"
 #include "obs-avc.h"
 #include "util/array-serializer.h"
+#include <emmintrin.h>
 
 bool obs_avc_keyframe(const uint8_t *data, size_t size)
 {
@@ -44,50 +45,41 @@ bool obs_avc_keyframe(const uint8_t *data, size_t size)
 	return false;
 }
 
-/* NOTE: I noticed that FFmpeg does some unusual special handling of certain
- * scenarios that I was unaware of, so instead of just searching for {0, 0, 1}
- * we'll just use the code from FFmpeg - http://www.ffmpeg.org/ */
-static const uint8_t *ff_avc_find_startcode_internal(const uint8_t *p,
+/* finds the first {0, 0, 1} that has data after it.  pairs of zero bytes are
+ * found 16 positions at a time, and only the byte after each pair is checked
+ * for the 1, which is rare in coded slice data because of emulation
+ * prevention */
+static const uint8_t *find_startcode_internal(const uint8_t *p,
 		const uint8_t *end)
 {
-	const uint8_t *a = p + 4 - ((intptr_t)p & 3);
-
-	for (end -= 3; p < a && p < end; p++) {
-		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-			return p;
-	}
-
-	for (end -= 3; p < end; p += 4) {
-		uint32_t x = *(const uint32_t*)p;
-
-		if ((x - 0x01010101) & (~x) & 0x80808080) {
-			if (p[1] == 0) {
-				if (p[0] == 0 && p[2] == 1)
-					return p;
-				if (p[2] == 0 && p[3] == 1)
-					return p+1;
-			}
-
-			if (p[3] == 0) {
-				if (p[2] == 0 && p[4] == 1)
-					return p+2;
-				if (p[4] == 0 && p[5] == 1)
-					return p+3;
-			}
+	const __m128i zero = _mm_setzero_si128();
+
+	while (end - p > 18) {
+		__m128i cur  = _mm_loadu_si128((const __m128i*)p);
+		__m128i next = _mm_loadu_si128((const __m128i*)(p + 1));
+		int     mask = _mm_movemask_epi8(_mm_and_si128(
+				_mm_cmpeq_epi8(cur, zero),
+				_mm_cmpeq_epi8(next, zero)));
+
+		for (int i = 0; mask; i++, mask >>= 1) {
+			if ((mask & 1) && p[i + 2] == 1)
+				return p + i;
 		}
+
+		p += 16;
 	}
 
-	for (end += 3; p < end; p++) {
+	for (; end - p > 3; p++) {
 		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
 			return p;
 	}
 
-	return end + 3;
+	return end;
 }
 
 const uint8_t *obs_avc_find_startcode(const uint8_t *p, const uint8_t *end)
 {
-	const uint8_t *out= ff_avc_find_startcode_internal(p, end);
+	const uint8_t *out = find_startcode_internal(p, end);
 	if (p < out && out < end && !out[-1]) out--;
 	return out;
 }
@@ -102,13 +94,61 @@ static inline int get_drop_priority(int priority)
 	return OBS_NAL_PRIORITY_HIGHEST;
 }
 
-static void serialize_avc_data(struct serializer *s, const uint8_t *data,
-		size_t size, bool *is_keyframe, int *priority)
+#define MAX_STACK_NALS 32
+
+struct avc_nal {
+	const uint8_t *data;
+	size_t        size;
+};
+
+/*
+ * The NAL units of a packet are found with a single scan, which gives the
+ * size of the length-prefixed output, so that it can be written with a single
+ * allocation and no reallocations.
+ */
+struct avc_nals {
+	struct avc_nal        stack[MAX_STACK_NALS];
+	DARRAY(struct avc_nal) heap;
+	struct avc_nal        *array;
+	size_t                num;
+	size_t                output_size;
+
+	/* every NAL has a 4-byte start code and there's nothing else in the
+	 * packet, so the output is the same size as the input */
+	bool                  same_size;
+};
+
+static inline void add_nal(struct avc_nals *nals, const uint8_t *data,
+		size_t size)
+{
+	struct avc_nal nal = {data, size};
+
+	if (nals->num < MAX_STACK_NALS) {
+		nals->stack[nals->num] = nal;
+	} else {
+		if (nals->num == MAX_STACK_NALS)
+			da_push_back_array(nals->heap, nals->stack,
+					MAX_STACK_NALS);
+		da_push_back(nals->heap, &nal);
+	}
+
+	nals->num++;
+	nals->output_size += size + 4;
+}
+
+static void find_nals(struct avc_nals *nals, const uint8_t *data, size_t size,
+		bool *is_keyframe, int *priority)
 {
 	const uint8_t *nal_start, *nal_end;
 	const uint8_t *end = data+size;
+	const uint8_t *prev_end = data;
 	int type;
 
+	da_init(nals->heap);
+	nals->num         = 0;
+	nals->output_size = 0;
+	nals->same_size   = true;
+
 	nal_start = obs_avc_find_startcode(data, end);
 	while (true) {
 		while (nal_start < end && !*(nal_start++));
@@ -125,28 +165,142 @@ static void serialize_avc_data(struct serializer *s, const uint8_t *data,
 				*priority = nal_start[0] >> 5;
 		}
 
+		if (nal_start - prev_end != 4)
+			nals->same_size = false;
+
 		nal_end = obs_avc_find_startcode(nal_start, end);
-		s_wb32(s, (uint32_t)(nal_end - nal_start));
-		s_write(s, nal_start, nal_end - nal_start);
-		nal_start = nal_end;
+		add_nal(nals, nal_start, nal_end - nal_start);
+		nal_start = prev_end = nal_end;
 	}
+
+	if (prev_end != end || !nals->num)
+		nals->same_size = false;
+
+	nals->array = nals->num > MAX_STACK_NALS ?
+		nals->heap.array : nals->stack;
+}
+
+static inline void write_be32(uint8_t *p, uint32_t val)
+{
+	p[0] = (uint8_t)(val >> 24);
+	p[1] = (uint8_t)(val >> 16);
+	p[2] = (uint8_t)(val >> 8);
+	p[3] = (uint8_t)val;
+}
+
+/* writes nals->output_size bytes of length-prefixed NAL units to out */
+static void write_nals(uint8_t *out, const struct avc_nals *nals,
+		const uint8_t *data)
+{
+	if (nals->same_size) {
+		/* copy everything at once and replace the start codes */
+		memcpy(out, data, nals->output_size);
+
+		for (size_t i = 0; i < nals->num; i++) {
+			const struct avc_nal *nal = nals->array + i;
+			write_be32(out + (nal->data - data) - 4,
+					(uint32_t)nal->size);
+		}
+		return;
+	}
+
+	for (size_t i = 0; i < nals->num; i++) {
+		const struct avc_nal *nal = nals->array + i;
+
+		write_be32(out, (uint32_t)nal->size);
+		memcpy(out + 4, nal->data, nal->size);
+		out += nal->size + 4;
+	}
+}
+
+static inline void free_nals(struct avc_nals *nals)
+{
+	da_free(nals->heap);
 }
 
 void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 		const struct encoder_packet *src)
 {
-	struct array_output_data output;
-	struct serializer s;
+	struct avc_nals nals;
 
-	array_output_serializer_init(&s, &output);
 	*avc_packet = *src;
 
-	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
+	find_nals(&nals, src->data, src->size, &avc_packet->keyframe,
 			&avc_packet->priority);
 
-	avc_packet->data          = output.bytes.array;
-	avc_packet->size          = output.bytes.num;
+	avc_packet->data = nals.output_size ?
+		bmalloc(nals.output_size) : NULL;
+	avc_packet->size = nals.output_size;
 	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
+
+	if (avc_packet->data)
+		write_nals(avc_packet->data, &nals, src->data);
+
+	free_nals(&nals);
+}
+
+/*
+ * Parses a reference-counted H.264 packet in to the length-prefixed format
+ * and stores the result with the packet data, so that outputs sharing the
+ * packet don't each have to parse it.  Also updates the keyframe and priority
+ * values of the packet.
+ */
+void obs_avc_cache_parsed_packet(struct encoder_packet *packet)
+{
+	struct avc_nals      nals;
+	struct packet_buffer *buf;
+	uint8_t              *output;
+
+	if (!packet->data)
+		return;
+
+	buf = get_packet_buffer(packet->data);
+	if (buf->avc_data)
+		return;
+
+	find_nals(&nals, packet->data, packet->size, &packet->keyframe,
+			&packet->priority);
+	packet->drop_priority = get_drop_priority(packet->priority);
+
+	output = packet_buffer_alloc(nals.output_size);
+	write_nals(output, &nals, packet->data);
+
+	buf->avc_data = output;
+	buf->avc_size = nals.output_size;
+
+	free_nals(&nals);
+}
+
+void obs_avc_packet_ref(struct encoder_packet *avc_packet,
+		struct encoder_packet *src)
+{
+	struct packet_buffer *buf;
+
+	if (!avc_packet || !src)
+		return;
+
+	if (!src->data) {
+		*avc_packet = *src;
+		return;
+	}
+
+	buf = get_packet_buffer(src->data);
+
+	/* not parsed when the packet was created, parse it now */
+	if (!buf->avc_data) {
+		struct encoder_packet parsed;
+
+		obs_parse_avc_packet(&parsed, src);
+		obs_encoder_packet_create_instance(avc_packet, &parsed);
+		obs_free_encoder_packet(&parsed);
+		return;
+	}
+
+	os_atomic_inc_long(&get_packet_buffer(buf->avc_data)->refs);
+
+	*avc_packet      = *src;
+	avc_packet->data = buf->avc_data;
+	avc_packet->size = buf->avc_size;
 }
 
 static inline bool has_start_code(const uint8_t *data)
@@ -53,6 +53,15 @@ EXPORT const uint8_t *obs_avc_find_startcode(const uint8_t *p,
 		const uint8_t *end);
 EXPORT void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 		const struct encoder_packet *src);
+
+/**
+ * Gets a reference to the length-prefixed (AVCC) version of a
+ * reference-counted H.264 packet.  The parsed data is created once per packet
+ * and shared by everything that references it.  Release the packet with
+ * obs_encoder_packet_release.
+ */
+EXPORT void obs_avc_packet_ref(struct encoder_packet *avc_packet,
+		struct encoder_packet *src);
 EXPORT size_t obs_parse_avc_header(uint8_t **header, const uint8_t *data,
 		size_t size);
 
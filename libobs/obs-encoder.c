@@ -36,18 +36,33 @@ const char *obs_encoder_get_display_name(const char *id)
 	return ei ? ei->get_name() : NULL;
 }
 
+static const char *encoder_signals[] = {
+	"void overload(ptr encoder, bool overloaded)",
+	"void update(ptr encoder, bool success)",
+	NULL
+};
+
 static bool init_encoder(struct obs_encoder *encoder, const char *name,
 		obs_data_t *settings)
 {
 	pthread_mutex_init_value(&encoder->callbacks_mutex);
 	pthread_mutex_init_value(&encoder->outputs_mutex);
+	pthread_mutex_init_value(&encoder->queue_mutex);
+	pthread_mutex_init_value(&encoder->update_mutex);
 
 	if (!obs_context_data_init(&encoder->context, settings, name))
 		return false;
+	if (!signal_handler_add_array(encoder->context.signals,
+				encoder_signals))
+		return false;
 	if (pthread_mutex_init(&encoder->callbacks_mutex, NULL) != 0)
 		return false;
 	if (pthread_mutex_init(&encoder->outputs_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&encoder->queue_mutex, NULL) != 0)
+		return false;
+	if (pthread_mutex_init(&encoder->update_mutex, NULL) != 0)
+		return false;
 
 	if (encoder->info.get_defaults)
 		encoder->info.get_defaults(encoder->context.settings);
@@ -78,7 +93,8 @@ static struct obs_encoder *create_encoder(const char *id,
 
 	obs_context_data_insert(&encoder->context,
 			&obs->data.encoders_mutex,
-			&obs->data.first_encoder);
+			&obs->data.first_encoder,
+			&obs->data.encoders_index);
 
 	blog(LOG_INFO, "encoder '%s' (%s) created", name, id);
 	return encoder;
@@ -147,8 +163,91 @@ static inline bool has_scaling(const struct obs_encoder *encoder)
 		 video_height != encoder->scaled_height);
 }
 
+static void *encode_thread(void *data);
+
+static void free_queue(struct obs_encoder *encoder)
+{
+	for (size_t i = 0; i < ENCODER_QUEUE_SIZE; i++)
+		video_frame_free(&encoder->queue[i].frame);
+
+	encoder->queue_format = VIDEO_FORMAT_NONE;
+	encoder->queue_width  = 0;
+	encoder->queue_height = 0;
+}
+
+static void reset_queue(struct obs_encoder *encoder,
+		const struct video_scale_info *info)
+{
+	if (encoder->queue_format != info->format ||
+	    encoder->queue_width  != info->width ||
+	    encoder->queue_height != info->height) {
+		free_queue(encoder);
+
+		for (size_t i = 0; i < ENCODER_QUEUE_SIZE; i++)
+			video_frame_init(&encoder->queue[i].frame,
+					info->format, info->width,
+					info->height);
+
+		encoder->queue_format = info->format;
+		encoder->queue_width  = info->width;
+		encoder->queue_height = info->height;
+	}
+
+	encoder->queue_first     = 0;
+	encoder->queue_count     = 0;
+	encoder->queue_depth     = 0;
+	encoder->max_queue_depth = 0;
+	encoder->frames_dropped  = 0;
+}
+
+static bool start_encode_thread(struct obs_encoder *encoder,
+		const struct video_scale_info *info)
+{
+	reset_queue(encoder, info);
+	encoder->thread_stop   = false;
+	encoder->thread_failed = false;
+
+	if (os_sem_init(&encoder->encode_sem, 0) != 0)
+		goto fail;
+
+	if (pthread_create(&encoder->encode_thread, NULL, encode_thread,
+				encoder) != 0) {
+		os_sem_destroy(encoder->encode_sem);
+		encoder->encode_sem = NULL;
+		goto fail;
+	}
+
+	encoder->thread_active = true;
+	return true;
+
+fail:
+	blog(LOG_WARNING, "encoder '%s': Failed to create encode thread, "
+	                  "encoding on the video thread instead",
+	                  encoder->context.name);
+	return false;
+}
+
+static void stop_encode_thread(struct obs_encoder *encoder)
+{
+	if (!encoder->thread_active)
+		return;
+
+	encoder->thread_active = false;
+	encoder->thread_stop   = true;
+
+	/* the thread encodes the frames that are still queued before it
+	 * exits, so the end of the video isn't lost */
+	os_sem_post(encoder->encode_sem);
+	pthread_join(encoder->encode_thread, NULL);
+
+	os_sem_destroy(encoder->encode_sem);
+	encoder->encode_sem = NULL;
+}
+
 static void add_connection(struct obs_encoder *encoder)
 {
+	encoder->encode_latency = 0;
+
 	if (encoder->info.type == OBS_ENCODER_AUDIO) {
 		struct audio_convert_info audio_info = {0};
 		get_audio_info(encoder, &audio_info);
@@ -159,8 +258,15 @@ static void add_connection(struct obs_encoder *encoder)
 		struct video_scale_info info = {0};
 		get_video_info(encoder, &info);
 
-		video_output_connect(encoder->media, &info, receive_video,
-			encoder);
+		if (encoder->async)
+			start_encode_thread(encoder, &info);
+
+		if (encoder->scale_cascade)
+			video_output_connect_cascaded(encoder->media, &info,
+					receive_video, encoder);
+		else
+			video_output_connect(encoder->media, &info,
+					receive_video, encoder);
 	}
 
 	encoder->active = true;
@@ -168,12 +274,14 @@ static void add_connection(struct obs_encoder *encoder)
 
 static void remove_connection(struct obs_encoder *encoder)
 {
-	if (encoder->info.type == OBS_ENCODER_AUDIO)
+	if (encoder->info.type == OBS_ENCODER_AUDIO) {
 		audio_output_disconnect(encoder->media, encoder->mixer_idx,
 				receive_audio, encoder);
-	else
+	} else {
 		video_output_disconnect(encoder->media, receive_video,
 				encoder);
+		stop_encode_thread(encoder);
+	}
 
 	encoder->active = false;
 }
@@ -201,12 +309,15 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		blog(LOG_INFO, "encoder '%s' destroyed", encoder->context.name);
 
 		free_audio_buffers(encoder);
+		free_queue(encoder);
 
 		if (encoder->context.data)
 			encoder->info.destroy(encoder->context.data);
 		da_free(encoder->callbacks);
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
+		pthread_mutex_destroy(&encoder->queue_mutex);
+		pthread_mutex_destroy(&encoder->update_mutex);
 		obs_context_data_free(&encoder->context);
 		bfree(encoder);
 	}
@@ -237,6 +348,25 @@ const char *obs_encoder_get_name(const obs_encoder_t *encoder)
 	return encoder ? encoder->context.name : NULL;
 }
 
+signal_handler_t *obs_encoder_get_signal_handler(
+		const obs_encoder_t *encoder)
+{
+	return encoder ? encoder->context.signals : NULL;
+}
+
+void obs_encoder_signal_overload(obs_encoder_t *encoder, bool overloaded)
+{
+	struct calldata params = {0};
+
+	if (!encoder)
+		return;
+
+	calldata_set_ptr(&params, "encoder", encoder);
+	calldata_set_bool(&params, "overloaded", overloaded);
+	signal_handler_signal(encoder->context.signals, "overload", &params);
+	calldata_free(&params);
+}
+
 void obs_encoder_set_name(obs_encoder_t *encoder, const char *name)
 {
 	if (!encoder) return;
@@ -289,11 +419,52 @@ void obs_encoder_update(obs_encoder_t *encoder, obs_data_t *settings)
 {
 	if (!encoder) return;
 
+	pthread_mutex_lock(&encoder->update_mutex);
+
 	obs_data_apply(encoder->context.settings, settings);
 
-	if (encoder->info.update && encoder->context.data)
+	/* while active, the encoder is only ever called from the thread that
+	 * encodes, so the update is deferred to that thread */
+	if (encoder->active)
+		encoder->update_pending = true;
+	else if (encoder->info.update && encoder->context.data)
 		encoder->info.update(encoder->context.data,
 				encoder->context.settings);
+
+	pthread_mutex_unlock(&encoder->update_mutex);
+}
+
+static void apply_pending_update(struct obs_encoder *encoder)
+{
+	struct calldata params = {0};
+	bool            success = true;
+
+	pthread_mutex_lock(&encoder->update_mutex);
+
+	encoder->update_pending = false;
+	if (encoder->info.update)
+		success = encoder->info.update(encoder->context.data,
+				encoder->context.settings);
+
+	pthread_mutex_unlock(&encoder->update_mutex);
+
+	if (!success)
+		blog(LOG_WARNING, "encoder '%s': Failed to apply updated "
+		                  "settings while active",
+		                  encoder->context.name);
+
+	calldata_set_ptr(&params, "encoder", encoder);
+	calldata_set_bool(&params, "success", success);
+	signal_handler_signal(encoder->context.signals, "update", &params);
+	calldata_free(&params);
+}
+
+void obs_encoder_request_keyframe(obs_encoder_t *encoder)
+{
+	if (!encoder || !encoder->info.request_keyframe)
+		return;
+
+	encoder->keyframe_pending = true;
 }
 
 bool obs_encoder_get_extra_data(const obs_encoder_t *encoder,
@@ -383,6 +554,7 @@ void obs_encoder_start(obs_encoder_t *encoder,
 {
 	struct encoder_callback cb = {false, new_packet, param};
 	bool first   = false;
+	bool added   = false;
 
 	if (!encoder || !new_packet || !encoder->context.data) return;
 
@@ -391,14 +563,20 @@ void obs_encoder_start(obs_encoder_t *encoder,
 	first = (encoder->callbacks.num == 0);
 
 	size_t idx = get_callback_idx(encoder, new_packet, param);
-	if (idx == DARRAY_INVALID)
+	if (idx == DARRAY_INVALID) {
 		da_push_back(encoder->callbacks, &cb);
+		added = true;
+	}
 
 	pthread_mutex_unlock(&encoder->callbacks_mutex);
 
 	if (first) {
 		encoder->cur_pts = 0;
 		add_connection(encoder);
+	} else if (added && encoder->info.type == OBS_ENCODER_VIDEO) {
+		/* the new output would otherwise have to wait until the end
+		 * of the current keyframe interval before it can start */
+		obs_encoder_request_keyframe(encoder);
 	}
 }
 
@@ -415,18 +593,38 @@ void obs_encoder_stop(obs_encoder_t *encoder,
 
 	idx = get_callback_idx(encoder, new_packet, param);
 	if (idx != DARRAY_INVALID) {
-		da_erase(encoder->callbacks, idx);
-		last = (encoder->callbacks.num == 0);
+		last = (encoder->callbacks.num == 1);
+		if (!last)
+			da_erase(encoder->callbacks, idx);
 	}
 
 	pthread_mutex_unlock(&encoder->callbacks_mutex);
 
-	if (last) {
-		remove_connection(encoder);
+	if (!last)
+		return;
 
-		if (encoder->destroy_on_stop)
-			obs_encoder_actually_destroy(encoder);
+	/* the last callback is only removed after the connection, so that the
+	 * frames still queued for encoding are sent to it */
+	remove_connection(encoder);
+
+	pthread_mutex_lock(&encoder->callbacks_mutex);
+
+	idx = get_callback_idx(encoder, new_packet, param);
+	if (idx != DARRAY_INVALID)
+		da_erase(encoder->callbacks, idx);
+	last = (encoder->callbacks.num == 0);
+
+	pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+	/* started again by another output in the meantime */
+	if (!last) {
+		encoder->cur_pts = 0;
+		add_connection(encoder);
+		return;
 	}
+
+	if (encoder->destroy_on_stop)
+		obs_encoder_actually_destroy(encoder);
 }
 
 const char *obs_encoder_get_codec(const obs_encoder_t *encoder)
@@ -468,6 +666,26 @@ void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 	encoder->scaled_height = height;
 }
 
+void obs_encoder_set_scale_cascade(obs_encoder_t *encoder, bool cascade)
+{
+	if (!encoder || encoder->info.type != OBS_ENCODER_VIDEO)
+		return;
+
+	if (encoder->active) {
+		blog(LOG_WARNING, "encoder '%s': Cannot change the scale "
+		                  "cascade while the encoder is active",
+		                  obs_encoder_get_name(encoder));
+		return;
+	}
+
+	encoder->scale_cascade = cascade;
+}
+
+bool obs_encoder_scale_cascade(const obs_encoder_t *encoder)
+{
+	return encoder ? encoder->scale_cascade : false;
+}
+
 uint32_t obs_encoder_get_width(const obs_encoder_t *encoder)
 {
 	if (!encoder || !encoder->media ||
@@ -531,6 +749,20 @@ bool obs_encoder_active(const obs_encoder_t *encoder)
 	return encoder ? encoder->active : false;
 }
 
+size_t obs_encoder_get_num_outputs(obs_encoder_t *encoder)
+{
+	size_t num;
+
+	if (!encoder)
+		return 0;
+
+	pthread_mutex_lock(&encoder->outputs_mutex);
+	num = encoder->outputs.num;
+	pthread_mutex_unlock(&encoder->outputs_mutex);
+
+	return num;
+}
+
 static inline bool get_sei(const struct obs_encoder *encoder,
 		uint8_t **sei, size_t *size)
 {
@@ -540,6 +772,12 @@ static inline bool get_sei(const struct obs_encoder *encoder,
 	return false;
 }
 
+static inline bool is_avc(const struct obs_encoder *encoder)
+{
+	return encoder->info.type == OBS_ENCODER_VIDEO &&
+		encoder->info.codec && strcmp(encoder->info.codec, "h264") == 0;
+}
+
 static void send_first_video_packet(struct obs_encoder *encoder,
 		struct encoder_callback *cb, struct encoder_packet *packet)
 {
@@ -567,9 +805,14 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	first_packet.data = data.array;
 	first_packet.size = data.num;
 
+	obs_encoder_packet_create_instance(&first_packet, &first_packet);
+	if (is_avc(encoder))
+		obs_avc_cache_parsed_packet(&first_packet);
+
 	cb->new_packet(cb->param, &first_packet);
 	cb->sent_first_packet = true;
 
+	obs_encoder_packet_release(&first_packet);
 	da_free(data);
 }
 
@@ -593,8 +836,22 @@ static void full_stop(struct obs_encoder *encoder)
 	}
 }
 
-static inline void do_encode(struct obs_encoder *encoder,
-		struct encoder_frame *frame)
+static inline void update_encode_latency(struct obs_encoder *encoder,
+		uint64_t start_ts)
+{
+	uint64_t latency = os_gettime_ns() - start_ts;
+
+	if (encoder->encode_latency)
+		encoder->encode_latency =
+			(encoder->encode_latency * 7 + latency) / 8;
+	else
+		encoder->encode_latency = latency;
+}
+
+/* returns false if the encoder failed, in which case the caller stops the
+ * encoder with full_stop once it's safe to do so */
+static inline bool do_encode(struct obs_encoder *encoder,
+		struct encoder_frame *frame, uint64_t start_ts)
 {
 	struct encoder_packet pkt = {0};
 	bool received = false;
@@ -604,30 +861,169 @@ static inline void do_encode(struct obs_encoder *encoder,
 	pkt.timebase_den = encoder->timebase_den;
 	pkt.encoder = encoder;
 
+	if (encoder->update_pending)
+		apply_pending_update(encoder);
+
+	if (encoder->keyframe_pending) {
+		encoder->keyframe_pending = false;
+		encoder->info.request_keyframe(encoder->context.data);
+	}
+
 	success = encoder->info.encode(encoder->context.data, frame, &pkt,
 			&received);
+	update_encode_latency(encoder, start_ts);
+
 	if (!success) {
-		full_stop(encoder);
 		blog(LOG_ERROR, "Error encoding with encoder '%s'",
 				encoder->context.name);
-		return;
+		return false;
 	}
 
 	if (received) {
+		struct encoder_packet shared;
+
 		/* we use system time here to ensure sync with other encoders,
 		 * you do not want to use relative timestamps here */
 		pkt.dts_usec = encoder->start_ts / 1000 + packet_dts_usec(&pkt);
 
+		/* the packet data is copied once and shared by every output,
+		 * and H.264 data is only parsed once for all of them */
+		obs_encoder_packet_create_instance(&shared, &pkt);
+		if (is_avc(encoder))
+			obs_avc_cache_parsed_packet(&shared);
+
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
 		for (size_t i = 0; i < encoder->callbacks.num; i++) {
 			struct encoder_callback *cb;
 			cb = encoder->callbacks.array+i;
-			send_packet(encoder, cb, &pkt);
+			send_packet(encoder, cb, &shared);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
+
+		obs_encoder_packet_release(&shared);
+	}
+
+	return true;
+}
+
+/* returns false if the encoder failed */
+static bool encode_queued_frame(struct obs_encoder *encoder)
+{
+	struct encoder_queued_frame *queued;
+	struct encoder_frame        enc_frame;
+	bool                        success;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	queued = encoder->queue_count ?
+		&encoder->queue[encoder->queue_first] : NULL;
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	if (!queued)
+		return true;
+
+	memset(&enc_frame, 0, sizeof(struct encoder_frame));
+
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		enc_frame.data[i]     = queued->frame.data[i];
+		enc_frame.linesize[i] = queued->frame.linesize[i];
+	}
+
+	enc_frame.frames = 1;
+	enc_frame.pts    = queued->pts;
+
+	success = do_encode(encoder, &enc_frame, queued->queued_ts);
+
+	/* the slot stays reserved until the encode call has returned */
+	pthread_mutex_lock(&encoder->queue_mutex);
+	encoder->queue_first = (encoder->queue_first + 1) % ENCODER_QUEUE_SIZE;
+	encoder->queue_count--;
+	encoder->queue_depth = (long)encoder->queue_count;
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	return success;
+}
+
+static inline bool queue_empty(struct obs_encoder *encoder)
+{
+	bool empty;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	empty = encoder->queue_count == 0;
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	return empty;
+}
+
+/*
+ * The encode thread never stops the encoder itself.  If the encoder fails,
+ * the thread exits and the video thread stops the encoder on the next frame,
+ * joining the thread, so nothing is touched after it could have been freed.
+ */
+static void *encode_thread(void *data)
+{
+	struct obs_encoder *encoder = data;
+
+	os_set_thread_name("libobs: encode thread");
+
+	while (os_sem_wait(encoder->encode_sem) == 0) {
+		if (encoder->thread_stop) {
+			while (!queue_empty(encoder))
+				if (!encode_queued_frame(encoder))
+					break;
+			break;
+		}
+
+		if (!encode_queued_frame(encoder)) {
+			encoder->thread_failed = true;
+			break;
+		}
 	}
+
+	return NULL;
+}
+
+static void queue_video_frame(struct obs_encoder *encoder,
+		struct video_data *frame)
+{
+	struct encoder_queued_frame *queued;
+	struct video_frame          src;
+	bool                        full;
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+
+	full = encoder->queue_count == ENCODER_QUEUE_SIZE;
+	queued = &encoder->queue[(encoder->queue_first + encoder->queue_count)
+		% ENCODER_QUEUE_SIZE];
+
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	if (full) {
+		os_atomic_inc_long(&encoder->frames_dropped);
+		return;
+	}
+
+	/* the free slot is not touched by the encode thread until it's been
+	 * added to the queue count */
+	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+		src.data[i]     = frame->data[i];
+		src.linesize[i] = frame->linesize[i];
+	}
+
+	video_frame_copy(&queued->frame, &src, encoder->queue_format,
+			encoder->queue_height);
+	queued->pts       = encoder->cur_pts;
+	queued->queued_ts = os_gettime_ns();
+
+	pthread_mutex_lock(&encoder->queue_mutex);
+	encoder->queue_count++;
+	encoder->queue_depth = (long)encoder->queue_count;
+	if (encoder->queue_depth > encoder->max_queue_depth)
+		encoder->max_queue_depth = encoder->queue_depth;
+	pthread_mutex_unlock(&encoder->queue_mutex);
+
+	os_sem_post(encoder->encode_sem);
 }
 
 static void receive_video(void *param, struct video_data *frame)
@@ -635,6 +1031,22 @@ static void receive_video(void *param, struct video_data *frame)
 	struct obs_encoder    *encoder  = param;
 	struct encoder_frame  enc_frame;
 
+	if (encoder->thread_failed) {
+		full_stop(encoder);
+		return;
+	}
+
+	if (!encoder->start_ts)
+		encoder->start_ts = frame->timestamp;
+
+	/* the pts is incremented for dropped frames as well so that the
+	 * encoder sees the gap */
+	if (encoder->thread_active) {
+		queue_video_frame(encoder, frame);
+		encoder->cur_pts += encoder->timebase_num;
+		return;
+	}
+
 	memset(&enc_frame, 0, sizeof(struct encoder_frame));
 
 	for (size_t i = 0; i < MAX_AV_PLANES; i++) {
@@ -642,13 +1054,13 @@ static void receive_video(void *param, struct video_data *frame)
 		enc_frame.linesize[i] = frame->linesize[i];
 	}
 
-	if (!encoder->start_ts)
-		encoder->start_ts = frame->timestamp;
-
 	enc_frame.frames = 1;
 	enc_frame.pts    = encoder->cur_pts;
 
-	do_encode(encoder, &enc_frame);
+	if (!do_encode(encoder, &enc_frame, os_gettime_ns())) {
+		full_stop(encoder);
+		return;
+	}
 
 	encoder->cur_pts += encoder->timebase_num;
 }
@@ -697,7 +1109,7 @@ static bool buffer_audio(struct obs_encoder *encoder, struct audio_data *data)
 	return true;
 }
 
-static void send_audio_data(struct obs_encoder *encoder)
+static bool send_audio_data(struct obs_encoder *encoder)
 {
 	struct encoder_frame  enc_frame;
 
@@ -715,9 +1127,13 @@ static void send_audio_data(struct obs_encoder *encoder)
 	enc_frame.frames = (uint32_t)encoder->framesize;
 	enc_frame.pts    = encoder->cur_pts;
 
-	do_encode(encoder, &enc_frame);
+	if (!do_encode(encoder, &enc_frame, os_gettime_ns())) {
+		full_stop(encoder);
+		return false;
+	}
 
 	encoder->cur_pts += encoder->framesize;
+	return true;
 }
 
 static void receive_audio(void *param, size_t mix_idx, struct audio_data *data)
@@ -728,7 +1144,8 @@ static void receive_audio(void *param, size_t mix_idx, struct audio_data *data)
 		return;
 
 	while (encoder->audio_input_buffer[0].size >= encoder->framesize_bytes)
-		send_audio_data(encoder);
+		if (!send_audio_data(encoder))
+			break;
 
 	UNUSED_PARAMETER(mix_idx);
 }
@@ -766,6 +1183,70 @@ void obs_free_encoder_packet(struct encoder_packet *packet)
 	memset(packet, 0, sizeof(struct encoder_packet));
 }
 
+uint8_t *packet_buffer_alloc(size_t size)
+{
+	uint8_t              *data = bmalloc(PACKET_BUFFER_HEADER_SIZE + size);
+	struct packet_buffer *buf  = (struct packet_buffer*)data;
+
+	buf->refs     = 1;
+	buf->avc_data = NULL;
+	buf->avc_size = 0;
+
+	return data + PACKET_BUFFER_HEADER_SIZE;
+}
+
+void obs_encoder_packet_create_instance(struct encoder_packet *dst,
+		const struct encoder_packet *src)
+{
+	uint8_t *data;
+
+	if (!dst || !src)
+		return;
+
+	data = packet_buffer_alloc(src->size);
+
+	if (src->size)
+		memcpy(data, src->data, src->size);
+
+	*dst      = *src;
+	dst->data = data;
+}
+
+void obs_encoder_packet_ref(struct encoder_packet *dst,
+		struct encoder_packet *src)
+{
+	if (!dst || !src)
+		return;
+
+	if (src->data)
+		os_atomic_inc_long(&get_packet_buffer(src->data)->refs);
+
+	*dst = *src;
+}
+
+static void release_packet_data(uint8_t *data)
+{
+	struct packet_buffer *buf;
+
+	if (!data)
+		return;
+
+	buf = get_packet_buffer(data);
+	if (os_atomic_dec_long(&buf->refs) == 0) {
+		release_packet_data(buf->avc_data);
+		bfree(buf);
+	}
+}
+
+void obs_encoder_packet_release(struct encoder_packet *packet)
+{
+	if (!packet)
+		return;
+
+	release_packet_data(packet->data);
+	memset(packet, 0, sizeof(struct encoder_packet));
+}
+
 void obs_encoder_set_preferred_video_format(obs_encoder_t *encoder,
 		enum video_format format)
 {
@@ -783,3 +1264,43 @@ enum video_format obs_encoder_get_preferred_video_format(
 
 	return encoder->preferred_format;
 }
+
+void obs_encoder_set_async(obs_encoder_t *encoder, bool async)
+{
+	if (!encoder || encoder->info.type != OBS_ENCODER_VIDEO)
+		return;
+
+	if (encoder->active) {
+		blog(LOG_WARNING, "encoder '%s': Cannot change asynchronous "
+		                  "encoding while the encoder is active",
+		                  obs_encoder_get_name(encoder));
+		return;
+	}
+
+	encoder->async = async;
+}
+
+bool obs_encoder_async(const obs_encoder_t *encoder)
+{
+	return encoder ? encoder->async : false;
+}
+
+int obs_encoder_get_frames_dropped(const obs_encoder_t *encoder)
+{
+	return encoder ? (int)encoder->frames_dropped : 0;
+}
+
+int obs_encoder_get_queue_depth(const obs_encoder_t *encoder)
+{
+	return encoder ? (int)encoder->queue_depth : 0;
+}
+
+int obs_encoder_get_max_queue_depth(const obs_encoder_t *encoder)
+{
+	return encoder ? (int)encoder->max_queue_depth : 0;
+}
+
+uint64_t obs_encoder_get_encode_latency(const obs_encoder_t *encoder)
+{
+	return encoder ? encoder->encode_latency : 0;
+}
@@ -180,6 +180,11 @@ struct obs_encoder_info {
 	 * Updates the settings for this encoder (usually used for things like
 	 * changeing birate while active)
 	 *
+	 * If the encoder is active, this is called on the encoding thread
+	 * between calls to encode, so it does not need to be synchronized
+	 * with encoding.  Settings that cannot be changed while encoding
+	 * should be left as they are.
+	 *
 	 * @param  data      Data associated with this encoder context
 	 * @param  settings  New settings for this encoder
 	 * @return           true if successful, false otherwise
@@ -223,6 +228,15 @@ struct obs_encoder_info {
 	 * @param[in/out]  info  Video format information
 	 */
 	void (*get_video_info)(void *data, struct video_scale_info *info);
+
+	/**
+	 * Requests that the next frame be encoded as a keyframe (optional,
+	 * video encoders only).  Always called from the thread that encodes,
+	 * right before the next call to encode.
+	 *
+	 * @param  data  Data associated with this encoder context
+	 */
+	void (*request_keyframe)(void *data);
 };
 
 EXPORT void obs_register_encoder_s(const struct obs_encoder_info *info,
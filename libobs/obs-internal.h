@@ -22,6 +22,7 @@
 #include "util/circlebuf.h"
 #include "util/dstr.h"
 #include "util/threading.h"
+#include "util/task-pool.h"
 #include "util/platform.h"
 #include "callback/signal.h"
 #include "callback/proc.h"
@@ -30,6 +31,7 @@
 
 #include "media-io/audio-resampler.h"
 #include "media-io/video-io.h"
+#include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
 
 #include "obs.h"
@@ -162,6 +164,16 @@ struct obs_core_video {
 	pthread_t                       video_thread;
 	bool                            thread_initialized;
 
+	/* sources flagged with OBS_SOURCE_PARALLEL_TICK (and base volume
+	 * calculation) are distributed over this pool each frame */
+	task_pool_t                     *tick_pool;
+	DARRAY(struct obs_source*)      tick_sources;
+	float                           tick_seconds;
+
+	/* incremented every time sources are ticked, used to determine
+	 * whether a source was culled during the last frame */
+	volatile long                   tick_frame;
+
 	bool                            gpu_conversion;
 	const char                      *conversion_tech;
 	uint32_t                        conversion_height;
@@ -187,10 +199,57 @@ struct obs_core_audio {
 	float                           present_volume;
 };
 
-/* user sources, output channels, and displays */
+/* ------------------------------------------------------------------------- */
+/* name index */
+
+/*
+ * Hash index of contexts by name, kept alongside the context lists so that
+ * lookups by name don't have to walk the entire list.  Contexts are chained
+ * through obs_context_data::hash_next, and the index is protected by the
+ * mutex that was given when the context was added to it.
+ *
+ * Names aren't required to be unique.  When several contexts share a name,
+ * lookups return the one added first if find_oldest is set, or the one added
+ * last otherwise, matching the order the lists were searched in before.
+ */
+struct obs_context_index {
+	struct obs_context_data         **buckets;
+	size_t                          num_buckets;
+	size_t                          count;
+	uint64_t                        next_order;
+	bool                            find_oldest;
+};
+
+/* FNV-1a */
+static inline uint32_t obs_hash_name(const char *name)
+{
+	uint32_t hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (uint8_t)*(name++);
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+extern void obs_context_index_free(struct obs_context_index *index);
+
+/*
+ * user sources, output channels, and displays
+ *
+ * Lock order: user_sources_mutex may be held while locking sources_mutex
+ * (sources are created and destroyed with the user source list locked), but
+ * never the other way around.  No source callbacks are called with
+ * sources_mutex held for that reason, see tick_sources in obs-video.c.
+ */
 struct obs_core_data {
 	pthread_mutex_t                 user_sources_mutex;
 	DARRAY(struct obs_source*)      user_sources;
+	struct obs_context_index        user_sources_index;
+
+	/* incremented whenever a source is renamed */
+	volatile long                   source_rename_count;
 
 	struct obs_source               *first_source;
 	struct obs_display              *first_display;
@@ -204,6 +263,10 @@ struct obs_core_data {
 	pthread_mutex_t                 encoders_mutex;
 	pthread_mutex_t                 services_mutex;
 
+	struct obs_context_index        outputs_index;
+	struct obs_context_index        encoders_index;
+	struct obs_context_index        services_index;
+
 	struct obs_view                 main_view;
 
 	volatile long                   active_transitions;
@@ -259,6 +322,12 @@ struct obs_context_data {
 	pthread_mutex_t                 *mutex;
 	struct obs_context_data         *next;
 	struct obs_context_data         **prev_next;
+
+	struct obs_context_index        *index;
+	pthread_mutex_t                 *index_mutex;
+	struct obs_context_data         *hash_next;
+	uint32_t                        name_hash;
+	uint64_t                        index_order;
 };
 
 extern bool obs_context_data_init(
@@ -268,9 +337,16 @@ extern bool obs_context_data_init(
 extern void obs_context_data_free(struct obs_context_data *context);
 
 extern void obs_context_data_insert(struct obs_context_data *context,
-		pthread_mutex_t *mutex, void *first);
+		pthread_mutex_t *mutex, void *first,
+		struct obs_context_index *index);
 extern void obs_context_data_remove(struct obs_context_data *context);
 
+extern void obs_context_index_add(struct obs_context_index *index,
+		pthread_mutex_t *mutex, struct obs_context_data *context);
+extern void obs_context_index_remove(struct obs_context_data *context);
+extern void *obs_context_index_find(const struct obs_context_index *index,
+		const char *name);
+
 extern void obs_context_data_setname(struct obs_context_data *context,
 		const char *name);
 
@@ -371,6 +447,27 @@ struct obs_source {
 	gs_texrender_t                  *filter_texrender;
 	enum obs_allow_direct_render    allow_direct;
 	bool                            rendering_filter;
+
+	/* combined effect of the per-pixel filters below this filter */
+	gs_effect_t                     *fused_effect;
+	struct dstr                     fused_key;
+	bool                            fused_failed;
+
+	/* render cache (OBS_SOURCE_STATIC_VIDEO) */
+	gs_texrender_t                  *render_cache;
+	uint32_t                        render_cache_cx;
+	uint32_t                        render_cache_cy;
+	volatile bool                   render_cache_valid;
+	volatile bool                   render_cache_checked;
+	bool                            render_cache_allowed;
+	bool                            rendering_cache;
+
+	/* culling (tick_frame values of the last render and the last time a
+	 * scene culled the source) */
+	volatile long                   render_frame;
+	volatile long                   cull_frame;
+	float                           culled_seconds;
+	int                             culled_ticks;
 };
 
 extern const struct obs_source_info *find_source(struct darray *list,
@@ -387,6 +484,9 @@ enum view_type {
 	AUX_VIEW
 };
 
+extern bool obs_source_opaque(obs_source_t *source);
+extern void obs_source_mark_culled(obs_source_t *source);
+
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
@@ -397,6 +497,39 @@ extern float obs_source_get_target_volume(obs_source_t *source,
 /* ------------------------------------------------------------------------- */
 /* outputs  */
 
+#define INTERLEAVE_TRACKS (1 + MAX_AUDIO_MIXES)
+
+struct interleaved_packet {
+	struct encoder_packet           packet;
+	uint64_t                        order;
+	uint64_t                        queued_ts;
+};
+
+/* packets past the memory limit of the output delay are written to a ring
+ * buffer in a file by the spill thread, and read back shortly before they
+ * are due.  only the spill thread touches the file */
+struct delay_spill {
+	struct dstr                     path;
+	size_t                          memory_limit;
+	uint64_t                        size;
+
+	FILE                            *file;
+	uint64_t                        head;
+	uint64_t                        tail;
+	uint64_t                        used;
+	bool                            warned_full;
+
+	/* packets are numbered in the order they were queued */
+	uint64_t                        front_seq;
+	uint64_t                        write_seq;
+	uint64_t                        read_seq;
+
+	pthread_t                       thread;
+	bool                            thread_active;
+	os_event_t                      *event;
+	volatile bool                   stop;
+};
+
 struct obs_output {
 	struct obs_context_data         context;
 	struct obs_output_info          info;
@@ -407,8 +540,44 @@ struct obs_output {
 	int64_t                         audio_offsets[MAX_AUDIO_MIXES];
 	int64_t                         highest_audio_ts;
 	int64_t                         highest_video_ts;
+
+	/* packets are queued per track (video, then each audio mix) in the
+	 * order they arrive, and the tracks are merged through a min-heap
+	 * ordered by the dts of the packet at the front of each queue */
 	pthread_mutex_t                 interleaved_mutex;
-	DARRAY(struct encoder_packet)   interleaved_packets;
+	struct circlebuf                interleaved_queues[INTERLEAVE_TRACKS];
+	size_t                          interleaved_heap[INTERLEAVE_TRACKS];
+	size_t                          interleaved_heap_size;
+	size_t                          interleaved_count;
+	uint64_t                        interleaved_order;
+	uint64_t                        interleave_latency;
+	uint64_t                        max_interleave_latency;
+	bool                            interleave_overflow;
+	bool                            interleave_skip_video;
+
+	/* encoded packets are held back for active_delay_ns before being
+	 * passed to the output, see obs-output-delay.c */
+	uint32_t                        delay_sec;
+	uint32_t                        delay_flags;
+	uint64_t                        active_delay_ns;
+	pthread_mutex_t                 delay_mutex;
+	struct circlebuf                delay_data;
+	size_t                          delay_memory_used;
+	struct delay_spill              delay_spill;
+
+	/* due packets are passed to the output by one thread at a time,
+	 * without delay_mutex locked */
+	bool                            delay_sending;
+	bool                            delay_send_waiting;
+	DARRAY(struct encoder_packet)   delay_send_packets;
+	os_event_t                      *delay_flush_event;
+
+	/* stopping after the delay has passed */
+	bool                            delay_stopping;
+	uint64_t                        delay_stop_ts;
+	pthread_t                       delay_stop_thread;
+	os_event_t                      *delay_stop_event;
+	bool                            delay_stop_thread_active;
 
 	int                             reconnect_retry_sec;
 	int                             reconnect_retry_max;
@@ -448,6 +617,15 @@ extern const struct obs_output_info *find_output(const char *id);
 extern void obs_output_remove_encoder(struct obs_output *output,
 		struct obs_encoder *encoder);
 
+extern void obs_output_actual_stop(struct obs_output *output);
+
+extern bool obs_output_delay_start(struct obs_output *output);
+extern void obs_output_delay_end(struct obs_output *output);
+extern void obs_output_delay_packet(struct obs_output *output,
+		struct encoder_packet *packet);
+extern void obs_output_delay_flush(struct obs_output *output,
+		uint64_t until_ts);
+
 
 /* ------------------------------------------------------------------------- */
 /* encoders  */
@@ -458,6 +636,39 @@ struct encoder_callback {
 	void *param;
 };
 
+/*
+ * Reference-counted encoder packet data.  The header is stored directly in
+ * front of the packet data, and optionally holds a reference to the parsed
+ * (length-prefixed) version of H.264 data, which is a reference-counted
+ * buffer itself.
+ */
+struct packet_buffer {
+	volatile long                   refs;
+	uint8_t                         *avc_data;
+	size_t                          avc_size;
+};
+
+#define PACKET_BUFFER_HEADER_SIZE \
+	((sizeof(struct packet_buffer) + 15) & ~(size_t)15)
+
+static inline struct packet_buffer *get_packet_buffer(const uint8_t *data)
+{
+	return (struct packet_buffer*)(data - PACKET_BUFFER_HEADER_SIZE);
+}
+
+/* allocates uninitialized packet data with one reference */
+extern uint8_t *packet_buffer_alloc(size_t size);
+
+extern void obs_avc_cache_parsed_packet(struct encoder_packet *packet);
+
+#define ENCODER_QUEUE_SIZE 4
+
+struct encoder_queued_frame {
+	struct video_frame              frame;
+	int64_t                         pts;
+	uint64_t                        queued_ts;
+};
+
 struct obs_encoder {
 	struct obs_context_data         context;
 	struct obs_encoder_info         info;
@@ -473,6 +684,7 @@ struct obs_encoder {
 	uint32_t                        scaled_width;
 	uint32_t                        scaled_height;
 	enum video_format               preferred_format;
+	bool                            scale_cascade;
 
 	bool                            active;
 
@@ -502,6 +714,38 @@ struct obs_encoder {
 
 	pthread_mutex_t                 callbacks_mutex;
 	DARRAY(struct encoder_callback) callbacks;
+
+	/* settings changed while active are applied by the encoding thread
+	 * before the next frame is encoded */
+	pthread_mutex_t                 update_mutex;
+	volatile bool                   update_pending;
+
+	/* keyframe requests are also passed on by the encoding thread */
+	volatile bool                   keyframe_pending;
+
+	/* asynchronous encoding (video encoders only).  frames are copied in
+	 * to a fixed ring of buffers and encoded on a separate thread so that
+	 * a slow encoder doesn't hold up the video output thread.  if the
+	 * ring is full, the frame is dropped */
+	bool                            async;
+	bool                            thread_active;
+	volatile bool                   thread_stop;
+	volatile bool                   thread_failed;
+	pthread_t                       encode_thread;
+	os_sem_t                        *encode_sem;
+	pthread_mutex_t                 queue_mutex;
+	struct encoder_queued_frame     queue[ENCODER_QUEUE_SIZE];
+	size_t                          queue_first;
+	size_t                          queue_count;
+	enum video_format               queue_format;
+	uint32_t                        queue_width;
+	uint32_t                        queue_height;
+
+	/* statistics */
+	volatile long                   frames_dropped;
+	volatile long                   queue_depth;
+	volatile long                   max_queue_depth;
+	uint64_t                        encode_latency;
 };
 
 extern struct obs_encoder_info *find_encoder(const char *id);
@@ -0,0 +1,561 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <inttypes.h>
+#include "obs.h"
+#include "obs-internal.h"
+
+/*
+ *   Output delay.  Encoded packets are held back in a queue with the time they
+ * arrived, and are passed on to the output once the delay has passed.  The
+ * queue is processed each time a new packet arrives, which happens many times
+ * per second while the output is active.
+ *
+ *   Holding encoded data costs a small fraction of what holding raw frames
+ * does, but for very long delays the packets past a memory limit can be
+ * written to a ring buffer in a file and read back when they are due.  The
+ * file is only accessed from its own thread, as the packets arrive on the
+ * encoder threads, which must never wait on the disk.
+ */
+
+/* how long before they're due that spilled packets are read back */
+#define SPILL_READ_AHEAD_NS 2000000000ULL
+
+/* how often the spill thread checks for packets to read back when no new
+ * packets arrive */
+#define SPILL_INTERVAL_MS 50
+
+struct delay_data {
+	uint64_t              ts;
+	bool                  spilled;
+	bool                  lost;
+	uint64_t              spill_pos;
+	struct encoder_packet packet;
+};
+
+static inline size_t delay_count(struct obs_output *output)
+{
+	return output->delay_data.size / sizeof(struct delay_data);
+}
+
+/* gets a queued packet by its number, returns false if it's been sent */
+static bool get_delay_data(struct obs_output *output, uint64_t seq,
+		struct delay_data *dd)
+{
+	uint64_t front = output->delay_spill.front_seq;
+
+	if (seq < front || seq - front >= delay_count(output))
+		return false;
+
+	circlebuf_peek_at(&output->delay_data,
+			(size_t)(seq - front) * sizeof(*dd), dd, sizeof(*dd));
+	return true;
+}
+
+static void set_delay_data(struct obs_output *output, uint64_t seq,
+		const struct delay_data *dd)
+{
+	uint64_t front = output->delay_spill.front_seq;
+
+	circlebuf_place(&output->delay_data,
+			(size_t)(seq - front) * sizeof(*dd), dd, sizeof(*dd));
+}
+
+static inline bool due_soon(struct obs_output *output,
+		const struct delay_data *dd, uint64_t ts)
+{
+	return dd->ts + output->active_delay_ns <= ts + SPILL_READ_AHEAD_NS;
+}
+
+static inline bool spill_io(struct delay_spill *spill, uint64_t pos,
+		uint8_t *data, size_t size, bool write)
+{
+	if (os_fseeki64(spill->file, (int64_t)pos, SEEK_SET) != 0)
+		return false;
+
+	if (write)
+		return fwrite(data, 1, size, spill->file) == size;
+	else
+		return fread(data, 1, size, spill->file) == size;
+}
+
+/* the data wraps around at the end of the file */
+static bool spill_ring_io(struct delay_spill *spill, uint64_t pos,
+		uint8_t *data, size_t size, bool write)
+{
+	size_t first = size;
+
+	if (pos + size > spill->size)
+		first = (size_t)(spill->size - pos);
+
+	if (!spill_io(spill, pos, data, first, write))
+		return false;
+	if (first < size && !spill_io(spill, 0, data + first, size - first,
+				write))
+		return false;
+
+	return true;
+}
+
+/*
+ * Writes the next packet past the memory limit to the spill file.  Packets
+ * are written in the order they arrived, which is also the order they're
+ * read back in, so the file works as a ring buffer.  Returns true if there
+ * may be more to do.
+ */
+static bool spill_next_packet(struct obs_output *output)
+{
+	struct delay_spill    *spill = &output->delay_spill;
+	struct encoder_packet packet;
+	struct delay_data     dd;
+	uint64_t              seq;
+	uint64_t              pos;
+	size_t                size;
+	bool                  success;
+
+	pthread_mutex_lock(&output->delay_mutex);
+
+	if (spill->write_seq < spill->front_seq)
+		spill->write_seq = spill->front_seq;
+
+	seq = spill->write_seq;
+
+	if (output->delay_memory_used <= spill->memory_limit ||
+	    !get_delay_data(output, seq, &dd)) {
+		pthread_mutex_unlock(&output->delay_mutex);
+		return false;
+	}
+
+	size = dd.packet.size;
+
+	/* packets that will be sent soon aren't worth writing out */
+	if (!size || due_soon(output, &dd, os_gettime_ns())) {
+		spill->write_seq++;
+		pthread_mutex_unlock(&output->delay_mutex);
+		return true;
+	}
+
+	if (spill->used + size > spill->size) {
+		if (!spill->warned_full)
+			blog(LOG_WARNING, "Output '%s': delay spill file is "
+			                  "full, keeping packets in memory",
+			                  output->context.name);
+		spill->warned_full = true;
+		spill->write_seq++;
+		pthread_mutex_unlock(&output->delay_mutex);
+		return true;
+	}
+
+	obs_encoder_packet_ref(&packet, &dd.packet);
+	pos = spill->head;
+
+	pthread_mutex_unlock(&output->delay_mutex);
+
+	success = spill_ring_io(spill, pos, packet.data, size, true);
+	if (!success)
+		blog(LOG_WARNING, "Output '%s': failed to write to the delay "
+		                  "spill file", output->context.name);
+
+	pthread_mutex_lock(&output->delay_mutex);
+
+	/* the packet may have been sent while it was being written */
+	if (success && get_delay_data(output, seq, &dd) && !dd.spilled) {
+		obs_encoder_packet_release(&dd.packet);
+		output->delay_memory_used -= size;
+
+		dd.packet.data = NULL;
+		dd.spilled     = true;
+		dd.spill_pos   = pos;
+		set_delay_data(output, seq, &dd);
+
+		spill->head  = (pos + size) % spill->size;
+		spill->used += size;
+	}
+
+	spill->write_seq++;
+
+	pthread_mutex_unlock(&output->delay_mutex);
+
+	obs_encoder_packet_release(&packet);
+	return true;
+}
+
+/* reads spilled packet data back in to a reference-counted buffer */
+static uint8_t *read_spilled_data(struct delay_spill *spill, uint64_t pos,
+		size_t size)
+{
+	uint8_t *data = packet_buffer_alloc(size);
+
+	if (!spill_ring_io(spill, pos, data, size, false)) {
+		bfree(get_packet_buffer(data));
+		return NULL;
+	}
+
+	return data;
+}
+
+/* reads back the next spilled packet if it's due soon, returns true if there
+ * may be more to do */
+static bool unspill_next_packet(struct obs_output *output)
+{
+	struct delay_spill *spill = &output->delay_spill;
+	struct delay_data  dd;
+	uint64_t           seq;
+	uint8_t            *data;
+
+	pthread_mutex_lock(&output->delay_mutex);
+
+	if (spill->read_seq < spill->front_seq)
+		spill->read_seq = spill->front_seq;
+
+	for (seq = spill->read_seq; seq < spill->write_seq; seq++) {
+		if (!get_delay_data(output, seq, &dd) || dd.spilled)
+			break;
+	}
+
+	spill->read_seq = seq;
+
+	if (seq == spill->write_seq || !get_delay_data(output, seq, &dd) ||
+	    !due_soon(output, &dd, os_gettime_ns())) {
+		pthread_mutex_unlock(&output->delay_mutex);
+		return false;
+	}
+
+	pthread_mutex_unlock(&output->delay_mutex);
+
+	/* spilled packets stay queued until they're read back, so the entry
+	 * can't go away in the meantime */
+	data = read_spilled_data(spill, dd.spill_pos, dd.packet.size);
+	if (!data)
+		blog(LOG_WARNING, "Output '%s': failed to read from the delay "
+		                  "spill file", output->context.name);
+
+	pthread_mutex_lock(&output->delay_mutex);
+
+	spill->tail  = (dd.spill_pos + dd.packet.size) % spill->size;
+	spill->used -= dd.packet.size;
+
+	dd.spilled     = false;
+	dd.lost        = !data;
+	dd.packet.data = data;
+	set_delay_data(output, seq, &dd);
+
+	if (data)
+		output->delay_memory_used += dd.packet.size;
+
+	spill->read_seq++;
+
+	pthread_mutex_unlock(&output->delay_mutex);
+
+	/* a flush may be waiting on this packet */
+	os_event_signal(output->delay_flush_event);
+	return true;
+}
+
+static void *delay_spill_thread(void *param)
+{
+	struct obs_output  *output = param;
+	struct delay_spill *spill  = &output->delay_spill;
+
+	os_set_thread_name("obs-output-delay-spill");
+
+	while (!spill->stop) {
+		while (!spill->stop &&
+		       (unspill_next_packet(output) ||
+		        spill_next_packet(output)))
+			;
+
+		os_event_timedwait(spill->event, SPILL_INTERVAL_MS);
+	}
+
+	return NULL;
+}
+
+/* takes the due packets off the queue, returns false if it has to wait for a
+ * packet to be read back first */
+static bool pop_due_packets(struct obs_output *output, uint64_t until_ts)
+{
+	while (output->delay_data.size) {
+		struct delay_data dd;
+
+		circlebuf_peek_front(&output->delay_data, &dd, sizeof(dd));
+		if (dd.ts + output->active_delay_ns > until_ts)
+			break;
+		if (dd.spilled)
+			return false;
+
+		circlebuf_pop_front(&output->delay_data, NULL, sizeof(dd));
+		output->delay_spill.front_seq++;
+
+		if (!dd.lost) {
+			output->delay_memory_used -= dd.packet.size;
+			da_push_back(output->delay_send_packets, &dd.packet);
+		}
+	}
+
+	return true;
+}
+
+static void send_popped_packets(struct obs_output *output)
+{
+	for (size_t i = 0; i < output->delay_send_packets.num; i++) {
+		struct encoder_packet *packet =
+			output->delay_send_packets.array + i;
+
+		if (!output->stopped)
+			output->info.encoded_packet(output->context.data,
+					packet);
+		obs_encoder_packet_release(packet);
+	}
+
+	da_resize(output->delay_send_packets, 0);
+}
+
+/*
+ * Sends every packet that arrived at or before until_ts minus the delay.
+ *
+ *   The output is called with the delay mutex unlocked, as it may stop itself
+ * from its encoded_packet callback.  To keep the packets in order only one
+ * thread sends at a time, and a thread that finds another one sending leaves
+ * the due packets to it.  Returns false if it couldn't send everything due,
+ * because a packet has to be read back first or another thread is sending.
+ */
+static bool send_due_packets(struct obs_output *output, uint64_t until_ts)
+{
+	bool done;
+	bool wake;
+
+	pthread_mutex_lock(&output->delay_mutex);
+
+	if (output->delay_sending) {
+		output->delay_send_waiting = true;
+		pthread_mutex_unlock(&output->delay_mutex);
+		return false;
+	}
+
+	output->delay_sending = true;
+
+	for (;;) {
+		done = pop_due_packets(output, until_ts);
+		if (!output->delay_send_packets.num)
+			break;
+
+		pthread_mutex_unlock(&output->delay_mutex);
+		send_popped_packets(output);
+		pthread_mutex_lock(&output->delay_mutex);
+	}
+
+	output->delay_sending = false;
+	wake = output->delay_send_waiting;
+	output->delay_send_waiting = false;
+
+	pthread_mutex_unlock(&output->delay_mutex);
+
+	if (wake)
+		os_event_signal(output->delay_flush_event);
+	return done;
+}
+
+void obs_output_delay_packet(struct obs_output *output,
+		struct encoder_packet *packet)
+{
+	struct delay_data dd = {0};
+
+	dd.ts = os_gettime_ns();
+
+	pthread_mutex_lock(&output->delay_mutex);
+
+	/* when stopping after the delay, nothing after the stop is sent */
+	if (!output->delay_stopping || dd.ts <= output->delay_stop_ts) {
+		obs_encoder_packet_ref(&dd.packet, packet);
+		output->delay_memory_used += dd.packet.size;
+
+		circlebuf_push_back(&output->delay_data, &dd, sizeof(dd));
+	}
+
+	pthread_mutex_unlock(&output->delay_mutex);
+
+	send_due_packets(output, dd.ts);
+
+	if (output->delay_spill.thread_active)
+		os_event_signal(output->delay_spill.event);
+}
+
+void obs_output_delay_flush(struct obs_output *output, uint64_t until_ts)
+{
+	while (!send_due_packets(output, until_ts)) {
+		/* a forced stop skips the rest */
+		if (os_event_try(output->delay_stop_event) == 0)
+			break;
+
+		/* wait for the spill thread to read the next packet back, or
+		 * for another thread to finish sending */
+		os_event_signal(output->delay_spill.event);
+		os_event_wait(output->delay_flush_event);
+	}
+}
+
+static void free_delay_data(struct obs_output *output)
+{
+	while (output->delay_data.size) {
+		struct delay_data dd;
+
+		circlebuf_pop_front(&output->delay_data, &dd, sizeof(dd));
+		if (!dd.spilled && !dd.lost)
+			obs_encoder_packet_release(&dd.packet);
+	}
+
+	circlebuf_free(&output->delay_data);
+	output->delay_memory_used = 0;
+}
+
+static void stop_spill_thread(struct delay_spill *spill)
+{
+	if (spill->thread_active) {
+		spill->stop = true;
+		os_event_signal(spill->event);
+		pthread_join(spill->thread, NULL);
+		spill->thread_active = false;
+	}
+}
+
+static void close_spill_file(struct delay_spill *spill)
+{
+	if (spill->file) {
+		fclose(spill->file);
+		os_unlink(spill->path.array);
+		spill->file = NULL;
+	}
+
+	spill->head = 0;
+	spill->tail = 0;
+	spill->used = 0;
+	spill->warned_full = false;
+
+	spill->front_seq = 0;
+	spill->write_seq = 0;
+	spill->read_seq  = 0;
+}
+
+static void open_spill_file(struct obs_output *output)
+{
+	struct delay_spill *spill = &output->delay_spill;
+
+	spill->file = os_fopen(spill->path.array, "w+b");
+	if (!spill->file) {
+		blog(LOG_WARNING, "Output '%s': failed to open delay spill "
+		                  "file '%s', keeping the delay in memory",
+		                  output->context.name, spill->path.array);
+		return;
+	}
+
+	spill->stop = false;
+	if (pthread_create(&spill->thread, NULL, delay_spill_thread,
+				output) != 0) {
+		blog(LOG_WARNING, "Output '%s': failed to create delay spill "
+		                  "thread, keeping the delay in memory",
+		                  output->context.name);
+		close_spill_file(spill);
+		return;
+	}
+
+	spill->thread_active = true;
+}
+
+bool obs_output_delay_start(struct obs_output *output)
+{
+	struct delay_spill *spill = &output->delay_spill;
+
+	stop_spill_thread(spill);
+
+	pthread_mutex_lock(&output->delay_mutex);
+
+	free_delay_data(output);
+	close_spill_file(spill);
+
+	output->active_delay_ns = (uint64_t)output->delay_sec * 1000000000ULL;
+	output->delay_stopping  = false;
+
+	if (output->active_delay_ns && !dstr_is_empty(&spill->path) &&
+	    spill->size)
+		open_spill_file(output);
+
+	pthread_mutex_unlock(&output->delay_mutex);
+
+	if (output->active_delay_ns)
+		blog(LOG_INFO, "Output '%s': delaying output by %"PRIu32
+		               " seconds", output->context.name,
+		               output->delay_sec);
+
+	return output->active_delay_ns != 0;
+}
+
+void obs_output_delay_end(struct obs_output *output)
+{
+	stop_spill_thread(&output->delay_spill);
+
+	pthread_mutex_lock(&output->delay_mutex);
+
+	free_delay_data(output);
+	close_spill_file(&output->delay_spill);
+	output->active_delay_ns = 0;
+
+	pthread_mutex_unlock(&output->delay_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
+void obs_output_set_delay(obs_output_t *output, uint32_t delay_sec,
+		uint32_t flags)
+{
+	if (!output)
+		return;
+
+	output->delay_sec   = delay_sec;
+	output->delay_flags = flags;
+}
+
+uint32_t obs_output_get_delay(const obs_output_t *output)
+{
+	return output ? output->delay_sec : 0;
+}
+
+uint32_t obs_output_get_active_delay(const obs_output_t *output)
+{
+	return output ? (uint32_t)(output->active_delay_ns / 1000000000ULL) : 0;
+}
+
+void obs_output_set_delay_spill(obs_output_t *output, const char *path,
+		size_t memory_limit, uint64_t file_size)
+{
+	if (!output)
+		return;
+
+	pthread_mutex_lock(&output->delay_mutex);
+
+	if (output->delay_spill.file) {
+		blog(LOG_WARNING, "Output '%s': cannot change the delay spill "
+		                  "file while the output is active",
+		                  output->context.name);
+	} else {
+		dstr_copy(&output->delay_spill.path, path);
+		output->delay_spill.memory_limit = memory_limit;
+		output->delay_spill.size         = file_size;
+	}
+
+	pthread_mutex_unlock(&output->delay_mutex);
+}
@@ -20,7 +20,14 @@
 #include "obs.h"
 #include "obs-internal.h"
 
+/* upper bound of packets held back for interleaving when one type stops
+ * arriving, roughly ten seconds of 60fps video with six audio tracks.  past
+ * this the oldest packets are dropped */
+#define MAX_INTERLEAVED_PACKETS 4096
+
 static inline void signal_stop(struct obs_output *output, int code);
+static inline void do_output_signal(struct obs_output *output,
+		const char *signal);
 
 const struct obs_output_info *find_output(const char *id)
 {
@@ -43,6 +50,7 @@ static const char *output_signals[] = {
 	"void stop(ptr output, int code)",
 	"void reconnect(ptr output)",
 	"void reconnect_success(ptr output)",
+	"void stopping(ptr output)",
 	NULL
 };
 
@@ -70,9 +78,18 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 
 	output = bzalloc(sizeof(struct obs_output));
 	pthread_mutex_init_value(&output->interleaved_mutex);
+	pthread_mutex_init_value(&output->delay_mutex);
 
 	if (pthread_mutex_init(&output->interleaved_mutex, NULL) != 0)
 		goto fail;
+	if (pthread_mutex_init(&output->delay_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&output->delay_stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+	if (os_event_init(&output->delay_spill.event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+	if (os_event_init(&output->delay_flush_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
 	if (!init_output_handlers(output, name, settings))
 		goto fail;
 
@@ -97,7 +114,8 @@ obs_output_t *obs_output_create(const char *id, const char *name,
 
 	obs_context_data_insert(&output->context,
 			&obs->data.outputs_mutex,
-			&obs->data.first_output);
+			&obs->data.first_output,
+			&obs->data.outputs_index);
 
 	blog(LOG_INFO, "output '%s' (%s) created", name, id);
 	return output;
@@ -109,9 +127,23 @@ fail:
 
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_free_encoder_packet(output->interleaved_packets.array+i);
-	da_free(output->interleaved_packets);
+	for (size_t i = 0; i < INTERLEAVE_TRACKS; i++) {
+		struct circlebuf *queue = &output->interleaved_queues[i];
+
+		while (queue->size) {
+			struct interleaved_packet item;
+
+			circlebuf_pop_front(queue, &item, sizeof(item));
+			obs_encoder_packet_release(&item.packet);
+		}
+
+		circlebuf_free(queue);
+	}
+
+	output->interleaved_heap_size   = 0;
+	output->interleaved_count       = 0;
+	output->interleave_overflow     = false;
+	output->interleave_skip_video   = false;
 }
 
 void obs_output_destroy(obs_output_t *output)
@@ -121,12 +153,14 @@ void obs_output_destroy(obs_output_t *output)
 
 		blog(LOG_INFO, "output '%s' destroyed", output->context.name);
 
-		if (output->valid && output->active)
-			obs_output_stop(output);
+		if (output->valid && (output->active ||
+		                      output->delay_stop_thread_active))
+			obs_output_force_stop(output);
 		if (output->service)
 			output->service->output = NULL;
 
 		free_packets(output);
+		obs_output_delay_end(output);
 
 		if (output->context.data)
 			output->info.destroy(output->context.data);
@@ -145,6 +179,12 @@ void obs_output_destroy(obs_output_t *output)
 		}
 
 		pthread_mutex_destroy(&output->interleaved_mutex);
+		pthread_mutex_destroy(&output->delay_mutex);
+		dstr_free(&output->delay_spill.path);
+		os_event_destroy(output->delay_stop_event);
+		os_event_destroy(output->delay_spill.event);
+		os_event_destroy(output->delay_flush_event);
+		da_free(output->delay_send_packets);
 		os_event_destroy(output->reconnect_stop_event);
 		obs_context_data_free(&output->context);
 		bfree(output);
@@ -210,21 +250,115 @@ static void log_frame_info(struct obs_output *output)
 	}
 }
 
+void obs_output_actual_stop(obs_output_t *output)
+{
+	output->stopped        = true;
+	output->delay_stopping = false;
+
+	os_event_signal(output->reconnect_stop_event);
+	if (output->reconnect_thread_active)
+		pthread_join(output->reconnect_thread, NULL);
+
+	output->info.stop(output->context.data);
+	signal_stop(output, OBS_OUTPUT_SUCCESS);
+
+	if (output->video)
+		log_frame_info(output);
+}
+
+static void *delay_stop_thread(void *param)
+{
+	struct obs_output *output = param;
+	unsigned long ms = (unsigned long)(output->active_delay_ns / 1000000);
+
+	/* send everything up to the stop unless stopping is forced */
+	if (os_event_timedwait(output->delay_stop_event, ms) == ETIMEDOUT)
+		obs_output_delay_flush(output,
+				output->delay_stop_ts + output->active_delay_ns);
+
+	obs_output_actual_stop(output);
+	return NULL;
+}
+
+/*
+ * The delay stop thread is never detached, it's always joined here: by
+ * obs_output_force_stop, or once it has finished by the next delayed stop of
+ * the output.  Stopping forcibly skips the rest of the delay.
+ */
+static void join_delay_stop_thread(struct obs_output *output, bool force)
+{
+	if (output->delay_stop_thread_active) {
+		if (force) {
+			os_event_signal(output->delay_stop_event);
+			os_event_signal(output->delay_flush_event);
+		}
+		pthread_join(output->delay_stop_thread, NULL);
+		output->delay_stop_thread_active = false;
+	}
+}
+
+/* keeps the output running until everything before the stop is sent */
+static bool delay_stop(struct obs_output *output)
+{
+	int ret;
+
+	if (!output->active || !output->active_delay_ns)
+		return false;
+	if (output->delay_stopping)
+		return true;
+
+	join_delay_stop_thread(output, false);
+
+	pthread_mutex_lock(&output->delay_mutex);
+	output->delay_stop_ts  = os_gettime_ns();
+	output->delay_stopping = true;
+	pthread_mutex_unlock(&output->delay_mutex);
+
+	os_event_reset(output->delay_stop_event);
+	output->delay_stop_thread_active = true;
+
+	ret = pthread_create(&output->delay_stop_thread, NULL,
+			delay_stop_thread, output);
+	if (ret != 0) {
+		blog(LOG_WARNING, "Output '%s': failed to create delay stop "
+		                  "thread, stopping now",
+		                  output->context.name);
+		output->delay_stop_thread_active = false;
+		output->delay_stopping = false;
+		return false;
+	}
+
+	blog(LOG_INFO, "Output '%s': stopping after the %"PRIu32" second "
+	               "delay", output->context.name, output->delay_sec);
+	do_output_signal(output, "stopping");
+	return true;
+}
+
 void obs_output_stop(obs_output_t *output)
 {
 	if (output) {
-		output->stopped = true;
+		if ((output->delay_flags & OBS_OUTPUT_DELAY_STOP_AFTER) != 0 &&
+		    delay_stop(output))
+			return;
 
-		os_event_signal(output->reconnect_stop_event);
-		if (output->reconnect_thread_active)
-			pthread_join(output->reconnect_thread, NULL);
+		obs_output_actual_stop(output);
+	}
+}
 
-		output->info.stop(output->context.data);
-		signal_stop(output, OBS_OUTPUT_SUCCESS);
+void obs_output_force_stop(obs_output_t *output)
+{
+	if (!output)
+		return;
 
-		if (output->video)
-			log_frame_info(output);
+	/* a delayed stop stops the output itself, unless the output has been
+	 * started again since */
+	if (output->delay_stop_thread_active) {
+		join_delay_stop_thread(output, true);
+		if (output->stopped)
+			return;
 	}
+
+	obs_output_actual_stop(output);
 }
 
 bool obs_output_active(const obs_output_t *output)
@@ -458,6 +592,16 @@ uint64_t obs_output_get_total_bytes(const obs_output_t *output)
 	return output->info.get_total_bytes(output->context.data);
 }
 
+uint64_t obs_output_get_interleave_latency(const obs_output_t *output)
+{
+	return output ? output->interleave_latency : 0;
+}
+
+uint64_t obs_output_get_max_interleave_latency(const obs_output_t *output)
+{
+	return output ? output->max_interleave_latency : 0;
+}
+
 int obs_output_get_frames_dropped(const obs_output_t *output)
 {
 	if (!output || !output->info.get_dropped_frames)
@@ -722,23 +866,244 @@ static inline bool has_higher_opposing_ts(struct obs_output *output,
 		return output->highest_video_ts > packet->dts_usec;
 }
 
+static inline size_t get_interleave_track(const struct encoder_packet *packet)
+{
+	return (packet->type == OBS_ENCODER_VIDEO) ? 0 : 1 + packet->track_idx;
+}
+
+static inline struct interleaved_packet *get_track_front(
+		struct obs_output *output, size_t track)
+{
+	struct circlebuf *queue = &output->interleaved_queues[track];
+
+	if (!queue->size)
+		return NULL;
+
+	return (struct interleaved_packet*)((uint8_t*)queue->data +
+			queue->start_pos);
+}
+
+static inline bool track_less(struct obs_output *output, size_t a, size_t b)
+{
+	struct interleaved_packet *pa = get_track_front(output, a);
+	struct interleaved_packet *pb = get_track_front(output, b);
+
+	if (pa->packet.dts_usec != pb->packet.dts_usec)
+		return pa->packet.dts_usec < pb->packet.dts_usec;
+
+	/* packets with the same timestamp stay in the order they arrived */
+	return pa->order < pb->order;
+}
+
+static inline void heap_swap(struct obs_output *output, size_t a, size_t b)
+{
+	size_t temp = output->interleaved_heap[a];
+	output->interleaved_heap[a] = output->interleaved_heap[b];
+	output->interleaved_heap[b] = temp;
+}
+
+static void heap_sift_up(struct obs_output *output, size_t idx)
+{
+	size_t *heap = output->interleaved_heap;
+
+	while (idx > 0) {
+		size_t parent = (idx - 1) / 2;
+
+		if (!track_less(output, heap[idx], heap[parent]))
+			break;
+
+		heap_swap(output, idx, parent);
+		idx = parent;
+	}
+}
+
+static void heap_sift_down(struct obs_output *output, size_t idx)
+{
+	size_t *heap = output->interleaved_heap;
+	size_t size  = output->interleaved_heap_size;
+
+	for (;;) {
+		size_t left     = idx * 2 + 1;
+		size_t right    = left + 1;
+		size_t smallest = idx;
+
+		if (left < size &&
+		    track_less(output, heap[left], heap[smallest]))
+			smallest = left;
+		if (right < size &&
+		    track_less(output, heap[right], heap[smallest]))
+			smallest = right;
+		if (smallest == idx)
+			break;
+
+		heap_swap(output, idx, smallest);
+		idx = smallest;
+	}
+}
+
+/* rebuilds the heap after the timestamps of queued packets have changed */
+static void rebuild_interleave_heap(struct obs_output *output)
+{
+	output->interleaved_heap_size = 0;
+
+	for (size_t i = 0; i < INTERLEAVE_TRACKS; i++) {
+		if (output->interleaved_queues[i].size)
+			output->interleaved_heap[
+				output->interleaved_heap_size++] = i;
+	}
+
+	for (size_t i = output->interleaved_heap_size / 2; i > 0; i--)
+		heap_sift_down(output, i - 1);
+}
+
+static inline struct interleaved_packet *peek_interleaved_packet(
+		struct obs_output *output)
+{
+	if (!output->interleaved_heap_size)
+		return NULL;
+
+	return get_track_front(output, output->interleaved_heap[0]);
+}
+
+static void pop_interleaved_packet(struct obs_output *output,
+		struct interleaved_packet *out)
+{
+	size_t           track = output->interleaved_heap[0];
+	struct circlebuf *queue = &output->interleaved_queues[track];
+
+	circlebuf_pop_front(queue, out, sizeof(*out));
+	output->interleaved_count--;
+
+	if (!queue->size) {
+		output->interleaved_heap[0] = output->interleaved_heap[
+			--output->interleaved_heap_size];
+	}
+
+	if (output->interleaved_heap_size)
+		heap_sift_down(output, 0);
+}
+
+static void push_interleaved_packet(struct obs_output *output,
+		struct encoder_packet *packet)
+{
+	struct interleaved_packet item;
+	size_t                    track = get_interleave_track(packet);
+	struct circlebuf          *queue = &output->interleaved_queues[track];
+	bool                      was_empty = !queue->size;
+
+	item.packet    = *packet;
+	item.order     = output->interleaved_order++;
+	item.queued_ts = os_gettime_ns();
+
+	circlebuf_push_back(queue, &item, sizeof(item));
+	output->interleaved_count++;
+
+	/* packets of a track arrive in dts order, so the front of a
+	 * non-empty queue (and thus its place in the heap) doesn't change */
+	if (was_empty) {
+		size_t idx = output->interleaved_heap_size++;
+		output->interleaved_heap[idx] = track;
+		heap_sift_up(output, idx);
+	}
+}
+
+static inline void update_interleave_latency(struct obs_output *output,
+		struct interleaved_packet *item)
+{
+	uint64_t latency = os_gettime_ns() - item->queued_ts;
+
+	if (output->interleave_latency)
+		output->interleave_latency =
+			(output->interleave_latency * 15 + latency) / 16;
+	else
+		output->interleave_latency = latency;
+
+	if (latency > output->max_interleave_latency)
+		output->max_interleave_latency = latency;
+}
+
+static inline void send_encoded_packet(struct obs_output *output,
+		struct encoder_packet *packet)
+{
+	if (output->active_delay_ns)
+		obs_output_delay_packet(output, packet);
+	else if (!output->stopped)
+		output->info.encoded_packet(output->context.data, packet);
+}
+
+/*
+ * Bounds the buffer when one type of packet stops arriving.  Sending packets
+ * without a packet of the opposing type would break the monotonic timestamps,
+ * so the oldest packet is dropped instead.  Once video has been dropped, the
+ * following video is dropped as well up to the next keyframe.
+ */
+static bool drop_overflowed_packet(struct obs_output *output)
+{
+	struct interleaved_packet item;
+
+	if (output->interleaved_count <= MAX_INTERLEAVED_PACKETS)
+		return false;
+
+	if (!output->interleave_overflow)
+		blog(LOG_WARNING, "output '%s': Interleave buffer full, "
+		                  "dropping packets until the opposing track "
+		                  "arrives", output->context.name);
+	output->interleave_overflow = true;
+
+	pop_interleaved_packet(output, &item);
+	if (item.packet.type == OBS_ENCODER_VIDEO)
+		output->interleave_skip_video = true;
+
+	obs_encoder_packet_release(&item.packet);
+	return true;
+}
+
+static inline bool skip_interleaved_video(struct obs_output *output,
+		struct encoder_packet *packet)
+{
+	if (!output->interleave_skip_video ||
+	    packet->type != OBS_ENCODER_VIDEO)
+		return false;
+
+	if (packet->keyframe) {
+		output->interleave_skip_video = false;
+		return false;
+	}
+
+	return true;
+}
+
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct interleaved_packet *front = peek_interleaved_packet(output);
+	struct interleaved_packet item;
+
+	if (!front)
+		return;
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timstamp in the interleave buffer.
-	 * this ensures that the timestamps are monotonic */
-	if (!has_higher_opposing_ts(output, &out))
+	 * this ensures that the timestamps are monotonic. */
+	if (!has_higher_opposing_ts(output, &front->packet)) {
+		drop_overflowed_packet(output);
 		return;
+	}
+
+	output->interleave_overflow = false;
+
+	pop_interleaved_packet(output, &item);
+	update_interleave_latency(output, &item);
 
-	if (out.type == OBS_ENCODER_VIDEO)
+	if (skip_interleaved_video(output, &item.packet)) {
+		obs_encoder_packet_release(&item.packet);
+		return;
+	}
+
+	if (item.packet.type == OBS_ENCODER_VIDEO)
 		output->total_frames++;
 
-	da_erase(output->interleaved_packets, 0);
-	if (!output->stopped)
-		output->info.encoded_packet(output->context.data, &out);
-	obs_free_encoder_packet(&out);
+	send_encoded_packet(output, &item.packet);
+	obs_encoder_packet_release(&item.packet);
 }
 
 static inline void set_higher_ts(struct obs_output *output,
@@ -753,25 +1118,67 @@ static inline void set_higher_ts(struct obs_output *output,
 	}
 }
 
-static bool can_prune_interleaved_packet(struct obs_output *output, size_t idx)
+/* returns the packet that would be sent after the first packet */
+static struct interleaved_packet *peek_second_interleaved_packet(
+		struct obs_output *output)
 {
-	struct encoder_packet *packet;
-	struct encoder_packet *next;
+	size_t                    first_track = output->interleaved_heap[0];
+	struct circlebuf          *queue;
+	struct interleaved_packet *next = NULL;
+	size_t                    next_track = 0;
+
+	/* the next packet is either the second packet of the first track,
+	 * or the front of one of the root's children in the heap */
+	for (size_t i = 1; i < 3 && i < output->interleaved_heap_size; i++) {
+		size_t track = output->interleaved_heap[i];
 
-	if (idx >= (output->interleaved_packets.num - 1))
+		if (!next || track_less(output, track, next_track)) {
+			next       = get_track_front(output, track);
+			next_track = track;
+		}
+	}
+
+	queue = &output->interleaved_queues[first_track];
+	if (queue->size >= 2 * sizeof(struct interleaved_packet)) {
+		struct interleaved_packet *second;
+		size_t pos = queue->start_pos +
+			sizeof(struct interleaved_packet);
+
+		if (pos >= queue->capacity)
+			pos -= queue->capacity;
+
+		second = (struct interleaved_packet*)((uint8_t*)queue->data +
+				pos);
+
+		if (!next ||
+		    second->packet.dts_usec < next->packet.dts_usec ||
+		    (second->packet.dts_usec == next->packet.dts_usec &&
+		     second->order < next->order))
+			next = second;
+	}
+
+	return next;
+}
+
+static bool can_prune_interleaved_packet(struct obs_output *output)
+{
+	struct interleaved_packet *packet;
+	struct interleaved_packet *next;
+
+	if (output->interleaved_count < 2)
 		return false;
 
-	packet = &output->interleaved_packets.array[idx];
+	packet = peek_interleaved_packet(output);
 
 	/* audio packets will almost always come before video packets,
 	 * so it should only ever be necessary to prune audio packets */
-	if (packet->type != OBS_ENCODER_AUDIO)
+	if (packet->packet.type != OBS_ENCODER_AUDIO)
 		return false;
 
-	next = &output->interleaved_packets.array[idx + 1];
+	next = peek_second_interleaved_packet(output);
 
-	if (next->type == OBS_ENCODER_VIDEO &&
-	    next->dts_usec == packet->dts_usec)
+	if (next->packet.type == OBS_ENCODER_VIDEO &&
+	    next->packet.dts_usec == packet->packet.dts_usec)
 		return false;
 
 	return true;
@@ -779,40 +1186,38 @@ static bool can_prune_interleaved_packet(struct obs_output *output, size_t idx)
 
 static void prune_interleaved_packets(struct obs_output *output)
 {
-	size_t start_idx = 0;
+	while (can_prune_interleaved_packet(output)) {
+		struct interleaved_packet item;
 
-	while (can_prune_interleaved_packet(output, start_idx))
-		start_idx++;
+		pop_interleaved_packet(output, &item);
+		obs_encoder_packet_release(&item.packet);
+	}
+}
 
-	if (start_idx) {
-		for (size_t i = 0; i < start_idx; i++) {
-			struct encoder_packet *packet =
-				&output->interleaved_packets.array[i];
-			obs_free_encoder_packet(packet);
-		}
+static inline struct encoder_packet *find_first_packet_type(
+		struct obs_output *output, enum obs_encoder_type type,
+		size_t audio_idx)
+{
+	size_t track = (type == OBS_ENCODER_VIDEO) ? 0 : 1 + audio_idx;
+	struct interleaved_packet *item = get_track_front(output, track);
 
-		da_erase_range(output->interleaved_packets, 0, start_idx);
-	}
+	return item ? &item->packet : NULL;
 }
 
-static struct encoder_packet *find_first_packet_type(struct obs_output *output,
-		enum obs_encoder_type type, size_t audio_idx)
+static void apply_track_offsets(struct obs_output *output, size_t track)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
+	struct circlebuf *queue = &output->interleaved_queues[track];
+	size_t           count;
 
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
+	count = queue->size / sizeof(struct interleaved_packet);
 
-			return packet;
-		}
-	}
+	for (size_t i = 0; i < count; i++) {
+		struct interleaved_packet item;
 
-	return NULL;
+		circlebuf_pop_front(queue, &item, sizeof(item));
+		apply_interleaved_packet_offset(output, &item.packet);
+		circlebuf_push_back(queue, &item, sizeof(item));
+	}
 }
 
 static bool initialize_interleaved_packets(struct obs_output *output)
@@ -847,44 +1252,12 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	output->highest_video_ts -= video->dts_usec;
 
 	/* apply new offsets to all existing packet DTS/PTS values */
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		apply_interleaved_packet_offset(output, packet);
-	}
+	for (size_t i = 0; i < INTERLEAVE_TRACKS; i++)
+		apply_track_offsets(output, i);
 
 	return true;
 }
 
-static inline void insert_interleaved_packet(struct obs_output *output,
-		struct encoder_packet *out)
-{
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
-
-		if (out->dts_usec < cur_packet->dts_usec)
-			break;
-	}
-
-	da_insert(output->interleaved_packets, idx, out);
-}
-
-static void resort_interleaved_packets(struct obs_output *output)
-{
-	DARRAY(struct encoder_packet) old_array;
-
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0,
-			sizeof(output->interleaved_packets));
-
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
-
-	da_free(old_array);
-}
-
 static void interleave_packets(void *data, struct encoder_packet *packet)
 {
 	struct obs_output     *output = data;
@@ -898,14 +1271,14 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 
 	was_started = output->received_audio && output->received_video;
 
-	obs_duplicate_encoder_packet(&out, packet);
+	obs_encoder_packet_ref(&out, packet);
 
 	if (was_started)
 		apply_interleaved_packet_offset(output, &out);
 	else
 		check_received(output, packet);
 
-	insert_interleaved_packet(output, &out);
+	push_interleaved_packet(output, &out);
 	set_higher_ts(output, &out);
 
 	/* when both video and audio have been received, we're ready
@@ -914,12 +1287,16 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 		if (!was_started) {
 			prune_interleaved_packets(output);
 			if (initialize_interleaved_packets(output)) {
-				resort_interleaved_packets(output);
+				rebuild_interleave_heap(output);
 				send_interleaved(output);
+			} else {
+				drop_overflowed_packet(output);
 			}
 		} else {
 			send_interleaved(output);
 		}
+	} else {
+		drop_overflowed_packet(output);
 	}
 
 	pthread_mutex_unlock(&output->interleaved_mutex);
@@ -932,8 +1309,7 @@ static void default_encoded_callback(void *param, struct encoder_packet *packet)
 	if (packet->type == OBS_ENCODER_AUDIO)
 		packet->track_idx = get_track_index(output, packet);
 
-	if (!output->stopped)
-		output->info.encoded_packet(output->context.data, packet);
+	send_encoded_packet(output, packet);
 
 	if (packet->type == OBS_ENCODER_VIDEO)
 		output->total_frames++;
@@ -1138,6 +1514,9 @@ bool obs_output_begin_data_capture(obs_output_t *output, uint32_t flags)
 
 	output->total_frames   = 0;
 
+	output->interleave_latency     = 0;
+	output->max_interleave_latency = 0;
+
 	convert_flags(output, flags, &encoded, &has_video, &has_audio,
 			&has_service);
 
@@ -1145,6 +1524,9 @@ bool obs_output_begin_data_capture(obs_output_t *output, uint32_t flags)
 				has_service))
 		return false;
 
+	if (encoded)
+		obs_output_delay_start(output);
+
 	hook_data_capture(output, encoded, has_video, has_audio);
 
 	if (has_service)
@@ -1203,6 +1585,9 @@ void obs_output_end_data_capture(obs_output_t *output)
 					default_raw_audio_callback, output);
 	}
 
+	if (encoded)
+		obs_output_delay_end(output);
+
 	if (has_service)
 		obs_service_deactivate(output->service, false);
 
@@ -42,6 +42,93 @@ static inline void signal_item_remove(struct obs_scene_item *item)
 	calldata_free(&params);
 }
 
+#define MIN_ITEM_BUCKETS 16
+
+static inline struct obs_scene_item **get_item_bucket(
+		struct obs_scene *scene, uint32_t hash)
+{
+	return &scene->item_buckets[hash & (scene->num_item_buckets - 1)];
+}
+
+static void scene_index_rebuild(struct obs_scene *scene)
+{
+	struct obs_scene_item *item = scene->first_item;
+	size_t num_buckets = MIN_ITEM_BUCKETS;
+
+	while (num_buckets < scene->num_items)
+		num_buckets *= 2;
+
+	if (num_buckets != scene->num_item_buckets) {
+		bfree(scene->item_buckets);
+		scene->item_buckets = bmalloc(sizeof(struct obs_scene_item*) *
+				num_buckets);
+		scene->num_item_buckets = num_buckets;
+	}
+
+	memset(scene->item_buckets, 0,
+			sizeof(struct obs_scene_item*) * num_buckets);
+
+	scene->index_rename_count = obs->data.source_rename_count;
+
+	while (item) {
+		struct obs_scene_item **bucket;
+
+		item->name_hash = obs_hash_name(item->source->context.name);
+		bucket = get_item_bucket(scene, item->name_hash);
+		item->hash_next = *bucket;
+		*bucket = item;
+
+		item = item->next;
+	}
+}
+
+static inline bool scene_index_stale(struct obs_scene *scene)
+{
+	return scene->index_rename_count != obs->data.source_rename_count;
+}
+
+static void scene_index_add(struct obs_scene *scene,
+		struct obs_scene_item *item)
+{
+	struct obs_scene_item **bucket;
+
+	scene->num_items++;
+
+	if (!scene->item_buckets || scene_index_stale(scene) ||
+	    scene->num_items > scene->num_item_buckets) {
+		scene_index_rebuild(scene);
+		return;
+	}
+
+	item->name_hash = obs_hash_name(item->source->context.name);
+	bucket = get_item_bucket(scene, item->name_hash);
+	item->hash_next = *bucket;
+	*bucket = item;
+}
+
+static void scene_index_remove(struct obs_scene *scene,
+		struct obs_scene_item *item)
+{
+	struct obs_scene_item **cur;
+
+	scene->num_items--;
+
+	if (!scene->item_buckets)
+		return;
+
+	cur = get_item_bucket(scene, item->name_hash);
+	while (*cur) {
+		if (*cur == item) {
+			*cur = item->hash_next;
+			break;
+		}
+
+		cur = &(*cur)->hash_next;
+	}
+
+	item->hash_next = NULL;
+}
+
 static const char *scene_getname(void)
 {
 	/* TODO: locale */
@@ -51,9 +138,8 @@ static const char *scene_getname(void)
 static void *scene_create(obs_data_t *settings, struct obs_source *source)
 {
 	pthread_mutexattr_t attr;
-	struct obs_scene *scene = bmalloc(sizeof(struct obs_scene));
+	struct obs_scene *scene = bzalloc(sizeof(struct obs_scene));
 	scene->source     = source;
-	scene->first_item = NULL;
 
 	signal_handler_add_array(obs_source_get_signal_handler(source),
 			obs_scene_signals);
@@ -100,6 +186,8 @@ static void scene_destroy(void *data)
 
 	remove_all_items(scene);
 	pthread_mutex_destroy(&scene->mutex);
+	bfree(scene->item_buckets);
+	da_free(scene->render_items);
 	bfree(scene);
 }
 
@@ -222,6 +310,35 @@ static void calculate_bounds_data(struct obs_scene_item *item,
 			(int)-width_diff, (int)-height_diff);
 }
 
+static void update_item_cull_rect(struct obs_scene_item *item,
+		uint32_t width, uint32_t height)
+{
+	struct vec3 corners[4];
+
+	vec3_set(&corners[0], 0.0f,         0.0f,          0.0f);
+	vec3_set(&corners[1], (float)width, 0.0f,          0.0f);
+	vec3_set(&corners[2], 0.0f,         (float)height, 0.0f);
+	vec3_set(&corners[3], (float)width, (float)height, 0.0f);
+
+	for (size_t i = 0; i < 4; i++) {
+		struct vec2 pos;
+
+		vec3_transform(&corners[i], &corners[i],
+				&item->draw_transform);
+		vec2_set(&pos, corners[i].x, corners[i].y);
+
+		if (i == 0) {
+			vec2_copy(&item->cull_min, &pos);
+			vec2_copy(&item->cull_max, &pos);
+		} else {
+			vec2_min(&item->cull_min, &item->cull_min, &pos);
+			vec2_max(&item->cull_max, &item->cull_max, &pos);
+		}
+	}
+
+	item->cull_rect_exact = fmodf(item->rot, 90.0f) == 0.0f;
+}
+
 static void update_item_transform(struct obs_scene_item *item)
 {
 	uint32_t        width         = obs_source_get_width(item->source);
@@ -280,6 +397,8 @@ static void update_item_transform(struct obs_scene_item *item)
 
 	/* ----------------------- */
 
+	update_item_cull_rect(item, width, height);
+
 	item->last_width  = width;
 	item->last_height = height;
 
@@ -298,6 +417,97 @@ static inline bool source_size_changed(struct obs_scene_item *item)
 	return item->last_width != width || item->last_height != height;
 }
 
+#define MAX_OCCLUDERS 16
+
+/* the corners are transformed to clip space, so that items are culled against
+ * whatever is being rendered to: the main canvas, a projector, a filter
+ * texture, or the parent scene of a nested scene */
+static bool item_off_canvas(const struct obs_scene_item *item,
+		const struct matrix4 *viewproj)
+{
+	struct vec4 corners[4];
+	struct vec2 min, max;
+
+	vec4_set(&corners[0], item->cull_min.x, item->cull_min.y, 0.0f, 1.0f);
+	vec4_set(&corners[1], item->cull_max.x, item->cull_min.y, 0.0f, 1.0f);
+	vec4_set(&corners[2], item->cull_min.x, item->cull_max.y, 0.0f, 1.0f);
+	vec4_set(&corners[3], item->cull_max.x, item->cull_max.y, 0.0f, 1.0f);
+
+	vec2_set(&min,  M_INFINITE,  M_INFINITE);
+	vec2_set(&max, -M_INFINITE, -M_INFINITE);
+
+	for (size_t i = 0; i < 4; i++) {
+		struct vec2 pos;
+
+		vec4_transform(&corners[i], &corners[i], viewproj);
+
+		/* perspective projections aren't used for scenes, don't try
+		 * to cull if one is */
+		if (!close_float(corners[i].w, 1.0f, EPSILON))
+			return false;
+
+		vec2_set(&pos, corners[i].x, corners[i].y);
+		vec2_min(&min, &min, &pos);
+		vec2_max(&max, &max, &pos);
+	}
+
+	return max.x <= -1.0f || max.y <= -1.0f ||
+	       min.x >=  1.0f || min.y >=  1.0f;
+}
+
+static inline bool item_occludes(const struct obs_scene_item *occluder,
+		const struct obs_scene_item *item)
+{
+	return occluder->cull_min.x <= item->cull_min.x &&
+	       occluder->cull_min.y <= item->cull_min.y &&
+	       occluder->cull_max.x >= item->cull_max.x &&
+	       occluder->cull_max.y >= item->cull_max.y;
+}
+
+/*
+ * Marks the items that don't need to be rendered: items that are entirely
+ * outside of the render target, and items that are entirely covered by an opaque
+ * item above them.  Items are checked from top to bottom.
+ */
+static void cull_items(struct obs_scene *scene)
+{
+	struct obs_scene_item *occluders[MAX_OCCLUDERS];
+	size_t                num_occluders = 0;
+	struct matrix4        viewproj;
+	struct matrix4        proj;
+
+	/* transform of the scene itself, in case it's nested */
+	gs_matrix_get(&viewproj);
+	gs_projection_get(&proj);
+	matrix4_mul(&viewproj, &viewproj, &proj);
+
+	for (size_t i = scene->render_items.num; i > 0; i--) {
+		struct obs_scene_item *item = scene->render_items.array[i - 1];
+
+		item->culled = false;
+
+		if (!item->last_width || !item->last_height)
+			continue;
+
+		if (item_off_canvas(item, &viewproj)) {
+			item->culled = true;
+			continue;
+		}
+
+		for (size_t j = 0; j < num_occluders; j++) {
+			if (item_occludes(occluders[j], item)) {
+				item->culled = true;
+				break;
+			}
+		}
+
+		if (!item->culled && item->cull_rect_exact &&
+		    num_occluders < MAX_OCCLUDERS &&
+		    obs_source_opaque(item->source))
+			occluders[num_occluders++] = item;
+	}
+}
+
 static void scene_video_render(void *data, gs_effect_t *effect)
 {
 	struct obs_scene *scene = data;
@@ -305,10 +515,9 @@ static void scene_video_render(void *data, gs_effect_t *effect)
 
 	pthread_mutex_lock(&scene->mutex);
 
-	item = scene->first_item;
+	da_resize(scene->render_items, 0);
 
-	gs_blend_state_push();
-	gs_reset_blend_state();
+	item = scene->first_item;
 
 	while (item) {
 		if (obs_source_removed(item->source)) {
@@ -322,16 +531,31 @@ static void scene_video_render(void *data, gs_effect_t *effect)
 		if (source_size_changed(item))
 			update_item_transform(item);
 
-		if (item->visible) {
-			gs_matrix_push();
-			gs_matrix_mul(&item->draw_transform);
-			obs_source_video_render(item->source);
-			gs_matrix_pop();
-		}
+		if (item->visible)
+			da_push_back(scene->render_items, &item);
 
 		item = item->next;
 	}
 
+	cull_items(scene);
+
+	gs_blend_state_push();
+	gs_reset_blend_state();
+
+	for (size_t i = 0; i < scene->render_items.num; i++) {
+		item = scene->render_items.array[i];
+
+		if (item->culled) {
+			obs_source_mark_culled(item->source);
+			continue;
+		}
+
+		gs_matrix_push();
+		gs_matrix_mul(&item->draw_transform);
+		obs_source_video_render(item->source);
+		gs_matrix_pop();
+	}
+
 	gs_blend_state_pop();
 
 	pthread_mutex_unlock(&scene->mutex);
@@ -458,7 +682,8 @@ const struct obs_source_info scene_info =
 {
 	.id            = "scene",
 	.type          = OBS_SOURCE_TYPE_INPUT,
-	.output_flags  = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW,
+	.output_flags  = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW |
+	                 OBS_SOURCE_PARALLEL_TICK,
 	.get_name      = scene_getname,
 	.create        = scene_create,
 	.destroy       = scene_destroy,
@@ -502,23 +727,64 @@ obs_scene_t *obs_scene_from_source(const obs_source_t *source)
 	return source->context.data;
 }
 
+static bool scene_index_has_duplicate(const struct obs_scene_item *item,
+		uint32_t hash, const char *name)
+{
+	for (item = item->hash_next; item; item = item->hash_next) {
+		if (item->name_hash == hash &&
+		    strcmp(item->source->context.name, name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static struct obs_scene_item *find_first_item(struct obs_scene *scene,
+		const char *name)
+{
+	struct obs_scene_item *item = scene->first_item;
+
+	while (item) {
+		if (strcmp(item->source->context.name, name) == 0)
+			break;
+
+		item = item->next;
+	}
+
+	return item;
+}
+
 obs_sceneitem_t *obs_scene_find_source(obs_scene_t *scene, const char *name)
 {
-	struct obs_scene_item *item;
+	struct obs_scene_item *item = NULL;
+	uint32_t              hash;
 
-	if (!scene)
+	if (!scene || !name)
 		return NULL;
 
+	hash = obs_hash_name(name);
+
 	pthread_mutex_lock(&scene->mutex);
 
-	item = scene->first_item;
+	if (scene->item_buckets && scene_index_stale(scene))
+		scene_index_rebuild(scene);
+
+	if (scene->item_buckets)
+		item = *get_item_bucket(scene, hash);
+
 	while (item) {
-		if (strcmp(item->source->context.name, name) == 0)
+		if (item->name_hash == hash &&
+		    strcmp(item->source->context.name, name) == 0)
 			break;
 
-		item = item->next;
+		item = item->hash_next;
 	}
 
+	/* the chains don't follow the item order, so if the source was added
+	 * more than once return the first item in the list as before */
+	if (item && scene_index_has_duplicate(item, hash, name))
+		item = find_first_item(scene, name);
+
 	pthread_mutex_unlock(&scene->mutex);
 
 	return item;
@@ -599,6 +865,8 @@ obs_sceneitem_t *obs_scene_add(obs_scene_t *scene, obs_source_t *source)
 		item->prev = last;
 	}
 
+	scene_index_add(scene, item);
+
 	pthread_mutex_unlock(&scene->mutex);
 
 	calldata_set_ptr(&params, "scene", scene);
@@ -659,6 +927,7 @@ void obs_sceneitem_remove(obs_sceneitem_t *item)
 	obs_source_remove_child(scene->source, item->source);
 
 	signal_item_remove(item);
+	scene_index_remove(scene, item);
 	detach_sceneitem(item);
 
 	pthread_mutex_unlock(&scene->mutex);
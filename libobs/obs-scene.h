@@ -45,6 +45,14 @@ struct obs_scene_item {
 	struct matrix4        box_transform;
 	struct matrix4        draw_transform;
 
+	/* bounding rectangle of the drawn source in scene space.  exact if
+	 * the item is not rotated by anything other than multiples of 90
+	 * degrees, which allows it to be used to occlude other items */
+	struct vec2           cull_min;
+	struct vec2           cull_max;
+	bool                  cull_rect_exact;
+	bool                  culled;
+
 	enum obs_bounds_type  bounds_type;
 	uint32_t              bounds_align;
 	struct vec2           bounds;
@@ -52,6 +60,10 @@ struct obs_scene_item {
 	/* would do **prev_next, but not really great for reordering */
 	struct obs_scene_item *prev;
 	struct obs_scene_item *next;
+
+	/* name index chain */
+	uint32_t              name_hash;
+	struct obs_scene_item *hash_next;
 };
 
 struct obs_scene {
@@ -59,4 +71,15 @@ struct obs_scene {
 
 	pthread_mutex_t       mutex;
 	struct obs_scene_item *first_item;
+
+	/* index of items by source name.  sources can be renamed at any
+	 * time, so the index is rebuilt whenever a source has been renamed
+	 * since it was last built */
+	struct obs_scene_item **item_buckets;
+	size_t                num_item_buckets;
+	size_t                num_items;
+	long                  index_rename_count;
+
+	/* visible items of the frame currently being rendered */
+	DARRAY(struct obs_scene_item*) render_items;
 };
@@ -148,7 +148,7 @@ bool obs_source_init(struct obs_source *source,
 
 	obs_context_data_insert(&source->context,
 			&obs->data.sources_mutex,
-			&obs->data.first_source);
+			&obs->data.first_source, NULL);
 	return true;
 }
 
@@ -278,6 +278,8 @@ void obs_source_destroy(struct obs_source *source)
 	gs_texrender_destroy(source->async_convert_texrender);
 	gs_texture_destroy(source->async_texture);
 	gs_texrender_destroy(source->filter_texrender);
+	gs_texrender_destroy(source->render_cache);
+	gs_effect_destroy(source->fused_effect);
 	gs_leave_context();
 
 	for (i = 0; i < MAX_AV_PLANES; i++)
@@ -289,6 +291,7 @@ void obs_source_destroy(struct obs_source *source)
 	da_free(source->async_cache);
 	da_free(source->async_frames);
 	da_free(source->filters);
+	dstr_free(&source->fused_key);
 	pthread_mutex_destroy(&source->filter_mutex);
 	pthread_mutex_destroy(&source->audio_mutex);
 	pthread_mutex_destroy(&source->async_mutex);
@@ -321,10 +324,10 @@ void obs_source_remove(obs_source_t *source)
 	size_t id;
 	bool   exists;
 
-	pthread_mutex_lock(&data->sources_mutex);
+	pthread_mutex_lock(&data->user_sources_mutex);
 
 	if (!source || source->removed) {
-		pthread_mutex_unlock(&data->sources_mutex);
+		pthread_mutex_unlock(&data->user_sources_mutex);
 		return;
 	}
 
@@ -336,10 +339,11 @@ void obs_source_remove(obs_source_t *source)
 	exists = (id != DARRAY_INVALID);
 	if (exists) {
 		da_erase(data->user_sources, id);
+		obs_context_index_remove(&source->context);
 		obs_source_release(source);
 	}
 
-	pthread_mutex_unlock(&data->sources_mutex);
+	pthread_mutex_unlock(&data->user_sources_mutex);
 
 	if (exists)
 		obs_source_dosignal(source, "source_remove", "remove");
@@ -419,6 +423,7 @@ static void obs_source_deferred_update(obs_source_t *source)
 				source->context.settings);
 
 	source->defer_update = false;
+	obs_source_invalidate(source);
 }
 
 void obs_source_update(obs_source_t *source, obs_data_t *settings)
@@ -430,6 +435,7 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 
 	if (source->info.output_flags & OBS_SOURCE_VIDEO) {
 		source->defer_update = true;
+		obs_source_invalidate(source);
 	} else if (source->context.data && source->info.update) {
 		source->info.update(source->context.data,
 				source->context.settings);
@@ -618,6 +624,53 @@ static inline struct obs_source_frame *get_closest_frame(obs_source_t *source,
 static void remove_async_frame(obs_source_t *source,
 		struct obs_source_frame *frame);
 
+#define MAX_CULLED_TICKS 30
+
+static inline bool culled_in_every_view(const obs_source_t *source)
+{
+	long last_frame = obs->video.tick_frame - 1;
+
+	if ((source->info.output_flags & OBS_SOURCE_VIDEO) == 0)
+		return false;
+
+	return source->cull_frame == last_frame &&
+	       source->render_frame != last_frame;
+}
+
+void obs_source_mark_culled(obs_source_t *source)
+{
+	source->cull_frame = obs->video.tick_frame;
+}
+
+bool obs_source_opaque(obs_source_t *source)
+{
+	bool opaque = true;
+
+	if ((source->info.output_flags & OBS_SOURCE_OPAQUE_VIDEO) == 0)
+		return false;
+	if (!source->context.data || !source->enabled)
+		return false;
+
+	/* the flag only says the source never draws transparent pixels on
+	 * its own, frames with an alpha channel still can */
+	if ((source->info.output_flags & OBS_SOURCE_ASYNC) != 0 &&
+	    (!source->async_active || !source->async_texture ||
+	     format_has_alpha(source->async_format)))
+		return false;
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	for (size_t i = 0; i < source->filters.num; i++) {
+		if (source->filters.array[i]->enabled) {
+			opaque = false;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&source->filter_mutex);
+	return opaque;
+}
+
 void obs_source_video_tick(obs_source_t *source, float seconds)
 {
 	bool now_showing, now_active;
@@ -655,6 +708,7 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 		}
 
 		source->showing = now_showing;
+		obs_source_invalidate(source);
 	}
 
 	/* call activate/deactivate if the reference changed */
@@ -667,10 +721,22 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 		}
 
 		source->active = now_active;
+		obs_source_invalidate(source);
 	}
 
-	if (source->context.data && source->info.video_tick)
-		source->info.video_tick(source->context.data, seconds);
+	if (source->context.data && source->info.video_tick) {
+		/* sources that were culled from every view only get ticked
+		 * occasionally, with the accumulated time */
+		if (culled_in_every_view(source) &&
+		    ++source->culled_ticks < MAX_CULLED_TICKS) {
+			source->culled_seconds += seconds;
+		} else {
+			source->info.video_tick(source->context.data,
+					seconds + source->culled_seconds);
+			source->culled_seconds = 0.0f;
+			source->culled_ticks   = 0;
+		}
+	}
 
 	source->async_rendered = false;
 }
@@ -1217,25 +1283,186 @@ static inline void obs_source_main_render(obs_source_t *source)
 				custom_draw ? NULL : gs_get_effect());
 }
 
+static bool filters_static(obs_source_t *source)
+{
+	bool allowed = true;
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	for (size_t i = 0; i < source->filters.num; i++) {
+		struct obs_source *filter = source->filters.array[i];
+		uint32_t filter_flags = filter->info.output_flags;
+
+		if (filter->enabled &&
+		    (filter_flags & OBS_SOURCE_STATIC_VIDEO) == 0) {
+			allowed = false;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&source->filter_mutex);
+
+	return allowed;
+}
+
+/*
+ * Only sources with a filter chain are cached; without filters the cache
+ * would cost an extra texture and draw over rendering the source directly.
+ * The filter chain is only rechecked after the source has been invalidated,
+ * which happens whenever a filter is added, removed, moved or toggled.
+ */
+static inline bool render_cache_allowed(obs_source_t *source)
+{
+	uint32_t flags = source->info.output_flags;
+
+	if (source->info.type != OBS_SOURCE_TYPE_INPUT)
+		return false;
+	if ((flags & OBS_SOURCE_STATIC_VIDEO) == 0)
+		return false;
+	if ((flags & OBS_SOURCE_ASYNC) != 0)
+		return false;
+	if (!source->filters.num)
+		return false;
+
+	if (!source->render_cache_checked) {
+		source->render_cache_checked = true;
+		source->render_cache_allowed = filters_static(source);
+	}
+
+	return source->render_cache_allowed;
+}
+
+/*
+ * The cache is rendered with premultiplied alpha so that sources which draw
+ * multiple overlapping primitives (text, for example) compose identically to
+ * when they are drawn directly with the default blend state.
+ */
+static void update_render_cache(obs_source_t *source, uint32_t cx,
+		uint32_t cy)
+{
+	struct vec4 clear_color;
+
+	if (!source->render_cache)
+		source->render_cache = gs_texrender_create(GS_RGBA,
+				GS_ZS_NONE);
+
+	gs_texrender_reset(source->render_cache);
+
+	gs_blend_state_push();
+	gs_blend_function_separate(
+			GS_BLEND_SRCALPHA, GS_BLEND_INVSRCALPHA,
+			GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+	if (gs_texrender_begin(source->render_cache, cx, cy)) {
+		vec4_zero(&clear_color);
+		gs_clear(GS_CLEAR_COLOR, &clear_color, 0.0f, 0);
+		gs_ortho(0.0f, (float)cx, 0.0f, (float)cy, -100.0f, 100.0f);
+
+		source->rendering_cache = true;
+		obs_source_video_render(source);
+		source->rendering_cache = false;
+
+		gs_texrender_end(source->render_cache);
+
+		source->render_cache_cx = cx;
+		source->render_cache_cy = cy;
+		source->render_cache_valid = true;
+	}
+
+	gs_blend_state_pop();
+}
+
+static void draw_render_cache(obs_source_t *source)
+{
+	gs_texture_t   *tex      = gs_texrender_get_texture(
+			source->render_cache);
+	gs_effect_t    *effect   = gs_get_effect();
+	bool           def_draw  = (!effect);
+	gs_technique_t *tech     = NULL;
+
+	if (!tex)
+		return;
+
+	if (def_draw) {
+		effect = obs_get_default_effect();
+		tech = gs_effect_get_technique(effect, "Draw");
+		gs_technique_begin(tech);
+		gs_technique_begin_pass(tech, 0);
+	}
+
+	gs_blend_state_push();
+	gs_blend_function(GS_BLEND_ONE, GS_BLEND_INVSRCALPHA);
+
+	gs_effect_set_texture(gs_effect_get_param_by_name(effect, "image"),
+			tex);
+	gs_draw_sprite(tex, 0, 0, 0);
+
+	gs_blend_state_pop();
+
+	if (def_draw) {
+		gs_technique_end_pass(tech);
+		gs_technique_end(tech);
+	}
+}
+
+static void obs_source_render_cached(obs_source_t *source)
+{
+	uint32_t cx = obs_source_get_width(source);
+	uint32_t cy = obs_source_get_height(source);
+
+	if (!cx || !cy)
+		return;
+
+	if (!source->render_cache_valid ||
+	    source->render_cache_cx != cx ||
+	    source->render_cache_cy != cy)
+		update_render_cache(source, cx, cy);
+
+	if (source->render_cache_valid)
+		draw_render_cache(source);
+}
+
+void obs_source_invalidate(obs_source_t *source)
+{
+	if (!source)
+		return;
+
+	source->render_cache_valid = false;
+	source->render_cache_checked = false;
+
+	if (source->filter_parent) {
+		source->filter_parent->render_cache_valid = false;
+		source->filter_parent->render_cache_checked = false;
+	}
+}
+
 static bool ready_async_frame(obs_source_t *source, uint64_t sys_time);
+static bool render_fused_filters(obs_source_t *filter);
 
 void obs_source_video_render(obs_source_t *source)
 {
 	if (!source) return;
 
+	source->render_frame = obs->video.tick_frame;
+
 	if (!source->context.data || !source->enabled) {
 		if (source->filter_parent)
 			obs_source_skip_video_filter(source);
 		return;
 	}
 
-	if (source->filters.num && !source->rendering_filter)
+	if (!source->rendering_filter && !source->rendering_cache &&
+	    render_cache_allowed(source))
+		obs_source_render_cached(source);
+
+	else if (source->filters.num && !source->rendering_filter)
 		obs_source_render_filters(source);
 
-	else if (source->info.video_render)
-		obs_source_main_render(source);
+	else if (source->info.video_render) {
+		if (!source->filter_parent || !render_fused_filters(source))
+			obs_source_main_render(source);
 
-	else if (source->filter_target)
+	} else if (source->filter_target)
 		obs_source_video_render(source->filter_target);
 
 	else
@@ -1364,6 +1591,7 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 		source : source->filters.array[0];
 
 	da_insert(source->filters, 0, &filter);
+	obs_source_invalidate(source);
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
@@ -1396,6 +1624,7 @@ static bool obs_source_filter_remove_refless(obs_source_t *source,
 	}
 
 	da_erase(source->filters, idx);
+	obs_source_invalidate(source);
 
 	pthread_mutex_unlock(&source->filter_mutex);
 
@@ -1514,6 +1743,9 @@ void obs_source_filter_set_order(obs_source_t *source, obs_source_t *filter,
 	success = move_filter_dir(source, filter, movement);
 	pthread_mutex_unlock(&source->filter_mutex);
 
+	if (success)
+		obs_source_invalidate(source);
+
 	if (success)
 		obs_source_dosignal(source, NULL, "reorder_filters");
 }
@@ -2092,6 +2324,7 @@ void obs_source_set_name(obs_source_t *source, const char *name)
 		struct calldata data;
 		char *prev_name = bstrdup(source->context.name);
 		obs_context_data_setname(&source->context, name);
+		os_atomic_inc_long(&obs->data.source_rename_count);
 
 		calldata_init(&data);
 		calldata_set_ptr(&data, "source", source);
@@ -2159,18 +2392,15 @@ static inline bool can_bypass(obs_source_t *target, obs_source_t *parent,
 		((parent_flags & OBS_SOURCE_ASYNC) == 0);
 }
 
-void obs_source_process_filter_begin(obs_source_t *filter,
+static void process_filter_begin(obs_source_t *filter, obs_source_t *target,
 		enum gs_color_format format,
 		enum obs_allow_direct_render allow_direct)
 {
-	obs_source_t *target, *parent;
+	obs_source_t *parent;
 	uint32_t     target_flags, parent_flags;
 	int          cx, cy;
 	bool         use_matrix;
 
-	if (!filter) return;
-
-	target       = obs_filter_get_target(filter);
 	parent       = obs_filter_get_parent(filter);
 	target_flags = target->info.output_flags;
 	parent_flags = parent->info.output_flags;
@@ -2215,17 +2445,24 @@ void obs_source_process_filter_begin(obs_source_t *filter,
 	gs_blend_state_pop();
 }
 
-void obs_source_process_filter_end(obs_source_t *filter, gs_effect_t *effect,
-		uint32_t width, uint32_t height)
+void obs_source_process_filter_begin(obs_source_t *filter,
+		enum gs_color_format format,
+		enum obs_allow_direct_render allow_direct)
 {
-	obs_source_t *target, *parent;
+	if (!filter) return;
+
+	process_filter_begin(filter, obs_filter_get_target(filter), format,
+			allow_direct);
+}
+
+static void process_filter_end(obs_source_t *filter, obs_source_t *target,
+		gs_effect_t *effect, uint32_t width, uint32_t height)
+{
+	obs_source_t *parent;
 	gs_texture_t *texture;
 	uint32_t     target_flags, parent_flags;
 	bool         use_matrix;
 
-	if (!filter) return;
-
-	target       = obs_filter_get_target(filter);
 	parent       = obs_filter_get_parent(filter);
 	target_flags = target->info.output_flags;
 	parent_flags = parent->info.output_flags;
@@ -2239,6 +2476,275 @@ void obs_source_process_filter_end(obs_source_t *filter, gs_effect_t *effect,
 	}
 }
 
+void obs_source_process_filter_end(obs_source_t *filter, gs_effect_t *effect,
+		uint32_t width, uint32_t height)
+{
+	if (!filter) return;
+
+	process_filter_end(filter, obs_filter_get_target(filter), effect,
+			width, height);
+}
+
+/* ------------------------------------------------------------------------- */
+/* filter fusion */
+
+#define MAX_FUSED_FILTERS 8
+#define FUSED_PREFIX_FORMAT "fused%d_"
+
+static const char *fused_effect_header =
+"uniform float4x4 ViewProj;\n"
+"uniform texture2d image;\n"
+"uniform float4x4 color_matrix = {1.0, 0.0, 0.0, 0.0,\n"
+"                                 0.0, 1.0, 0.0, 0.0,\n"
+"                                 0.0, 0.0, 1.0, 0.0,\n"
+"                                 0.0, 0.0, 0.0, 1.0};\n"
+"uniform float3 color_range_min = {0.0, 0.0, 0.0};\n"
+"uniform float3 color_range_max = {1.0, 1.0, 1.0};\n"
+"\n"
+"sampler_state textureSampler {\n"
+"	Filter    = Linear;\n"
+"	AddressU  = Clamp;\n"
+"	AddressV  = Clamp;\n"
+"};\n"
+"\n"
+"struct VertData {\n"
+"	float4 pos : POSITION;\n"
+"	float2 uv  : TEXCOORD0;\n"
+"};\n"
+"\n"
+"VertData VSDefault(VertData v_in)\n"
+"{\n"
+"	VertData vert_out;\n"
+"	vert_out.pos = mul(float4(v_in.pos.xyz, 1.0), ViewProj);\n"
+"	vert_out.uv  = v_in.uv;\n"
+"	return vert_out;\n"
+"}\n"
+"\n";
+
+static const char *fused_effect_footer =
+"float4 PSFusedRGBA(VertData v_in) : TARGET\n"
+"{\n"
+"	return ProcessFused(image.Sample(textureSampler, v_in.uv));\n"
+"}\n"
+"\n"
+"float4 PSFusedMatrix(VertData v_in) : TARGET\n"
+"{\n"
+"	float4 yuv = image.Sample(textureSampler, v_in.uv);\n"
+"	yuv.xyz = clamp(yuv.xyz, color_range_min, color_range_max);\n"
+"	float4 rgba = saturate(mul(float4(yuv.xyz, 1.0), color_matrix));\n"
+"	return ProcessFused(rgba);\n"
+"}\n"
+"\n"
+"technique Draw\n"
+"{\n"
+"	pass\n"
+"	{\n"
+"		vertex_shader = VSDefault(v_in);\n"
+"		pixel_shader  = PSFusedRGBA(v_in);\n"
+"	}\n"
+"}\n"
+"\n"
+"technique DrawMatrix\n"
+"{\n"
+"	pass\n"
+"	{\n"
+"		vertex_shader = VSDefault(v_in);\n"
+"		pixel_shader  = PSFusedMatrix(v_in);\n"
+"	}\n"
+"}\n";
+
+static inline const char *get_pixel_shader(obs_source_t *filter)
+{
+	if (!filter->context.data || !filter->info.get_pixel_shader ||
+	    !filter->info.set_pixel_shader_params)
+		return NULL;
+
+	return filter->info.get_pixel_shader(filter->context.data);
+}
+
+/*
+ * Collects the consecutive per-pixel filters starting at the specified
+ * filter (the last one to be applied), skipping disabled filters.  base
+ * receives the first source in the chain that can't be combined.
+ */
+static size_t get_fusable_filters(obs_source_t *filter, obs_source_t **run,
+		obs_source_t **base)
+{
+	obs_source_t *cur = filter;
+	size_t count = 0;
+
+	while (cur && cur->info.type == OBS_SOURCE_TYPE_FILTER &&
+	       count < MAX_FUSED_FILTERS) {
+		if (cur->enabled) {
+			if (!get_pixel_shader(cur))
+				break;
+			run[count++] = cur;
+		}
+
+		cur = cur->filter_target;
+	}
+
+	*base = cur;
+	return count;
+}
+
+static void build_fused_key(struct dstr *key, obs_source_t **run,
+		size_t count)
+{
+	dstr_free(key);
+
+	for (size_t i = 0; i < count; i++)
+		dstr_catf(key, "%s:%p;", run[i]->info.id,
+				get_pixel_shader(run[i]));
+}
+
+/*
+ * Builds an effect that applies each per-pixel shader in turn.  Each stage is
+ * clamped like it would be by the render target of a separate pass.  With a
+ * single shader and no prefixes, the shader's parameters keep their own
+ * names.
+ */
+static gs_effect_t *create_pixel_shader_effect(const char **shaders,
+		size_t count, bool use_prefix, const char *name)
+{
+	struct dstr effect_string = {0};
+	struct dstr code = {0};
+	struct dstr prefix = {0};
+	gs_effect_t *effect;
+	char *errors = NULL;
+
+	dstr_copy(&effect_string, fused_effect_header);
+
+	for (size_t i = 0; i < count; i++) {
+		if (use_prefix)
+			dstr_printf(&prefix, FUSED_PREFIX_FORMAT, (int)i);
+
+		dstr_copy(&code, shaders[i]);
+		dstr_replace(&code, "FILTER_", prefix.array);
+
+		dstr_cat_dstr(&effect_string, &code);
+		dstr_cat(&effect_string, "\n");
+	}
+
+	/* shaders[0] is the last one to be applied */
+	dstr_cat(&effect_string, "float4 ProcessFused(float4 rgba)\n{\n");
+	for (size_t i = count; i > 0; i--) {
+		if (use_prefix)
+			dstr_printf(&prefix, FUSED_PREFIX_FORMAT, (int)(i - 1));
+
+		dstr_catf(&effect_string,
+				"\trgba = saturate(%sProcess(rgba));\n",
+				prefix.array ? prefix.array : "");
+	}
+	dstr_cat(&effect_string, "\treturn rgba;\n}\n\n");
+
+	dstr_cat(&effect_string, fused_effect_footer);
+
+	effect = gs_effect_create(effect_string.array, NULL, &errors);
+	if (!effect)
+		blog(LOG_WARNING, "Failed to create pixel shader effect for "
+		                  "'%s': %s", name,
+		                  errors ? errors : "(unknown error)");
+
+	bfree(errors);
+	dstr_free(&effect_string);
+	dstr_free(&code);
+	dstr_free(&prefix);
+	return effect;
+}
+
+static gs_effect_t *create_fused_effect(obs_source_t **run, size_t count)
+{
+	const char *shaders[MAX_FUSED_FILTERS];
+
+	for (size_t i = 0; i < count; i++)
+		shaders[i] = get_pixel_shader(run[i]);
+
+	return create_pixel_shader_effect(shaders, count, true,
+			obs_source_get_name(run[0]->filter_parent));
+}
+
+static gs_effect_t *get_fused_effect(obs_source_t *filter, obs_source_t **run,
+		size_t count)
+{
+	struct dstr key = {0};
+
+	build_fused_key(&key, run, count);
+
+	if (dstr_cmp(&filter->fused_key, key.array) != 0) {
+		gs_effect_destroy(filter->fused_effect);
+		filter->fused_effect = create_fused_effect(run, count);
+		filter->fused_failed = !filter->fused_effect;
+		dstr_move(&filter->fused_key, &key);
+	}
+
+	dstr_free(&key);
+	return filter->fused_failed ? NULL : filter->fused_effect;
+}
+
+/*
+ * Renders a chain of per-pixel filters with a single combined effect rather
+ * than a render target per filter.  Returns false if the filter should be
+ * rendered normally instead.
+ */
+static bool render_fused_filters(obs_source_t *filter)
+{
+	obs_source_t *run[MAX_FUSED_FILTERS];
+	obs_source_t *base;
+	struct dstr  prefix = {0};
+	gs_effect_t  *effect;
+	size_t       count;
+
+	count = get_fusable_filters(filter, run, &base);
+	if (count < 2 || !base)
+		return false;
+
+	effect = get_fused_effect(filter, run, count);
+	if (!effect)
+		return false;
+
+	process_filter_begin(filter, base, GS_RGBA,
+			OBS_ALLOW_DIRECT_RENDERING);
+
+	for (size_t i = 0; i < count; i++) {
+		dstr_printf(&prefix, FUSED_PREFIX_FORMAT, (int)i);
+		run[i]->info.set_pixel_shader_params(run[i]->context.data,
+				effect, prefix.array);
+	}
+
+	process_filter_end(filter, base, effect, 0, 0);
+
+	dstr_free(&prefix);
+	return true;
+}
+
+gs_effect_t *obs_filter_create_pixel_shader_effect(const char *pixel_shader,
+		const char *name)
+{
+	if (!pixel_shader)
+		return NULL;
+
+	return create_pixel_shader_effect(&pixel_shader, 1, false,
+			name ? name : "(unknown)");
+}
+
+gs_eparam_t *obs_filter_get_pixel_shader_param(gs_effect_t *effect,
+		const char *prefix, const char *name)
+{
+	struct dstr full_name = {0};
+	gs_eparam_t *param;
+
+	if (!effect || !prefix || !name)
+		return NULL;
+
+	dstr_copy(&full_name, prefix);
+	dstr_cat(&full_name, name);
+	param = gs_effect_get_param_by_name(effect, full_name.array);
+	dstr_free(&full_name);
+
+	return param;
+}
+
 void obs_source_skip_video_filter(obs_source_t *filter)
 {
 	obs_source_t *target, *parent;
@@ -2721,6 +3227,7 @@ void obs_source_set_enabled(obs_source_t *source, bool enabled)
 		return;
 
 	source->enabled = enabled;
+	obs_source_invalidate(source);
 
 	calldata_set_ptr(&data, "source", source);
 	calldata_set_bool(&data, "enabled", enabled);
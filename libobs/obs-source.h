@@ -103,6 +103,42 @@ enum obs_source_type {
  */
 #define OBS_SOURCE_INTERACTION (1<<5)
 
+/**
+ * Source can be ticked in parallel with other sources.
+ *
+ * When this is used, the video_tick, update, show/hide and activate/deactivate
+ * callbacks may be called from a worker thread rather than the graphics
+ * thread, concurrently with the ticks of other sources.  Sources must use
+ * obs_enter_graphics/obs_leave_graphics for any graphics calls made from
+ * those callbacks.  The ticks run without the sources list locked, so they
+ * may create and release sources.
+ */
+#define OBS_SOURCE_PARALLEL_TICK (1<<6)
+
+/**
+ * Source video only changes when its settings, size or filters change.
+ *
+ * When this is used on an input source that has filters, and those filters
+ * are static as well, libobs renders the source and its filters to a cached
+ * texture once and reuses that texture until the source is invalidated.  If
+ * the output of the source changes for any other reason, the source must
+ * call obs_source_invalidate.  On filters, this flag indicates that the
+ * filter output only depends on its settings and its target.
+ */
+#define OBS_SOURCE_STATIC_VIDEO (1<<7)
+
+/**
+ * Source video is fully opaque and covers its entire width and height.
+ *
+ * Scenes use this to skip rendering items that are completely covered by an
+ * opaque item above them.  Async sources are only treated as opaque while
+ * they have a frame to display and that frame has no alpha channel (is not
+ * RGBA or BGRA), so the flag can be set on sources that only sometimes output
+ * alpha.
+ * Sources with enabled filters are never treated as opaque.
+ */
+#define OBS_SOURCE_OPAQUE_VIDEO (1<<8)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
@@ -372,6 +408,35 @@ struct obs_source_info {
 	 * @param  source  Source that the filter being removed from
 	 */
 	void (*filter_remove)(void *data, obs_source_t *source);
+
+	/**
+	 * Returns the per-pixel shader function of a filter.  Filters that only
+	 * change the color of each pixel independently of any other pixel can
+	 * implement this so that libobs can combine them with adjacent filters
+	 * into a single render pass.
+	 *
+	 * The code must prefix every uniform and function it declares with
+	 * "FILTER_", and must define the function
+	 * "float4 FILTER_Process(float4 rgba)".  It must not sample textures.
+	 *
+	 * @param  data  Filter data
+	 * @return       Shader code, or NULL if the filter can't be combined
+	 *               with other filters in its current state
+	 */
+	const char *(*get_pixel_shader)(void *data);
+
+	/**
+	 * Sets the uniforms of the per-pixel shader function of a filter within
+	 * a combined effect.  Required if get_pixel_shader is implemented.
+	 *
+	 * @param  data    Filter data
+	 * @param  effect  Combined effect
+	 * @param  prefix  Prefix that replaced "FILTER_" in the shader code,
+	 *                 use obs_filter_get_pixel_shader_param to get the
+	 *                 parameters of the effect
+	 */
+	void (*set_pixel_shader_params)(void *data, gs_effect_t *effect,
+			const char *prefix);
 };
 
 EXPORT void obs_register_source_s(const struct obs_source_info *info,
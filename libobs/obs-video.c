@@ -50,11 +50,135 @@ static inline void calculate_base_volume(struct obs_core_data *data,
 	}
 }
 
+/* below this number of sources, dispatching to the tick pool costs more
+ * than it saves */
+#define MIN_PARALLEL_TICK_SOURCES 4
+
+static inline bool tick_in_parallel(const struct obs_source *source)
+{
+	return (source->info.output_flags & OBS_SOURCE_PARALLEL_TICK) != 0;
+}
+
+/* a source with no references left is being destroyed, so it must not be
+ * revived */
+static inline bool source_try_addref(struct obs_source *source)
+{
+	long refs;
+
+	do {
+		refs = source->refs;
+		if (!refs)
+			return false;
+	} while (!os_atomic_compare_swap_long(&source->refs, refs, refs + 1));
+
+	return true;
+}
+
+static void tick_source_task(void *param)
+{
+	obs_source_video_tick(param, obs->video.tick_seconds);
+}
+
+static void calculate_base_volume_task(void *param)
+{
+	calculate_base_volume(&obs->data, &obs->data.main_view, param);
+}
+
+/*
+ * Sources are ticked with a reference held to each rather than with the
+ * sources mutex locked, so that the tick callbacks can create, release and
+ * look up sources without inverting the lock order of the user sources mutex
+ * and the sources mutex, or deadlocking with the tick pool.
+ */
+static void collect_tick_sources(struct obs_core_video *video,
+		struct obs_core_data *data)
+{
+	struct obs_source *source;
+
+	da_resize(video->tick_sources, 0);
+
+	pthread_mutex_lock(&data->sources_mutex);
+
+	for (source = data->first_source; source;
+	     source = (struct obs_source*)source->context.next) {
+		if (source_try_addref(source))
+			da_push_back(video->tick_sources, &source);
+	}
+
+	pthread_mutex_unlock(&data->sources_mutex);
+}
+
+static void release_tick_sources(struct obs_core_video *video)
+{
+	for (size_t i = 0; i < video->tick_sources.num; i++)
+		obs_source_release(video->tick_sources.array[i]);
+	da_resize(video->tick_sources, 0);
+}
+
+static void tick_all_sources(struct obs_core_video *video, float seconds)
+{
+	size_t num_parallel = 0;
+	bool   parallel;
+
+	if (video->tick_pool) {
+		for (size_t i = 0; i < video->tick_sources.num; i++) {
+			if (tick_in_parallel(video->tick_sources.array[i]))
+				num_parallel++;
+		}
+	}
+
+	parallel = num_parallel >= MIN_PARALLEL_TICK_SOURCES;
+
+	video->tick_seconds = seconds;
+	if (parallel) {
+		for (size_t i = 0; i < video->tick_sources.num; i++) {
+			struct obs_source *source = video->tick_sources.array[i];
+
+			if (tick_in_parallel(source))
+				task_pool_push(video->tick_pool,
+						tick_source_task, source);
+		}
+	}
+
+	/* sources that may need the graphics thread tick here while the
+	 * pool works on the rest */
+	for (size_t i = 0; i < video->tick_sources.num; i++) {
+		struct obs_source *source = video->tick_sources.array[i];
+
+		if (!parallel || !tick_in_parallel(source))
+			obs_source_video_tick(source, seconds);
+	}
+
+	if (parallel)
+		task_pool_wait(video->tick_pool);
+}
+
+static void calculate_base_volumes(struct obs_core_video *video,
+		struct obs_core_data *data, struct obs_view *view)
+{
+	struct obs_source **sources = video->tick_sources.array;
+	size_t            num       = video->tick_sources.num;
+
+	/* without transitions this is trivial, so only use the pool when
+	 * the source trees actually have to be walked */
+	if (!video->tick_pool || !data->active_transitions) {
+		for (size_t i = 0; i < num; i++)
+			calculate_base_volume(data, view, sources[i]);
+		return;
+	}
+
+	for (size_t i = 0; i < num; i++)
+		task_pool_push(video->tick_pool, calculate_base_volume_task,
+				sources[i]);
+
+	task_pool_wait(video->tick_pool);
+}
+
 static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 {
+	struct obs_core_video *video = &obs->video;
 	struct obs_core_data *data = &obs->data;
 	struct obs_view      *view = &data->main_view;
-	struct obs_source    *source;
 	uint64_t             delta_time;
 	float                seconds;
 
@@ -65,29 +189,20 @@ static uint64_t tick_sources(uint64_t cur_time, uint64_t last_time)
 	delta_time = cur_time - last_time;
 	seconds = (float)((double)delta_time / 1000000000.0);
 
-	pthread_mutex_lock(&data->sources_mutex);
+	os_atomic_inc_long(&video->tick_frame);
+
+	collect_tick_sources(video, data);
 
 	/* call the tick function of each source */
-	source = data->first_source;
-	while (source) {
-		if (source->refs)
-			obs_source_video_tick(source, seconds);
-		source = (struct obs_source*)source->context.next;
-	}
+	tick_all_sources(video, seconds);
 
 	/* calculate source volumes */
 	pthread_mutex_lock(&view->channels_mutex);
-
-	source = data->first_source;
-	while (source) {
-		if (source->refs)
-			calculate_base_volume(data, view, source);
-		source = (struct obs_source*)source->context.next;
-	}
-
+	calculate_base_volumes(video, data, view);
 	pthread_mutex_unlock(&view->channels_mutex);
 
-	pthread_mutex_unlock(&data->sources_mutex);
+	/* the last release destroys a source, which needs the sources mutex */
+	release_tick_sources(video);
 
 	return cur_time;
 }
@@ -375,6 +375,12 @@ static int obs_init_video(struct obs_video_info *ovi)
 
 	gs_leave_context();
 
+	video->tick_pool = task_pool_create("libobs: tick worker", 0);
+	if (video->tick_pool)
+		blog(LOG_INFO, "Using %d thread(s) for parallel source ticks",
+				(int)task_pool_get_thread_count(
+					video->tick_pool));
+
 	errorcode = pthread_create(&video->video_thread, NULL,
 			obs_video_thread, obs);
 	if (errorcode != 0)
@@ -409,6 +415,10 @@ static void obs_free_video(void)
 		video_output_close(video->video);
 		video->video = NULL;
 
+		task_pool_destroy(video->tick_pool);
+		video->tick_pool = NULL;
+		da_free(video->tick_sources);
+
 		if (!video->graphics)
 			return;
 
@@ -530,6 +540,9 @@ static bool obs_init_data(void)
 	if (!obs_view_init(&data->main_view))
 		goto fail;
 
+	/* the user source list was searched from the front */
+	data->user_sources_index.find_oldest = true;
+
 	data->valid = true;
 
 fail:
@@ -584,6 +597,11 @@ static void obs_free_data(void)
 	FREE_OBS_LINKED_LIST(display);
 	FREE_OBS_LINKED_LIST(service);
 
+	obs_context_index_free(&data->user_sources_index);
+	obs_context_index_free(&data->outputs_index);
+	obs_context_index_free(&data->encoders_index);
+	obs_context_index_free(&data->services_index);
+
 	pthread_mutex_destroy(&data->user_sources_mutex);
 	pthread_mutex_destroy(&data->sources_mutex);
 	pthread_mutex_destroy(&data->displays_mutex);
@@ -1026,10 +1044,12 @@ bool obs_add_source(obs_source_t *source)
 	if (!obs) return false;
 	if (!source) return false;
 
-	pthread_mutex_lock(&obs->data.sources_mutex);
+	pthread_mutex_lock(&obs->data.user_sources_mutex);
 	da_push_back(obs->data.user_sources, &source);
+	obs_context_index_add(&obs->data.user_sources_index,
+			&obs->data.user_sources_mutex, &source->context);
 	obs_source_addref(source);
-	pthread_mutex_unlock(&obs->data.sources_mutex);
+	pthread_mutex_unlock(&obs->data.user_sources_mutex);
 
 	calldata_set_ptr(&params, "source", source);
 	signal_handler_signal(obs->signals, "source_add", &params);
@@ -1142,64 +1162,54 @@ void obs_enum_services(bool (*enum_proc)(void*, obs_service_t*), void *param)
 
 obs_source_t *obs_get_source_by_name(const char *name)
 {
-	struct obs_core_data *data = &obs->data;
+	struct obs_context_data *context;
 	struct obs_source *source = NULL;
-	size_t i;
 
 	if (!obs) return NULL;
 
-	pthread_mutex_lock(&data->user_sources_mutex);
+	pthread_mutex_lock(&obs->data.user_sources_mutex);
 
-	for (i = 0; i < data->user_sources.num; i++) {
-		struct obs_source *cur_source = data->user_sources.array[i];
-		if (strcmp(cur_source->context.name, name) == 0) {
-			source = cur_source;
-			obs_source_addref(source);
-			break;
-		}
+	/* the context is the first member of every context type */
+	context = obs_context_index_find(&obs->data.user_sources_index, name);
+	if (context) {
+		source = (struct obs_source*)context;
+		obs_source_addref(source);
 	}
 
-	pthread_mutex_unlock(&data->user_sources_mutex);
+	pthread_mutex_unlock(&obs->data.user_sources_mutex);
 	return source;
 }
 
-static inline void *get_context_by_name(void *vfirst, const char *name,
-		pthread_mutex_t *mutex)
+static inline void *get_context_by_name(struct obs_context_index *index,
+		const char *name, pthread_mutex_t *mutex)
 {
-	struct obs_context_data **first = vfirst;
 	struct obs_context_data *context;
 
 	pthread_mutex_lock(mutex);
-
-	context = *first;
-	while (context) {
-		if (strcmp(context->name, name) == 0)
-			break;
-		context = context->next;
-	}
-
+	context = obs_context_index_find(index, name);
 	pthread_mutex_unlock(mutex);
+
 	return context;
 }
 
 obs_output_t *obs_get_output_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_output, name,
+	return get_context_by_name(&obs->data.outputs_index, name,
 			&obs->data.outputs_mutex);
 }
 
 obs_encoder_t *obs_get_encoder_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_encoder, name,
+	return get_context_by_name(&obs->data.encoders_index, name,
 			&obs->data.encoders_mutex);
 }
 
 obs_service_t *obs_get_service_by_name(const char *name)
 {
 	if (!obs) return NULL;
-	return get_context_by_name(&obs->data.first_service, name,
+	return get_context_by_name(&obs->data.services_index, name,
 			&obs->data.services_mutex);
 }
 
@@ -1552,7 +1562,8 @@ void obs_context_data_free(struct obs_context_data *context)
 }
 
 void obs_context_data_insert(struct obs_context_data *context,
-		pthread_mutex_t *mutex, void *pfirst)
+		pthread_mutex_t *mutex, void *pfirst,
+		struct obs_context_index *index)
 {
 	struct obs_context_data **first = pfirst;
 
@@ -1568,11 +1579,16 @@ void obs_context_data_insert(struct obs_context_data *context,
 	*first              = context;
 	if (context->next)
 		context->next->prev_next = &context->next;
+	if (index)
+		obs_context_index_add(index, mutex, context);
 	pthread_mutex_unlock(mutex);
 }
 
 void obs_context_data_remove(struct obs_context_data *context)
 {
+	if (context)
+		obs_context_index_remove(context);
+
 	if (context && context->mutex) {
 		pthread_mutex_lock(context->mutex);
 		if (context->prev_next)
@@ -1585,16 +1601,179 @@ void obs_context_data_remove(struct obs_context_data *context)
 	}
 }
 
+/* ------------------------------------------------------------------------- */
+/* name index */
+
+#define MIN_INDEX_BUCKETS 64
+
+static inline struct obs_context_data **get_bucket(
+		const struct obs_context_index *index, uint32_t hash)
+{
+	return &index->buckets[hash & (index->num_buckets - 1)];
+}
+
+static void context_index_grow(struct obs_context_index *index)
+{
+	struct obs_context_data **old_buckets = index->buckets;
+	size_t old_num = index->num_buckets;
+
+	index->num_buckets = old_num ? old_num * 2 : MIN_INDEX_BUCKETS;
+	index->buckets = bzalloc(sizeof(struct obs_context_data*) *
+			index->num_buckets);
+
+	for (size_t i = 0; i < old_num; i++) {
+		struct obs_context_data *context = old_buckets[i];
+
+		while (context) {
+			struct obs_context_data *next = context->hash_next;
+			struct obs_context_data **bucket =
+				get_bucket(index, context->name_hash);
+
+			context->hash_next = *bucket;
+			*bucket = context;
+			context = next;
+		}
+	}
+
+	bfree(old_buckets);
+}
+
+static void context_index_link(struct obs_context_index *index,
+		struct obs_context_data *context)
+{
+	struct obs_context_data **bucket;
+
+	if (index->count >= index->num_buckets)
+		context_index_grow(index);
+
+	context->name_hash = obs_hash_name(context->name);
+
+	bucket = get_bucket(index, context->name_hash);
+	context->hash_next = *bucket;
+	*bucket = context;
+	index->count++;
+}
+
+static void context_index_unlink(struct obs_context_index *index,
+		struct obs_context_data *context)
+{
+	struct obs_context_data **cur;
+
+	if (!index->num_buckets)
+		return;
+
+	cur = get_bucket(index, context->name_hash);
+	while (*cur) {
+		if (*cur == context) {
+			*cur = context->hash_next;
+			context->hash_next = NULL;
+			index->count--;
+			break;
+		}
+
+		cur = &(*cur)->hash_next;
+	}
+}
+
+void obs_context_index_add(struct obs_context_index *index,
+		pthread_mutex_t *mutex, struct obs_context_data *context)
+{
+	pthread_mutex_lock(mutex);
+
+	context->index       = index;
+	context->index_mutex = mutex;
+	context->index_order = index->next_order++;
+	context_index_link(index, context);
+
+	pthread_mutex_unlock(mutex);
+}
+
+void obs_context_index_remove(struct obs_context_data *context)
+{
+	pthread_mutex_t *mutex = context->index_mutex;
+
+	if (!mutex)
+		return;
+
+	pthread_mutex_lock(mutex);
+
+	if (context->index)
+		context_index_unlink(context->index, context);
+	context->index       = NULL;
+	context->index_mutex = NULL;
+
+	pthread_mutex_unlock(mutex);
+}
+
+static inline bool context_index_prefer(
+		const struct obs_context_index *index,
+		const struct obs_context_data *context,
+		const struct obs_context_data *found)
+{
+	if (!found)
+		return true;
+
+	return index->find_oldest ?
+		context->index_order < found->index_order :
+		context->index_order > found->index_order;
+}
+
+/* the index mutex must be held by the caller */
+void *obs_context_index_find(const struct obs_context_index *index,
+		const char *name)
+{
+	struct obs_context_data *context;
+	struct obs_context_data *found = NULL;
+	uint32_t hash;
+
+	if (!index->num_buckets || !name)
+		return NULL;
+
+	hash = obs_hash_name(name);
+
+	/* chains aren't kept in insertion order (growing the index reverses
+	 * them), so the whole chain is checked for duplicate names */
+	context = *get_bucket(index, hash);
+	while (context) {
+		if (context->name_hash == hash &&
+		    strcmp(context->name, name) == 0 &&
+		    context_index_prefer(index, context, found))
+			found = context;
+
+		context = context->hash_next;
+	}
+
+	return found;
+}
+
+void obs_context_index_free(struct obs_context_index *index)
+{
+	bfree(index->buckets);
+	memset(index, 0, sizeof(*index));
+}
+
 void obs_context_data_setname(struct obs_context_data *context,
 		const char *name)
 {
+	pthread_mutex_t *index_mutex = context->index_mutex;
+
+	if (index_mutex)
+		pthread_mutex_lock(index_mutex);
 	pthread_mutex_lock(&context->rename_cache_mutex);
 
+	if (context->index)
+		context_index_unlink(context->index, context);
+
 	if (context->name)
 		da_push_back(context->rename_cache, &context->name);
 	context->name = dup_name(name);
 
+	if (context->index)
+		context_index_link(context->index, context);
+
 	pthread_mutex_unlock(&context->rename_cache_mutex);
+	if (index_mutex)
+		pthread_mutex_unlock(index_mutex);
 }
 
 void obs_preview_set_enabled(bool enable)
@@ -688,6 +688,13 @@ EXPORT void obs_source_update(obs_source_t *source, obs_data_t *settings);
 /** Renders a video source. */
 EXPORT void obs_source_video_render(obs_source_t *source);
 
+/**
+ * Invalidates the cached render of a source flagged with
+ * OBS_SOURCE_STATIC_VIDEO, causing it to be rendered again on the next frame.
+ * If the source is a filter, its parent source is invalidated.
+ */
+EXPORT void obs_source_invalidate(obs_source_t *source);
+
 /** Gets the width of a source (if it has video) */
 EXPORT uint32_t obs_source_get_width(obs_source_t *source);
 
@@ -922,6 +929,23 @@ EXPORT void obs_source_process_filter_end(obs_source_t *filter,
 /** Skips the filter if the filter is invalid and cannot be rendered */
 EXPORT void obs_source_skip_video_filter(obs_source_t *filter);
 
+/**
+ * Gets a parameter of a filter's per-pixel shader function within a combined
+ * effect.  Used by the set_pixel_shader_params callback of filters.
+ */
+EXPORT gs_eparam_t *obs_filter_get_pixel_shader_param(gs_effect_t *effect,
+		const char *prefix, const char *name);
+
+/**
+ * Creates an effect that renders a filter's per-pixel shader on its own, with
+ * the same Draw and DrawMatrix techniques as a combined effect, so that a
+ * filter's regular rendering and its combined rendering share the same
+ * shader code.  Parameters are set with obs_filter_get_pixel_shader_param
+ * and an empty prefix.  Must be called within the graphics context.
+ */
+EXPORT gs_effect_t *obs_filter_create_pixel_shader_effect(
+		const char *pixel_shader, const char *name);
+
 /**
  * Adds a child source.  Must be called by parent sources on child sources
  * when the child is added.  This ensures that the source is properly activated
@@ -1081,9 +1105,41 @@ EXPORT const char *obs_output_get_name(const obs_output_t *output);
 /** Starts the output. */
 EXPORT bool obs_output_start(obs_output_t *output);
 
-/** Stops the output. */
+/**
+ * Stops the output.  If the output is delayed with
+ * OBS_OUTPUT_DELAY_STOP_AFTER, it keeps running until the data captured up to
+ * this point has been sent, and signals "stopping" in the meantime.
+ */
 EXPORT void obs_output_stop(obs_output_t *output);
 
+/** Stops the output right away, discarding any delayed data */
+EXPORT void obs_output_force_stop(obs_output_t *output);
+
+/** When stopping, keep the output running until the delayed data is sent */
+#define OBS_OUTPUT_DELAY_STOP_AFTER (1<<0)
+
+/**
+ * Sets the amount of time in seconds to hold back encoded data before it is
+ * passed to the output, 0 to disable.  Takes effect the next time the output
+ * starts.
+ */
+EXPORT void obs_output_set_delay(obs_output_t *output, uint32_t delay_sec,
+		uint32_t flags);
+
+/** Gets the delay set with obs_output_set_delay */
+EXPORT uint32_t obs_output_get_delay(const obs_output_t *output);
+
+/** Gets the delay in seconds of the currently active output */
+EXPORT uint32_t obs_output_get_active_delay(const obs_output_t *output);
+
+/**
+ * Writes delayed data past memory_limit bytes to a ring buffer of file_size
+ * bytes in the file at path, for long delays.  The file is removed when the
+ * output stops.  Set path to NULL to keep all delayed data in memory.
+ */
+EXPORT void obs_output_set_delay_spill(obs_output_t *output,
+		const char *path, size_t memory_limit, uint64_t file_size);
+
 /** Returns whether the output is active */
 EXPORT bool obs_output_active(const obs_output_t *output);
 
@@ -1191,6 +1247,16 @@ EXPORT uint64_t obs_output_get_total_bytes(const obs_output_t *output);
 EXPORT int obs_output_get_frames_dropped(const obs_output_t *output);
 EXPORT int obs_output_get_total_frames(const obs_output_t *output);
 
+/**
+ * Returns the average time in nanoseconds that encoded packets are held back
+ * to interleave audio and video before being passed to the output
+ */
+EXPORT uint64_t obs_output_get_interleave_latency(const obs_output_t *output);
+
+/** Returns the highest interleave latency since the output was started */
+EXPORT uint64_t obs_output_get_max_interleave_latency(
+		const obs_output_t *output);
+
 /**
  * Sets the preferred scaled resolution for this output.  Set width and height
  * to 0 to disable scaling.
@@ -1287,6 +1353,21 @@ EXPORT void obs_encoder_destroy(obs_encoder_t *encoder);
 EXPORT void obs_encoder_set_name(obs_encoder_t *encoder, const char *name);
 EXPORT const char *obs_encoder_get_name(const obs_encoder_t *encoder);
 
+/**
+ * Returns the signal handler for an encoder
+ *
+ * Signals:
+ *   void overload(ptr encoder, bool overloaded)
+ *     Emitted when the encoder can no longer encode frames within the frame
+ *     interval (overloaded is true), and again once it has recovered
+ *
+ *   void update(ptr encoder, bool success)
+ *     Emitted from the encoding thread when settings changed while the
+ *     encoder was active have been applied
+ */
+EXPORT signal_handler_t *obs_encoder_get_signal_handler(
+		const obs_encoder_t *encoder);
+
 /** Returns the codec of an encoder by the id */
 EXPORT const char *obs_get_encoder_codec(const char *id);
 
@@ -1307,6 +1388,18 @@ EXPORT enum obs_encoder_type obs_encoder_get_type(const obs_encoder_t *encoder);
 EXPORT void obs_encoder_set_scaled_size(obs_encoder_t *encoder, uint32_t width,
 		uint32_t height);
 
+/**
+ * Adds a scaled video encoder to the shared downscale cascade of its video
+ * output, for encoding multiple renditions of the same video (an encode
+ * ladder).  Rather than every rendition being scaled from the full resolution
+ * frame, each cascaded encoder is scaled from the frame of the next larger
+ * cascaded encoder with the same format.  Can only be changed while the
+ * encoder is inactive.
+ */
+EXPORT void obs_encoder_set_scale_cascade(obs_encoder_t *encoder,
+		bool cascade);
+EXPORT bool obs_encoder_scale_cascade(const obs_encoder_t *encoder);
+
 /** For video encoders, returns the width of the encoded image */
 EXPORT uint32_t obs_encoder_get_width(const obs_encoder_t *encoder);
 
@@ -1326,6 +1419,38 @@ EXPORT void obs_encoder_set_preferred_video_format(obs_encoder_t *encoder,
 EXPORT enum video_format obs_encoder_get_preferred_video_format(
 		const obs_encoder_t *encoder);
 
+/**
+ * Emits the overload signal of an encoder.  Called by encoder implementations
+ * when they detect that they are falling behind real time or have recovered.
+ */
+EXPORT void obs_encoder_signal_overload(obs_encoder_t *encoder,
+		bool overloaded);
+
+/**
+ * Sets whether a video encoder encodes on its own thread.
+ *
+ * When enabled, frames are copied in to a small bounded queue and encoded on
+ * a separate thread rather than on the video output thread.  If the encoder
+ * falls behind and the queue is full, new frames are dropped instead of
+ * delaying frame delivery to other encoders and outputs.  Can only be changed
+ * while the encoder is inactive.
+ */
+EXPORT void obs_encoder_set_async(obs_encoder_t *encoder, bool async);
+EXPORT bool obs_encoder_async(const obs_encoder_t *encoder);
+
+/** Returns the number of frames dropped because the encoder queue was full */
+EXPORT int obs_encoder_get_frames_dropped(const obs_encoder_t *encoder);
+
+/** Returns the current and maximum number of frames waiting to be encoded */
+EXPORT int obs_encoder_get_queue_depth(const obs_encoder_t *encoder);
+EXPORT int obs_encoder_get_max_queue_depth(const obs_encoder_t *encoder);
+
+/**
+ * Returns the smoothed time in nanoseconds between a frame being received by
+ * the encoder and its encode call returning.
+ */
+EXPORT uint64_t obs_encoder_get_encode_latency(const obs_encoder_t *encoder);
+
 /** Gets the default settings for an encoder type */
 EXPORT obs_data_t *obs_encoder_defaults(const char *id);
 
@@ -1340,10 +1465,24 @@ EXPORT obs_properties_t *obs_encoder_properties(const obs_encoder_t *encoder);
 
 /**
  * Updates the settings of the encoder context.  Usually used for changing
- * bitrate while active
+ * bitrate while active.
+ *
+ * Can be called from any thread.  If the encoder is active, the settings are
+ * applied by the encoding thread before the next frame is encoded, and the
+ * encoder's "update" signal reports whether the encoder accepted them.
  */
 EXPORT void obs_encoder_update(obs_encoder_t *encoder, obs_data_t *settings);
 
+/**
+ * Requests that the next frame be encoded as a keyframe, if the encoder
+ * supports it.  Outputs can't use any video until they receive a keyframe, so
+ * this is done automatically when an output is attached to a video encoder
+ * that is already active.
+ *
+ * Can be called from any thread.
+ */
+EXPORT void obs_encoder_request_keyframe(obs_encoder_t *encoder);
+
 /** Gets extra data (headers) associated with this context */
 EXPORT bool obs_encoder_get_extra_data(const obs_encoder_t *encoder,
 		uint8_t **extra_data, size_t *size);
@@ -1372,12 +1511,36 @@ EXPORT audio_t *obs_encoder_audio(const obs_encoder_t *encoder);
 /** Returns true if encoder is active, false otherwise */
 EXPORT bool obs_encoder_active(const obs_encoder_t *encoder);
 
+/** Returns the number of outputs that the encoder is set on */
+EXPORT size_t obs_encoder_get_num_outputs(obs_encoder_t *encoder);
+
 /** Duplicates an encoder packet */
 EXPORT void obs_duplicate_encoder_packet(struct encoder_packet *dst,
 		const struct encoder_packet *src);
 
 EXPORT void obs_free_encoder_packet(struct encoder_packet *packet);
 
+/**
+ * Creates a reference-counted copy of an encoder packet.  Release the new
+ * packet with obs_encoder_packet_release.
+ */
+EXPORT void obs_encoder_packet_create_instance(struct encoder_packet *dst,
+		const struct encoder_packet *src);
+
+/**
+ * Adds a reference to a reference-counted encoder packet.
+ *
+ * Packets passed to encoded packet callbacks are reference-counted and
+ * immutable, and are shared by every output the encoder sends to.  Outputs
+ * that need to keep a packet after the callback has returned should add a
+ * reference to it rather than duplicating it.
+ */
+EXPORT void obs_encoder_packet_ref(struct encoder_packet *dst,
+		struct encoder_packet *src);
+
+/** Releases a reference to a reference-counted encoder packet */
+EXPORT void obs_encoder_packet_release(struct encoder_packet *packet);
+
 
 /* ------------------------------------------------------------------------- */
 /* Stream Services */
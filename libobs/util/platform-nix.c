@@ -144,6 +144,12 @@ void os_sleep_ms(uint32_t duration)
 	usleep(duration*1000);
 }
 
+int os_get_logical_cores(void)
+{
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	return cores > 0 ? (int)cores : 1;
+}
+
 #if !defined(__APPLE__)
 
 uint64_t os_gettime_ns(void)
@@ -296,6 +302,11 @@ int os_unlink(const char *path)
 	return unlink(path);
 }
 
+int os_rename(const char *old_path, const char *new_path)
+{
+	return rename(old_path, new_path);
+}
+
 int os_mkdir(const char *path)
 {
 	if (mkdir(path, 0777) == 0)
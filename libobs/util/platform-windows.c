@@ -177,6 +177,13 @@ void os_sleep_ms(uint32_t duration)
 	Sleep(duration);
 }
 
+int os_get_logical_cores(void)
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (int)info.dwNumberOfProcessors;
+}
+
 uint64_t os_gettime_ns(void)
 {
 	LARGE_INTEGER current_time;
@@ -395,6 +402,25 @@ int os_unlink(const char *path)
 	return success ? 0 : -1;
 }
 
+int os_rename(const char *old_path, const char *new_path)
+{
+	wchar_t *old_path_utf16 = NULL;
+	wchar_t *new_path_utf16 = NULL;
+	bool success = false;
+
+	os_utf8_to_wcs_ptr(old_path, 0, &old_path_utf16);
+	os_utf8_to_wcs_ptr(new_path, 0, &new_path_utf16);
+
+	if (old_path_utf16 && new_path_utf16)
+		success = !!MoveFileExW(old_path_utf16, new_path_utf16,
+				MOVEFILE_REPLACE_EXISTING);
+
+	bfree(old_path_utf16);
+	bfree(new_path_utf16);
+
+	return success ? 0 : -1;
+}
+
 int os_mkdir(const char *path)
 {
 	wchar_t *path_utf16;
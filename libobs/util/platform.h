@@ -79,6 +79,8 @@ EXPORT os_cpu_usage_info_t *os_cpu_usage_info_start(void);
 EXPORT double              os_cpu_usage_info_query(os_cpu_usage_info_t *info);
 EXPORT void                os_cpu_usage_info_destroy(os_cpu_usage_info_t *info);
 
+EXPORT int os_get_logical_cores(void);
+
 typedef const void os_performance_token_t;
 EXPORT os_performance_token_t *os_request_high_performance(const char *reason);
 EXPORT void                   os_end_high_performance(os_performance_token_t *);
@@ -129,6 +131,9 @@ EXPORT void os_globfree(os_glob_t *pglob);
 
 EXPORT int os_unlink(const char *path);
 
+/** Renames a file, replacing the destination if it already exists */
+EXPORT int os_rename(const char *old_path, const char *new_path);
+
 #define MKDIR_EXISTS   1
 #define MKDIR_SUCCESS  0
 #define MKDIR_ERROR   -1
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+#include <string.h>
+
+#include "bmem.h"
+#include "threading.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Fixed size single producer, single consumer ring buffer
+ *
+ *   The producer only writes write_idx, the consumer only writes read_idx,
+ * and count is changed with atomics, which also act as the memory barriers,
+ * so neither side needs a mutex.  free_sem counts the free elements, which
+ * lets the producer block while the ring is full.  Waking the consumer is
+ * left to the user, as a consumer may be reading from more than one ring.
+ *
+ *   The producer reserves an element, fills it in place, then commits it:
+ *
+ *     if (spsc_ring_reserve(ring)) {
+ *             *(T*)spsc_ring_back(ring) = item;
+ *             spsc_ring_commit(ring);
+ *     }
+ *
+ *   The consumer reads spsc_ring_front while spsc_ring_count is non-zero, and
+ * calls spsc_ring_pop_front when done with the element.
+ */
+
+struct spsc_ring {
+	uint8_t       *data;
+	size_t        element_size;
+	size_t        capacity;
+
+	size_t        write_idx;
+	size_t        read_idx;
+	volatile long count;
+	long          max_count;
+
+	os_sem_t      *free_sem;
+};
+
+static inline bool spsc_ring_init(struct spsc_ring *ring, size_t element_size,
+		size_t capacity)
+{
+	memset(ring, 0, sizeof(struct spsc_ring));
+
+	if (os_sem_init(&ring->free_sem, (int)capacity) != 0)
+		return false;
+
+	ring->data         = bzalloc(element_size * capacity);
+	ring->element_size = element_size;
+	ring->capacity     = capacity;
+	return true;
+}
+
+/* any elements still in the ring must be released by the caller first */
+static inline void spsc_ring_free(struct spsc_ring *ring)
+{
+	os_sem_destroy(ring->free_sem);
+	bfree(ring->data);
+	memset(ring, 0, sizeof(struct spsc_ring));
+}
+
+static inline size_t spsc_ring_count(const struct spsc_ring *ring)
+{
+	return (size_t)ring->count;
+}
+
+static inline bool spsc_ring_full(const struct spsc_ring *ring)
+{
+	return (size_t)ring->count == ring->capacity;
+}
+
+/* storage of an element by absolute index, for initializing and freeing
+ * per-element data */
+static inline void *spsc_ring_at(struct spsc_ring *ring, size_t idx)
+{
+	return ring->data + idx * ring->element_size;
+}
+
+/* ------------------------------------------------------------------------- */
+/* producer */
+
+/* blocks until an element is free, returns false if the wait failed */
+static inline bool spsc_ring_reserve(struct spsc_ring *ring)
+{
+	return os_sem_wait(ring->free_sem) == 0;
+}
+
+/* reserves an element without blocking, returns false if the ring is full */
+static inline bool spsc_ring_try_reserve(struct spsc_ring *ring)
+{
+	/* only the producer takes from free_sem, so it can't block here once
+	 * the ring is known to have room */
+	if (spsc_ring_full(ring))
+		return false;
+	return spsc_ring_reserve(ring);
+}
+
+/* the reserved element */
+static inline void *spsc_ring_back(struct spsc_ring *ring)
+{
+	return spsc_ring_at(ring, ring->write_idx);
+}
+
+/* publishes the reserved element to the consumer, returns the new count */
+static inline long spsc_ring_commit(struct spsc_ring *ring)
+{
+	long count;
+
+	ring->write_idx = (ring->write_idx + 1) % ring->capacity;
+
+	count = os_atomic_inc_long(&ring->count);
+	if (count > ring->max_count)
+		ring->max_count = count;
+
+	return count;
+}
+
+/* ------------------------------------------------------------------------- */
+/* consumer */
+
+/* the oldest element, only valid while the count is non-zero */
+static inline void *spsc_ring_front(struct spsc_ring *ring)
+{
+	return spsc_ring_at(ring, ring->read_idx);
+}
+
+static inline void spsc_ring_pop_front(struct spsc_ring *ring)
+{
+	ring->read_idx = (ring->read_idx + 1) % ring->capacity;
+	os_atomic_dec_long(&ring->count);
+	os_sem_post(ring->free_sem);
+}
+
+/* copies out and removes the oldest element, returns false if empty */
+static inline bool spsc_ring_pop(struct spsc_ring *ring, void *data)
+{
+	if (!ring->count)
+		return false;
+
+	memcpy(data, spsc_ring_front(ring), ring->element_size);
+	spsc_ring_pop_front(ring);
+	return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
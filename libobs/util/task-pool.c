@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "bmem.h"
+#include "darray.h"
+#include "threading.h"
+#include "platform.h"
+#include "task-pool.h"
+
+struct pool_task {
+	task_pool_task_t  func;
+	void              *param;
+};
+
+struct pool_worker {
+	struct task_pool           *pool;
+	pthread_t                  thread;
+	bool                       thread_created;
+
+	pthread_mutex_t            mutex;
+	DARRAY(struct pool_task)   tasks;
+};
+
+struct task_pool {
+	char                       *name;
+	struct pool_worker         *workers;
+	size_t                     num_workers;
+	volatile long              next_worker;
+
+	volatile long              pending;
+	os_sem_t                   *task_sem;
+	os_event_t                 *done_event;
+	volatile bool              stop;
+};
+
+static bool pop_own_task(struct pool_worker *worker, struct pool_task *task)
+{
+	bool success = false;
+
+	pthread_mutex_lock(&worker->mutex);
+	if (worker->tasks.num) {
+		*task = worker->tasks.array[worker->tasks.num - 1];
+		da_pop_back(worker->tasks);
+		success = true;
+	}
+	pthread_mutex_unlock(&worker->mutex);
+
+	return success;
+}
+
+static bool steal_task(struct pool_worker *worker, struct pool_task *task)
+{
+	bool success = false;
+
+	pthread_mutex_lock(&worker->mutex);
+	if (worker->tasks.num) {
+		*task = worker->tasks.array[0];
+		da_erase(worker->tasks, 0);
+		success = true;
+	}
+	pthread_mutex_unlock(&worker->mutex);
+
+	return success;
+}
+
+/* tries the worker's own queue first, then walks the other queues starting
+ * from the next worker so that thieves don't all hit the same queue */
+static bool get_task(struct task_pool *pool, size_t idx,
+		struct pool_task *task)
+{
+	if (idx < pool->num_workers && pop_own_task(&pool->workers[idx], task))
+		return true;
+
+	for (size_t i = 1; i <= pool->num_workers; i++) {
+		size_t victim = (idx + i) % pool->num_workers;
+		if (steal_task(&pool->workers[victim], task))
+			return true;
+	}
+
+	return false;
+}
+
+static inline void run_task(struct task_pool *pool, struct pool_task *task)
+{
+	task->func(task->param);
+
+	if (os_atomic_dec_long(&pool->pending) == 0)
+		os_event_signal(pool->done_event);
+}
+
+static void *worker_thread(void *data)
+{
+	struct pool_worker *worker = data;
+	struct task_pool   *pool   = worker->pool;
+	size_t             idx     = worker - pool->workers;
+	struct pool_task   task;
+
+	os_set_thread_name(pool->name);
+
+	while (os_sem_wait(pool->task_sem) == 0) {
+		if (pool->stop)
+			break;
+
+		/* the calling thread of task_pool_wait may have already taken
+		 * the task this post was for */
+		if (get_task(pool, idx, &task))
+			run_task(pool, &task);
+	}
+
+	return NULL;
+}
+
+static void free_workers(struct task_pool *pool)
+{
+	pool->stop = true;
+
+	for (size_t i = 0; i < pool->num_workers; i++)
+		os_sem_post(pool->task_sem);
+
+	for (size_t i = 0; i < pool->num_workers; i++) {
+		struct pool_worker *worker = &pool->workers[i];
+
+		if (worker->thread_created)
+			pthread_join(worker->thread, NULL);
+
+		pthread_mutex_destroy(&worker->mutex);
+		da_free(worker->tasks);
+	}
+
+	bfree(pool->workers);
+	pool->workers = NULL;
+	pool->num_workers = 0;
+}
+
+task_pool_t *task_pool_create(const char *name, size_t threads)
+{
+	struct task_pool *pool;
+
+	if (!threads) {
+		int cores = os_get_logical_cores();
+		threads = cores > 1 ? (size_t)cores - 1 : 0;
+	}
+
+	if (!threads)
+		return NULL;
+
+	pool = bzalloc(sizeof(struct task_pool));
+	pool->name = bstrdup(name ? name : "task pool worker");
+
+	if (os_sem_init(&pool->task_sem, 0) != 0)
+		goto fail;
+	if (os_event_init(&pool->done_event, OS_EVENT_TYPE_AUTO) != 0)
+		goto fail;
+
+	pool->workers = bzalloc(sizeof(struct pool_worker) * threads);
+	pool->num_workers = threads;
+
+	for (size_t i = 0; i < threads; i++) {
+		struct pool_worker *worker = &pool->workers[i];
+
+		worker->pool = pool;
+		if (pthread_mutex_init(&worker->mutex, NULL) != 0)
+			goto fail;
+	}
+
+	for (size_t i = 0; i < threads; i++) {
+		struct pool_worker *worker = &pool->workers[i];
+
+		if (pthread_create(&worker->thread, NULL, worker_thread,
+					worker) != 0)
+			goto fail;
+		worker->thread_created = true;
+	}
+
+	return pool;
+
+fail:
+	task_pool_destroy(pool);
+	return NULL;
+}
+
+void task_pool_destroy(task_pool_t *pool)
+{
+	if (!pool)
+		return;
+
+	if (pool->workers)
+		free_workers(pool);
+
+	os_sem_destroy(pool->task_sem);
+	os_event_destroy(pool->done_event);
+	bfree(pool->name);
+	bfree(pool);
+}
+
+size_t task_pool_get_thread_count(const task_pool_t *pool)
+{
+	return pool ? pool->num_workers : 0;
+}
+
+void task_pool_push(task_pool_t *pool, task_pool_task_t func, void *param)
+{
+	struct pool_task   task = {func, param};
+	struct pool_worker *worker;
+	size_t             idx;
+
+	if (!pool || !func)
+		return;
+
+	idx = (size_t)os_atomic_inc_long(&pool->next_worker) %
+		pool->num_workers;
+	worker = &pool->workers[idx];
+
+	os_atomic_inc_long(&pool->pending);
+
+	pthread_mutex_lock(&worker->mutex);
+	da_push_back(worker->tasks, &task);
+	pthread_mutex_unlock(&worker->mutex);
+
+	os_sem_post(pool->task_sem);
+}
+
+void task_pool_wait(task_pool_t *pool)
+{
+	struct pool_task task;
+
+	if (!pool)
+		return;
+
+	/* the event is signaled when the last task finishes, and stays
+	 * signaled until it's waited on, so the wakeup can't be missed */
+	while (pool->pending) {
+		if (get_task(pool, pool->num_workers, &task))
+			run_task(pool, &task);
+		else
+			os_event_wait(pool->done_event);
+	}
+}
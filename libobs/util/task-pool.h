@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2015 Hugh Bailey <obs.jim@gmail.com>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+#include "c99defs.h"
+
+/*
+ *   Work-stealing task pool.
+ *
+ *   Each worker thread owns a task queue.  Pushed tasks are spread over the
+ * worker queues, workers take their own tasks from the back of their queue,
+ * and idle workers steal from the front of the other queues.  The thread that
+ * calls task_pool_wait also helps execute tasks until the pool is drained.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct task_pool;
+typedef struct task_pool task_pool_t;
+
+typedef void (*task_pool_task_t)(void *param);
+
+/**
+ * Creates a task pool.
+ *
+ * @param  name     Thread name used for the worker threads
+ * @param  threads  Number of worker threads, or 0 to use one less than the
+ *                  number of logical cores
+ * @return          The task pool, or NULL if no worker threads could be
+ *                  created
+ */
+EXPORT task_pool_t *task_pool_create(const char *name, size_t threads);
+EXPORT void task_pool_destroy(task_pool_t *pool);
+
+EXPORT size_t task_pool_get_thread_count(const task_pool_t *pool);
+
+/** Queues a task for execution on one of the worker threads */
+EXPORT void task_pool_push(task_pool_t *pool, task_pool_task_t task,
+		void *param);
+
+/**
+ * Waits until all queued tasks have finished executing.  The calling thread
+ * executes queued tasks itself while waiting.
+ */
+EXPORT void task_pool_wait(task_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
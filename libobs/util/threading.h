@@ -73,6 +73,10 @@ EXPORT int  os_sem_wait(os_sem_t *sem);
 EXPORT long os_atomic_inc_long(volatile long *val);
 EXPORT long os_atomic_dec_long(volatile long *val);
 
+/** Sets val to new_val if it equals old_val, returns true if it did */
+EXPORT bool os_atomic_compare_swap_long(volatile long *val, long old_val,
+		long new_val);
+
 EXPORT void os_set_thread_name(const char *name);
 
 
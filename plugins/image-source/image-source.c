@@ -175,7 +175,8 @@ static obs_properties_t *image_source_properties(void *unused)
 static struct obs_source_info image_source_info = {
 	.id             = "image_source",
 	.type           = OBS_SOURCE_TYPE_INPUT,
-	.output_flags   = OBS_SOURCE_VIDEO,
+	.output_flags   = OBS_SOURCE_VIDEO | OBS_SOURCE_PARALLEL_TICK |
+	                  OBS_SOURCE_STATIC_VIDEO,
 	.get_name       = image_source_get_name,
 	.create         = image_source_create,
 	.destroy        = image_source_destroy,
@@ -241,6 +241,24 @@ static bool do_aac_encode(struct aac_encoder *enc,
 	return true;
 }
 
+/* the FFmpeg AAC encoder computes its bit budget from the context bitrate for
+ * every frame, so the bitrate can be changed between frames */
+static bool aac_update(void *data, obs_data_t *settings)
+{
+	struct aac_encoder *enc = data;
+	int bitrate = (int)obs_data_get_int(settings, "bitrate");
+
+	if (!bitrate) {
+		aac_warn("aac_update", "Invalid bitrate specified");
+		return false;
+	}
+
+	enc->context->bit_rate = bitrate * 1000;
+
+	blog(LOG_INFO, "FFmpeg AAC: bitrate changed to %d", bitrate);
+	return true;
+}
+
 static bool aac_encode(void *data, struct encoder_frame *frame,
 		struct encoder_packet *packet, bool *received_packet)
 {
@@ -297,6 +315,7 @@ struct obs_encoder_info aac_encoder_info = {
 	.create         = aac_create,
 	.destroy        = aac_destroy,
 	.encode         = aac_encode,
+	.update         = aac_update,
 	.get_frame_size = aac_frame_size,
 	.get_defaults   = aac_defaults,
 	.get_properties = aac_properties,
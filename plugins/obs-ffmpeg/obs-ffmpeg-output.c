@@ -18,11 +18,12 @@
 #include <obs-module.h>
 #include <util/circlebuf.h>
 #include <util/threading.h>
+#include <util/spsc-ring.h>
 #include <util/dstr.h>
-#include <util/darray.h>
 #include <util/platform.h>
 
 #include <libavutil/opt.h>
+#include <libavutil/imgutils.h>
 #include <libavformat/avformat.h>
 #include <libswscale/swscale.h>
 
@@ -78,6 +79,14 @@ struct ffmpeg_data {
 	bool               initialized;
 };
 
+#define VIDEO_QUEUE_SIZE  8
+#define PACKET_QUEUE_SIZE 256
+
+struct video_slot {
+	AVPicture          picture;
+	uint64_t           timestamp;
+};
+
 struct ffmpeg_output {
 	obs_output_t       *output;
 	volatile bool      active;
@@ -87,12 +96,32 @@ struct ffmpeg_output {
 	pthread_t          start_thread;
 
 	bool               write_thread_active;
-	pthread_mutex_t    write_mutex;
 	pthread_t          write_thread;
 	os_sem_t           *write_sem;
 	os_event_t         *stop_event;
-
-	DARRAY(AVPacket)   packets;
+	volatile bool      write_error;
+
+	/* raw frames are copied in on the video thread and encoded on the
+	 * video encode thread, using the same kind of ring as the packets */
+	struct spsc_ring   video_slots;
+	long               dropped_frames;
+	os_sem_t           *video_sem;
+	pthread_t          video_thread;
+	bool               video_thread_active;
+
+	/* raw audio is buffered in ff_data.excess_frames under audio_mutex
+	 * and encoded on the audio encode thread */
+	pthread_mutex_t    audio_mutex;
+	size_t             audio_max_buffered;
+	os_sem_t           *audio_sem;
+	pthread_t          audio_thread;
+	bool               audio_thread_active;
+
+	volatile bool      stop_encoding;
+
+	/* encoded packets, consumed by the write thread */
+	struct spsc_ring   video_packets;
+	struct spsc_ring   audio_packets;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -503,18 +532,25 @@ static void ffmpeg_log_callback(void *param, int level, const char *format,
 	UNUSED_PARAMETER(param);
 }
 
+static void ffmpeg_output_get_stats_proc(void *data, calldata_t *cd);
+
 static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct ffmpeg_output *data = bzalloc(sizeof(struct ffmpeg_output));
-	pthread_mutex_init_value(&data->write_mutex);
+	pthread_mutex_init_value(&data->audio_mutex);
 	data->output = output;
 
-	if (pthread_mutex_init(&data->write_mutex, NULL) != 0)
+	if (pthread_mutex_init(&data->audio_mutex, NULL) != 0)
 		goto fail;
 	if (os_event_init(&data->stop_event, OS_EVENT_TYPE_AUTO) != 0)
 		goto fail;
-	if (os_sem_init(&data->write_sem, 0) != 0)
-		goto fail;
+
+	proc_handler_add(obs_output_get_proc_handler(output),
+			"void get_queue_stats(out int video_frames, "
+			"out int max_video_frames, out int video_packets, "
+			"out int max_video_packets, out int audio_packets, "
+			"out int max_audio_packets, out int dropped_frames)",
+			ffmpeg_output_get_stats_proc, data);
 
 	av_log_set_callback(ffmpeg_log_callback);
 
@@ -522,7 +558,7 @@ static void *ffmpeg_output_create(obs_data_t *settings, obs_output_t *output)
 	return data;
 
 fail:
-	pthread_mutex_destroy(&data->write_mutex);
+	pthread_mutex_destroy(&data->audio_mutex);
 	os_event_destroy(data->stop_event);
 	bfree(data);
 	return NULL;
@@ -540,110 +576,330 @@ static void ffmpeg_output_destroy(void *data)
 
 		ffmpeg_output_stop(output);
 
-		pthread_mutex_destroy(&output->write_mutex);
-		os_sem_destroy(output->write_sem);
+		pthread_mutex_destroy(&output->audio_mutex);
 		os_event_destroy(output->stop_event);
 		bfree(data);
 	}
 }
 
-static inline void copy_data(AVPicture *pic, const struct video_data *frame,
-		int height)
+static void ffmpeg_output_get_stats_proc(void *data, calldata_t *cd)
 {
-	for (int plane = 0; plane < MAX_AV_PLANES; plane++) {
-		if (!frame->data[plane])
-			continue;
+	struct ffmpeg_output *output = data;
+
+	calldata_set_int(cd, "video_frames", output->video_slots.count);
+	calldata_set_int(cd, "max_video_frames", output->video_slots.max_count);
+	calldata_set_int(cd, "video_packets", output->video_packets.count);
+	calldata_set_int(cd, "max_video_packets",
+			output->video_packets.max_count);
+	calldata_set_int(cd, "audio_packets", output->audio_packets.count);
+	calldata_set_int(cd, "max_audio_packets",
+			output->audio_packets.max_count);
+	calldata_set_int(cd, "dropped_frames", output->dropped_frames);
+}
+
+static int ffmpeg_output_dropped_frames(void *data)
+{
+	struct ffmpeg_output *output = data;
+	return (int)output->dropped_frames;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void packet_ring_free(struct spsc_ring *ring)
+{
+	AVPacket packet;
+
+	while (spsc_ring_pop(ring, &packet))
+		av_free_packet(&packet);
+
+	spsc_ring_free(ring);
+}
+
+/* called from an encode thread, blocks while the ring is full so that a slow
+ * file or connection holds back the encoders rather than using up memory */
+static void push_packet(struct ffmpeg_output *output,
+		struct spsc_ring *ring, AVPacket *packet)
+{
+	if (!output->write_error)
+		spsc_ring_reserve(ring);
 
-		int frame_rowsize = (int)frame->linesize[plane];
-		int pic_rowsize   = pic->linesize[plane];
-		int bytes = frame_rowsize < pic_rowsize ?
-			frame_rowsize : pic_rowsize;
-		int plane_height = plane == 0 ? height : height/2;
+	if (output->write_error) {
+		av_free_packet(packet);
+		return;
+	}
+
+	*(AVPacket*)spsc_ring_back(ring) = *packet;
+	spsc_ring_commit(ring);
+
+	os_sem_post(output->write_sem);
+}
+
+static void free_queues(struct ffmpeg_output *output)
+{
+	struct spsc_ring *slots = &output->video_slots;
+
+	for (size_t i = 0; i < slots->capacity; i++) {
+		struct video_slot *slot = spsc_ring_at(slots, i);
+		avpicture_free(&slot->picture);
+	}
 
-		for (int y = 0; y < plane_height; y++) {
-			int pos_frame = y * frame_rowsize;
-			int pos_pic   = y * pic_rowsize;
+	spsc_ring_free(slots);
+	packet_ring_free(&output->video_packets);
+	packet_ring_free(&output->audio_packets);
 
-			memcpy(pic->data[plane] + pos_pic,
-			       frame->data[plane] + pos_frame,
-			       bytes);
+	os_sem_destroy(output->write_sem);
+	os_sem_destroy(output->video_sem);
+	os_sem_destroy(output->audio_sem);
+	output->write_sem = NULL;
+	output->video_sem = NULL;
+	output->audio_sem = NULL;
+}
+
+static bool init_queues(struct ffmpeg_output *output)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+
+	output->dropped_frames     = 0;
+	output->audio_max_buffered = 0;
+	output->stop_encoding      = false;
+	output->write_error        = false;
+
+	os_event_reset(output->stop_event);
+
+	if (!spsc_ring_init(&output->video_packets, sizeof(AVPacket),
+				PACKET_QUEUE_SIZE))
+		return false;
+	if (!spsc_ring_init(&output->audio_packets, sizeof(AVPacket),
+				PACKET_QUEUE_SIZE))
+		return false;
+	if (os_sem_init(&output->write_sem, 0) != 0)
+		return false;
+	if (os_sem_init(&output->video_sem, 0) != 0)
+		return false;
+	if (os_sem_init(&output->audio_sem, 0) != 0)
+		return false;
+
+	if (!data->video)
+		return true;
+
+	if (!spsc_ring_init(&output->video_slots, sizeof(struct video_slot),
+				VIDEO_QUEUE_SIZE))
+		return false;
+
+	for (size_t i = 0; i < VIDEO_QUEUE_SIZE; i++) {
+		struct video_slot *slot = spsc_ring_at(&output->video_slots, i);
+		int ret = avpicture_alloc(&slot->picture,
+				data->config.format,
+				data->config.width, data->config.height);
+		if (ret < 0) {
+			blog(LOG_WARNING, "Failed to allocate video queue: %s",
+					av_err2str(ret));
+			return false;
 		}
 	}
+
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void copy_data(AVPicture *pic, const struct video_data *frame,
+		enum AVPixelFormat format, int width, int height)
+{
+	const uint8_t *src[4];
+	int           src_linesize[4];
+
+	for (int plane = 0; plane < 4; plane++) {
+		src[plane]          = frame->data[plane];
+		src_linesize[plane] = (int)frame->linesize[plane];
+	}
+
+	av_image_copy(pic->data, pic->linesize, src, src_linesize,
+			format, width, height);
 }
 
+/* only copies the frame, so the video thread never waits on the encoder */
 static void receive_video(void *param, struct video_data *frame)
 {
 	struct ffmpeg_output *output = param;
 	struct ffmpeg_data   *data   = &output->ff_data;
+	struct video_slot    *slot;
 
 	// codec doesn't support video or none configured
 	if (!data->video)
 		return;
 
-	AVCodecContext *context = data->video->codec;
+	if (!spsc_ring_try_reserve(&output->video_slots)) {
+		if (output->dropped_frames++ == 0)
+			blog(LOG_WARNING, "receive_video: Encoder cannot keep "
+			                  "up, dropping frames");
+		return;
+	}
+
+	if (!data->start_timestamp)
+		data->start_timestamp = frame->timestamp;
+
+	slot = spsc_ring_back(&output->video_slots);
+	copy_data(&slot->picture, frame, data->config.format,
+			data->config.width, data->config.height);
+	slot->timestamp = frame->timestamp;
+
+	spsc_ring_commit(&output->video_slots);
+	os_sem_post(output->video_sem);
+}
+
+static void push_video_packet(struct ffmpeg_output *output,
+		AVCodecContext *context, AVPacket *packet)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+
+	packet->pts = rescale_ts(packet->pts, context, data->video->time_base);
+	packet->dts = rescale_ts(packet->dts, context, data->video->time_base);
+	packet->duration = (int)av_rescale_q(packet->duration,
+			context->time_base, data->video->time_base);
+
+	push_packet(output, &output->video_packets, packet);
+}
+
+static void encode_video(struct ffmpeg_output *output,
+		struct video_slot *slot)
+{
+	struct ffmpeg_data *data    = &output->ff_data;
+	AVCodecContext     *context = data->video->codec;
+	AVPicture          *picture = &slot->picture;
 	AVPacket packet = {0};
 	int ret = 0, got_packet;
 
 	av_init_packet(&packet);
 
-	if (!data->start_timestamp)
-		data->start_timestamp = frame->timestamp;
-
-	if (!!data->swscale)
-		sws_scale(data->swscale, (const uint8_t *const *)frame->data,
-				(const int*)frame->linesize,
+	if (!!data->swscale) {
+		sws_scale(data->swscale,
+				(const uint8_t *const *)slot->picture.data,
+				slot->picture.linesize,
 				0, data->config.height, data->dst_picture.data,
 				data->dst_picture.linesize);
-	else
-		copy_data(&data->dst_picture, frame, context->height);
+		picture = &data->dst_picture;
+	}
 
 	if (data->output->flags & AVFMT_RAWPICTURE) {
+		if (picture != &data->dst_picture)
+			av_picture_copy(&data->dst_picture, picture,
+					context->pix_fmt,
+					context->width, context->height);
+
 		packet.flags        |= AV_PKT_FLAG_KEY;
 		packet.stream_index  = data->video->index;
 		packet.data          = data->dst_picture.data[0];
 		packet.size          = sizeof(AVPicture);
 
-		pthread_mutex_lock(&output->write_mutex);
-		da_push_back(output->packets, &packet);
-		pthread_mutex_unlock(&output->write_mutex);
-		os_sem_post(output->write_sem);
+		push_packet(output, &output->video_packets, &packet);
 
 	} else {
-		data->vframe->pts = data->total_frames;
+		/* frames can be dropped before they get here, so the pts
+		 * comes from the timestamp rather than the frame count */
+		*((AVPicture*)data->vframe) = *picture;
+		data->vframe->pts = av_rescale_q(
+				(int64_t)(slot->timestamp -
+					data->start_timestamp),
+				(AVRational){1, 1000000000},
+				context->time_base);
+
 		ret = avcodec_encode_video2(context, &packet, data->vframe,
 				&got_packet);
 		if (ret < 0) {
-			blog(LOG_WARNING, "receive_video: Error encoding "
+			blog(LOG_WARNING, "encode_video: Error encoding "
 			                  "video: %s", av_err2str(ret));
 			return;
 		}
 
 		if (!ret && got_packet && packet.size) {
-			packet.pts = rescale_ts(packet.pts, context,
-					data->video->time_base);
-			packet.dts = rescale_ts(packet.dts, context,
-					data->video->time_base);
-			packet.duration = (int)av_rescale_q(packet.duration,
-					context->time_base,
-					data->video->time_base);
-
-			pthread_mutex_lock(&output->write_mutex);
-			da_push_back(output->packets, &packet);
-			pthread_mutex_unlock(&output->write_mutex);
-			os_sem_post(output->write_sem);
+			push_video_packet(output, context, &packet);
 		} else {
 			ret = 0;
 		}
 	}
 
 	if (ret != 0) {
-		blog(LOG_WARNING, "receive_video: Error writing video: %s",
+		blog(LOG_WARNING, "encode_video: Error writing video: %s",
 				av_err2str(ret));
 	}
 
 	data->total_frames++;
 }
 
+/* encoders with a delay (B-frames, lookahead) hold on to frames until they
+ * are given NULL frames, so they are drained here before the encode thread
+ * exits, while the write thread is still running */
+static void flush_video(struct ffmpeg_output *output)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+	AVCodecContext     *context;
+
+	if (!data->video || output->write_error)
+		return;
+	if (data->output->flags & AVFMT_RAWPICTURE)
+		return;
+
+	context = data->video->codec;
+	if ((context->codec->capabilities & CODEC_CAP_DELAY) == 0)
+		return;
+
+	for (;;) {
+		AVPacket packet = {0};
+		int ret, got_packet;
+
+		av_init_packet(&packet);
+
+		ret = avcodec_encode_video2(context, &packet, NULL,
+				&got_packet);
+		if (ret < 0) {
+			blog(LOG_WARNING, "flush_video: Error flushing "
+			                  "video: %s", av_err2str(ret));
+			break;
+		}
+
+		if (!got_packet)
+			break;
+
+		push_video_packet(output, context, &packet);
+	}
+}
+
+static void *video_thread(void *param)
+{
+	struct ffmpeg_output *output = param;
+
+	os_set_thread_name("ffmpeg output: video encode");
+
+	while (os_sem_wait(output->video_sem) == 0) {
+		if (!spsc_ring_count(&output->video_slots)) {
+			if (output->stop_encoding)
+				break;
+			continue;
+		}
+
+		encode_video(output, spsc_ring_front(&output->video_slots));
+		spsc_ring_pop_front(&output->video_slots);
+	}
+
+	flush_video(output);
+	return NULL;
+}
+
+static void push_audio_packet(struct ffmpeg_output *output,
+		AVCodecContext *context, AVPacket *packet)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+
+	packet->pts = rescale_ts(packet->pts, context, data->audio->time_base);
+	packet->dts = rescale_ts(packet->dts, context, data->audio->time_base);
+	packet->duration = (int)av_rescale_q(packet->duration,
+			context->time_base, data->audio->time_base);
+	packet->stream_index = data->audio->index;
+
+	push_packet(output, &output->audio_packets, packet);
+}
+
 static void encode_audio(struct ffmpeg_output *output,
 		struct AVCodecContext *context, size_t block_size)
 {
@@ -680,16 +936,38 @@ static void encode_audio(struct ffmpeg_output *output,
 	if (!got_packet)
 		return;
 
-	packet.pts = rescale_ts(packet.pts, context, data->audio->time_base);
-	packet.dts = rescale_ts(packet.dts, context, data->audio->time_base);
-	packet.duration = (int)av_rescale_q(packet.duration, context->time_base,
-			data->audio->time_base);
-	packet.stream_index = data->audio->index;
+	push_audio_packet(output, context, &packet);
+}
 
-	pthread_mutex_lock(&output->write_mutex);
-	da_push_back(output->packets, &packet);
-	pthread_mutex_unlock(&output->write_mutex);
-	os_sem_post(output->write_sem);
+static void flush_audio(struct ffmpeg_output *output)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+	AVCodecContext     *context;
+
+	if (!data->audio || output->write_error)
+		return;
+
+	context = data->audio->codec;
+	if ((context->codec->capabilities & CODEC_CAP_DELAY) == 0)
+		return;
+
+	for (;;) {
+		AVPacket packet = {0};
+		int ret, got_packet;
+
+		ret = avcodec_encode_audio2(context, &packet, NULL,
+				&got_packet);
+		if (ret < 0) {
+			blog(LOG_WARNING, "flush_audio: Error flushing "
+			                  "audio: %s", av_err2str(ret));
+			break;
+		}
+
+		if (!got_packet)
+			break;
+
+		push_audio_packet(output, context, &packet);
+	}
 }
 
 static bool prepare_audio(struct ffmpeg_data *data,
@@ -718,65 +996,105 @@ static bool prepare_audio(struct ffmpeg_data *data,
 	return true;
 }
 
+/* only buffers the audio, it is encoded on the audio encode thread */
 static void receive_audio(void *param, struct audio_data *frame)
 {
 	struct ffmpeg_output *output = param;
 	struct ffmpeg_data   *data   = &output->ff_data;
-	size_t frame_size_bytes;
 	struct audio_data in;
 
 	// codec doesn't support audio or none configured
 	if (!data->audio)
 		return;
 
-	AVCodecContext *context = data->audio->codec;
-
 	if (!data->start_timestamp)
 		return;
 	if (!prepare_audio(data, frame, &in))
 		return;
 
-	frame_size_bytes = (size_t)data->frame_size * data->audio_size;
+	pthread_mutex_lock(&output->audio_mutex);
 
 	for (size_t i = 0; i < data->audio_planes; i++)
 		circlebuf_push_back(&data->excess_frames[i], in.data[i],
 				in.frames * data->audio_size);
 
-	while (data->excess_frames[0].size >= frame_size_bytes) {
+	if (data->excess_frames[0].size > output->audio_max_buffered)
+		output->audio_max_buffered = data->excess_frames[0].size;
+
+	pthread_mutex_unlock(&output->audio_mutex);
+
+	os_sem_post(output->audio_sem);
+}
+
+static bool pop_audio_frame(struct ffmpeg_output *output)
+{
+	struct ffmpeg_data *data = &output->ff_data;
+	size_t frame_size_bytes = (size_t)data->frame_size * data->audio_size;
+	bool   success = false;
+
+	pthread_mutex_lock(&output->audio_mutex);
+
+	if (data->excess_frames[0].size >= frame_size_bytes) {
 		for (size_t i = 0; i < data->audio_planes; i++)
 			circlebuf_pop_front(&data->excess_frames[i],
 					data->samples[i], frame_size_bytes);
-
-		encode_audio(output, context, data->audio_size);
+		success = true;
 	}
+
+	pthread_mutex_unlock(&output->audio_mutex);
+	return success;
 }
 
-static bool process_packet(struct ffmpeg_output *output)
+static void *audio_thread(void *param)
 {
-	AVPacket packet;
-	bool new_packet = false;
-	int ret;
+	struct ffmpeg_output *output = param;
+	struct ffmpeg_data   *data   = &output->ff_data;
+
+	os_set_thread_name("ffmpeg output: audio encode");
 
-	pthread_mutex_lock(&output->write_mutex);
-	if (output->packets.num) {
-		packet = output->packets.array[0];
-		da_erase(output->packets, 0);
-		new_packet = true;
+	while (os_sem_wait(output->audio_sem) == 0) {
+		while (pop_audio_frame(output))
+			encode_audio(output, data->audio->codec,
+					data->audio_size);
+
+		if (output->stop_encoding)
+			break;
 	}
-	pthread_mutex_unlock(&output->write_mutex);
 
-	if (!new_packet)
-		return true;
+	flush_audio(output);
+	return NULL;
+}
 
-	/*blog(LOG_DEBUG, "size = %d, flags = %lX, stream = %d, "
-			"packets queued: %lu",
-			packet.size, packet.flags,
-			packet.stream_index, output->packets.num);*/
+/* takes the earliest of the queued video and audio packets, which keeps the
+ * interleaving work in av_interleaved_write_frame to a minimum */
+static bool get_next_packet(struct ffmpeg_output *output, AVPacket *packet)
+{
+	struct ffmpeg_data *data  = &output->ff_data;
+	struct spsc_ring   *video = &output->video_packets;
+	struct spsc_ring   *audio = &output->audio_packets;
+
+	if (spsc_ring_count(video) && spsc_ring_count(audio)) {
+		AVPacket *v = spsc_ring_front(video);
+		AVPacket *a = spsc_ring_front(audio);
+
+		if (av_compare_ts(v->dts, data->video->time_base,
+		                  a->dts, data->audio->time_base) <= 0)
+			return spsc_ring_pop(video, packet);
+		else
+			return spsc_ring_pop(audio, packet);
+	}
 
-	ret = av_interleaved_write_frame(output->ff_data.output, &packet);
+	return spsc_ring_pop(video, packet) || spsc_ring_pop(audio, packet);
+}
+
+static bool process_packet(struct ffmpeg_output *output, AVPacket *packet)
+{
+	int ret;
+
+	ret = av_interleaved_write_frame(output->ff_data.output, packet);
 	if (ret < 0) {
-		av_free_packet(&packet);
-		blog(LOG_WARNING, "receive_audio: Error writing packet: %s",
+		av_free_packet(packet);
+		blog(LOG_WARNING, "process_packet: Error writing packet: %s",
 				av_err2str(ret));
 		return false;
 	}
@@ -788,12 +1106,26 @@ static void *write_thread(void *data)
 {
 	struct ffmpeg_output *output = data;
 
+	os_set_thread_name("ffmpeg output: write");
+
 	while (os_sem_wait(output->write_sem) == 0) {
-		/* check to see if shutting down */
-		if (os_event_try(output->stop_event) == 0)
-			break;
+		AVPacket packet;
+
+		/* the encoders are stopped before the write thread, so
+		 * everything queued is written before shutting down */
+		if (!get_next_packet(output, &packet)) {
+			if (os_event_try(output->stop_event) == 0)
+				break;
+			continue;
+		}
+
+		if (!process_packet(output, &packet)) {
+			/* wake up any encoder waiting for queue space, they
+			 * drop their packets from now on */
+			output->write_error = true;
+			os_sem_post(output->video_packets.free_sem);
+			os_sem_post(output->audio_packets.free_sem);
 
-		if (!process_packet(output)) {
 			pthread_detach(output->write_thread);
 			output->write_thread_active = false;
 
@@ -870,6 +1202,11 @@ static bool try_connect(struct ffmpeg_output *output)
 	if (!obs_output_can_begin_data_capture(output->output, 0))
 		return false;
 
+	if (!init_queues(output)) {
+		ffmpeg_output_stop(output);
+		return false;
+	}
+
 	ret = pthread_create(&output->write_thread, NULL, write_thread, output);
 	if (ret != 0) {
 		blog(LOG_WARNING, "ffmpeg_output_start: failed to create write "
@@ -878,10 +1215,31 @@ static bool try_connect(struct ffmpeg_output *output)
 		return false;
 	}
 
+	output->write_thread_active = true;
+
+	ret = pthread_create(&output->video_thread, NULL, video_thread, output);
+	if (ret != 0) {
+		blog(LOG_WARNING, "ffmpeg_output_start: failed to create video "
+		                  "encode thread.");
+		ffmpeg_output_stop(output);
+		return false;
+	}
+
+	output->video_thread_active = true;
+
+	ret = pthread_create(&output->audio_thread, NULL, audio_thread, output);
+	if (ret != 0) {
+		blog(LOG_WARNING, "ffmpeg_output_start: failed to create audio "
+		                  "encode thread.");
+		ffmpeg_output_stop(output);
+		return false;
+	}
+
+	output->audio_thread_active = true;
+
 	obs_output_set_video_conversion(output->output, NULL);
 	obs_output_set_audio_conversion(output->output, &aci);
 	obs_output_begin_data_capture(output->output, 0);
-	output->write_thread_active = true;
 	return true;
 }
 
@@ -916,6 +1274,22 @@ static void ffmpeg_output_stop(void *data)
 	if (output->active) {
 		obs_output_end_data_capture(output->output);
 
+		/* the encoders finish what is queued before exiting, and the
+		 * write thread is stopped last so that it writes it all */
+		output->stop_encoding = true;
+
+		if (output->video_thread_active) {
+			os_sem_post(output->video_sem);
+			pthread_join(output->video_thread, NULL);
+			output->video_thread_active = false;
+		}
+
+		if (output->audio_thread_active) {
+			os_sem_post(output->audio_sem);
+			pthread_join(output->audio_thread, NULL);
+			output->audio_thread_active = false;
+		}
+
 		if (output->write_thread_active) {
 			os_event_signal(output->stop_event);
 			os_sem_post(output->write_sem);
@@ -923,14 +1297,17 @@ static void ffmpeg_output_stop(void *data)
 			output->write_thread_active = false;
 		}
 
-		pthread_mutex_lock(&output->write_mutex);
-
-		for (size_t i = 0; i < output->packets.num; i++)
-			av_free_packet(output->packets.array+i);
-		da_free(output->packets);
-
-		pthread_mutex_unlock(&output->write_mutex);
-
+		blog(LOG_INFO, "ffmpeg output: max queued video frames: %ld, "
+		               "max queued packets: %ld video, %ld audio, "
+		               "max buffered audio: %d bytes, "
+		               "dropped frames: %ld",
+		               output->video_slots.max_count,
+		               output->video_packets.max_count,
+		               output->audio_packets.max_count,
+		               (int)output->audio_max_buffered,
+		               output->dropped_frames);
+
+		free_queues(output);
 		ffmpeg_data_free(&output->ff_data);
 	}
 }
@@ -945,4 +1322,5 @@ struct obs_output_info ffmpeg_output = {
 	.stop      = ffmpeg_output_stop,
 	.raw_video = receive_video,
 	.raw_audio = receive_audio,
+	.get_dropped_frames = ffmpeg_output_dropped_frames,
 };
@@ -1,4 +1,5 @@
 #include <obs-module.h>
+#include <util/platform.h>
 #include <graphics/vec4.h>
 
 #define SETTING_COLOR                  "color"
@@ -22,6 +23,7 @@ struct color_filter_data {
 	obs_source_t                   *context;
 
 	gs_effect_t                    *effect;
+	char                           *pixel_shader;
 
 	gs_eparam_t                    *color_param;
 	gs_eparam_t                    *contrast_param;
@@ -76,6 +78,7 @@ static void color_filter_destroy(void *data)
 		obs_leave_graphics();
 	}
 
+	bfree(filter->pixel_shader);
 	bfree(data);
 }
 
@@ -83,13 +86,20 @@ static void *color_filter_create(obs_data_t *settings, obs_source_t *context)
 {
 	struct color_filter_data *filter =
 		bzalloc(sizeof(struct color_filter_data));
-	char *effect_path = obs_module_file("color_filter.effect");
+	char *effect_path = obs_module_file("color_filter_pixel.effect");
 
 	filter->context = context;
 
+	/* the regular effect is generated from the same per-pixel shader
+	 * that is used when the filter is combined with other filters */
+	if (effect_path)
+		filter->pixel_shader = os_quick_read_utf8_file(effect_path);
+	bfree(effect_path);
+
 	obs_enter_graphics();
 
-	filter->effect = gs_effect_create_from_file(effect_path, NULL);
+	filter->effect = obs_filter_create_pixel_shader_effect(
+			filter->pixel_shader, obs_source_get_name(context));
 	if (filter) {
 		filter->color_param = gs_effect_get_param_by_name(
 				filter->effect, "color");
@@ -103,8 +113,6 @@ static void *color_filter_create(obs_data_t *settings, obs_source_t *context)
 
 	obs_leave_graphics();
 
-	bfree(effect_path);
-
 	if (!filter->effect) {
 		color_filter_destroy(filter);
 		return NULL;
@@ -131,6 +139,27 @@ static void color_filter_render(void *data, gs_effect_t *effect)
 	UNUSED_PARAMETER(effect);
 }
 
+static const char *color_filter_get_pixel_shader(void *data)
+{
+	struct color_filter_data *filter = data;
+	return filter->pixel_shader;
+}
+
+static void color_filter_set_pixel_shader_params(void *data, gs_effect_t *effect,
+		const char *prefix)
+{
+	struct color_filter_data *filter = data;
+
+	gs_effect_set_vec4(obs_filter_get_pixel_shader_param(effect, prefix,
+			"color"), &filter->color);
+	gs_effect_set_float(obs_filter_get_pixel_shader_param(effect, prefix,
+			"contrast"), filter->contrast);
+	gs_effect_set_float(obs_filter_get_pixel_shader_param(effect, prefix,
+			"brightness"), filter->brightness);
+	gs_effect_set_float(obs_filter_get_pixel_shader_param(effect, prefix,
+			"gamma"), filter->gamma);
+}
+
 static obs_properties_t *color_filter_properties(void *data)
 {
 	obs_properties_t *props = obs_properties_create();
@@ -161,11 +190,14 @@ static void color_filter_defaults(obs_data_t *settings)
 struct obs_source_info color_filter = {
 	.id                            = "color_filter",
 	.type                          = OBS_SOURCE_TYPE_FILTER,
-	.output_flags                  = OBS_SOURCE_VIDEO,
+	.output_flags                  = OBS_SOURCE_VIDEO |
+	                                 OBS_SOURCE_STATIC_VIDEO,
 	.get_name                      = color_filter_name,
 	.create                        = color_filter_create,
 	.destroy                       = color_filter_destroy,
 	.video_render                  = color_filter_render,
+	.get_pixel_shader              = color_filter_get_pixel_shader,
+	.set_pixel_shader_params       = color_filter_set_pixel_shader_params,
 	.update                        = color_filter_update,
 	.get_properties                = color_filter_properties,
 	.get_defaults                  = color_filter_defaults
@@ -1,4 +1,5 @@
 #include <obs-module.h>
+#include <util/platform.h>
 #include <graphics/matrix4.h>
 #include <graphics/vec2.h>
 #include <graphics/vec4.h>
@@ -25,6 +26,7 @@ struct color_key_filter_data {
 	obs_source_t                   *context;
 
 	gs_effect_t                    *effect;
+	char                           *pixel_shader;
 
 	gs_eparam_t                    *color_param;
 	gs_eparam_t                    *contrast_param;
@@ -117,6 +119,7 @@ static void color_key_destroy(void *data)
 		obs_leave_graphics();
 	}
 
+	bfree(filter->pixel_shader);
 	bfree(data);
 }
 
@@ -124,13 +127,20 @@ static void *color_key_create(obs_data_t *settings, obs_source_t *context)
 {
 	struct color_key_filter_data *filter =
 		bzalloc(sizeof(struct color_key_filter_data));
-	char *effect_path = obs_module_file("color_key_filter.effect");
+	char *effect_path = obs_module_file("color_key_filter_pixel.effect");
 
 	filter->context = context;
 
+	/* the regular effect is generated from the same per-pixel shader
+	 * that is used when the filter is combined with other filters */
+	if (effect_path)
+		filter->pixel_shader = os_quick_read_utf8_file(effect_path);
+	bfree(effect_path);
+
 	obs_enter_graphics();
 
-	filter->effect = gs_effect_create_from_file(effect_path, NULL);
+	filter->effect = obs_filter_create_pixel_shader_effect(
+			filter->pixel_shader, obs_source_get_name(context));
 	if (filter) {
 		filter->color_param = gs_effect_get_param_by_name(
 				filter->effect, "color");
@@ -150,8 +160,6 @@ static void *color_key_create(obs_data_t *settings, obs_source_t *context)
 
 	obs_leave_graphics();
 
-	bfree(effect_path);
-
 	if (!filter->effect) {
 		color_key_destroy(filter);
 		return NULL;
@@ -181,6 +189,33 @@ static void color_key_render(void *data, gs_effect_t *effect)
 	UNUSED_PARAMETER(effect);
 }
 
+static const char *color_key_get_pixel_shader(void *data)
+{
+	struct color_key_filter_data *filter = data;
+	return filter->pixel_shader;
+}
+
+static void color_key_set_pixel_shader_params(void *data, gs_effect_t *effect,
+		const char *prefix)
+{
+	struct color_key_filter_data *filter = data;
+
+	gs_effect_set_vec4(obs_filter_get_pixel_shader_param(effect, prefix,
+			"color"), &filter->color);
+	gs_effect_set_float(obs_filter_get_pixel_shader_param(effect, prefix,
+			"contrast"), filter->contrast);
+	gs_effect_set_float(obs_filter_get_pixel_shader_param(effect, prefix,
+			"brightness"), filter->brightness);
+	gs_effect_set_float(obs_filter_get_pixel_shader_param(effect, prefix,
+			"gamma"), filter->gamma);
+	gs_effect_set_vec4(obs_filter_get_pixel_shader_param(effect, prefix,
+			"key_color"), &filter->key_color);
+	gs_effect_set_float(obs_filter_get_pixel_shader_param(effect, prefix,
+			"similarity"), filter->similarity);
+	gs_effect_set_float(obs_filter_get_pixel_shader_param(effect, prefix,
+			"smoothness"), filter->smoothness);
+}
+
 static bool key_type_changed(obs_properties_t *props, obs_property_t *p,
 		obs_data_t *settings)
 {
@@ -243,11 +278,14 @@ static void color_key_defaults(obs_data_t *settings)
 struct obs_source_info color_key_filter = {
 	.id                            = "color_key_filter",
 	.type                          = OBS_SOURCE_TYPE_FILTER,
-	.output_flags                  = OBS_SOURCE_VIDEO,
+	.output_flags                  = OBS_SOURCE_VIDEO |
+	                                 OBS_SOURCE_STATIC_VIDEO,
 	.get_name                      = color_key_name,
 	.create                        = color_key_create,
 	.destroy                       = color_key_destroy,
 	.video_render                  = color_key_render,
+	.get_pixel_shader              = color_key_get_pixel_shader,
+	.set_pixel_shader_params       = color_key_set_pixel_shader_params,
 	.update                        = color_key_update,
 	.get_properties                = color_key_properties,
 	.get_defaults                  = color_key_defaults
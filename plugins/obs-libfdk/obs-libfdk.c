@@ -197,6 +197,33 @@ static void libfdk_destroy(void *data)
 	blog(LOG_INFO, "libfdk_aac encoder destroyed");
 }
 
+/* libfdk reinitializes itself on the next encode call when parameters of an
+ * open encoder are changed; the AudioSpecificConfig does not depend on the
+ * bitrate, so the extra data stays valid */
+static bool libfdk_update(void *data, obs_data_t *settings)
+{
+	libfdk_encoder_t *enc = data;
+	int bitrate = (int)obs_data_get_int(settings, "bitrate") * 1000;
+	int afterburner = obs_data_get_bool(settings, "afterburner") ? 1 : 0;
+	AACENC_ERROR err;
+
+	if (!bitrate) {
+		blog(LOG_ERROR, "Invalid bitrate");
+		return false;
+	}
+
+	CHECK_LIBFDK(aacEncoder_SetParam(enc->fdkhandle, AACENC_BITRATE, bitrate));
+	CHECK_LIBFDK(aacEncoder_SetParam(enc->fdkhandle, AACENC_AFTERBURNER,
+	                                 afterburner));
+
+	blog(LOG_INFO, "libfdk_aac bitrate changed to %d", bitrate / 1000);
+	return true;
+
+fail:
+	blog(LOG_WARNING, "libfdk_aac encoder update failed");
+	return false;
+}
+
 static bool libfdk_encode(void *data, struct encoder_frame *frame,
                           struct encoder_packet *packet, bool *received_packet)
 {
@@ -294,6 +321,7 @@ struct obs_encoder_info obs_libfdk_encoder = {
 	.create         = libfdk_create,
 	.destroy        = libfdk_destroy,
 	.encode         = libfdk_encode,
+	.update         = libfdk_update,
 	.get_frame_size = libfdk_frame_size,
 	.get_defaults   = libfdk_defaults,
 	.get_properties = libfdk_properties,
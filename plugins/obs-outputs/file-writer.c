@@ -0,0 +1,443 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#ifdef __linux__
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <util/spsc-ring.h>
+#include <util/dstr.h>
+#include "file-writer.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#define do_log(level, format, ...) \
+	blog(level, "[file writer: '%s'] " format, fw->path.array, \
+			##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+/* O_DIRECT requires the buffer address, the write size and the file offset
+ * to be aligned to the logical block size of the device, 4096 covers the
+ * block sizes in use */
+#define ALIGNMENT           4096
+#define DEFAULT_BUFFER_SIZE (1024 * 1024)
+#define DEFAULT_QUEUE_SIZE  8192
+
+struct file_writer {
+	struct dstr           path;
+	file_writer_mux_t     mux;
+	void                  *param;
+
+#ifdef _WIN32
+	FILE                  *file;
+#else
+	int                   fd;
+#endif
+	bool                  direct_io;
+	bool                  drop_cache;
+	uint64_t              preallocate_size;
+	uint64_t              preallocated;
+
+	/* packets queued by the encoder thread, used_sem wakes the writer */
+	struct spsc_ring      queue;
+	os_sem_t              *used_sem;
+	volatile bool         stop;
+
+	pthread_t             thread;
+	bool                  thread_created;
+
+	/* coalescing buffer, only used by the writer thread */
+	uint8_t               *buffer_alloc;
+	uint8_t               *buffer;
+	size_t                buffer_size;
+	size_t                buffer_used;
+	uint64_t              offset;
+
+	/* statistics */
+	uint64_t              num_writes;
+	uint64_t              total_write_ns;
+	uint64_t              max_write_ns;
+	bool                  warned_full;
+	volatile bool         error;
+};
+
+/* ------------------------------------------------------------------------- */
+/* File access */
+
+#ifdef _WIN32
+
+static bool open_file(struct file_writer *fw)
+{
+	fw->file       = os_fopen(fw->path.array, "wb");
+	fw->direct_io  = false;
+	fw->drop_cache = false;
+	return fw->file != NULL;
+}
+
+static bool write_data(struct file_writer *fw, const uint8_t *data,
+		size_t size)
+{
+	return fwrite(data, 1, size, fw->file) == size;
+}
+
+static void close_file(struct file_writer *fw)
+{
+	if (fw->file)
+		fclose(fw->file);
+}
+
+#else
+
+static bool open_file(struct file_writer *fw)
+{
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+#ifdef O_DIRECT
+	if (fw->direct_io) {
+		fw->fd = open(fw->path.array, flags | O_DIRECT, 0644);
+		if (fw->fd != -1)
+			return true;
+
+		/* not every file system supports direct I/O */
+		info("Direct I/O not supported (%d), using buffered I/O",
+				errno);
+	}
+#endif
+	fw->direct_io = false;
+	fw->fd = open(fw->path.array, flags, 0644);
+	return fw->fd != -1;
+}
+
+static void preallocate(struct file_writer *fw, uint64_t end)
+{
+#ifdef __linux__
+	/* FALLOC_FL_KEEP_SIZE keeps the file size at the written data, the
+	 * excess is released by the truncate when the file is closed */
+	while (fw->preallocated < end) {
+		if (fallocate(fw->fd, FALLOC_FL_KEEP_SIZE,
+					(off_t)fw->preallocated,
+					(off_t)fw->preallocate_size) != 0) {
+			info("Preallocation failed (%d), disabling", errno);
+			fw->preallocate_size = 0;
+			return;
+		}
+
+		fw->preallocated += fw->preallocate_size;
+	}
+#else
+	UNUSED_PARAMETER(end);
+	fw->preallocate_size = 0;
+#endif
+}
+
+static void drop_cache(struct file_writer *fw, uint64_t offset, size_t size)
+{
+#ifdef __linux__
+	/* only clean pages can be dropped, so write the range back first */
+	sync_file_range(fw->fd, (off64_t)offset, (off64_t)size,
+			SYNC_FILE_RANGE_WAIT_BEFORE |
+			SYNC_FILE_RANGE_WRITE |
+			SYNC_FILE_RANGE_WAIT_AFTER);
+	posix_fadvise(fw->fd, (off_t)offset, (off_t)size,
+			POSIX_FADV_DONTNEED);
+#else
+	UNUSED_PARAMETER(fw);
+	UNUSED_PARAMETER(offset);
+	UNUSED_PARAMETER(size);
+#endif
+}
+
+static bool write_data(struct file_writer *fw, const uint8_t *data,
+		size_t size)
+{
+	uint64_t offset = fw->offset;
+
+	if (fw->preallocate_size)
+		preallocate(fw, offset + size);
+
+	while (size) {
+		ssize_t ret = pwrite(fw->fd, data, size, (off_t)offset);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+
+		data   += ret;
+		size   -= (size_t)ret;
+		offset += (uint64_t)ret;
+	}
+
+	if (fw->drop_cache && !fw->direct_io)
+		drop_cache(fw, fw->offset, (size_t)(offset - fw->offset));
+	return true;
+}
+
+static void close_file(struct file_writer *fw)
+{
+	if (fw->fd == -1)
+		return;
+
+	/* removes the padding of the last direct write and any preallocated
+	 * space past the end of the data */
+	if ((fw->direct_io || fw->preallocated) &&
+	    ftruncate(fw->fd, (off_t)fw->offset) != 0)
+		warn("Failed to truncate file (%d)", errno);
+
+	close(fw->fd);
+	fw->fd = -1;
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+/* Writer thread */
+
+/* when partial is set, the data stays readable in the file but the buffer
+ * keeps its unfinished last block for direct I/O, so that the next write
+ * starts at an aligned offset again */
+static void flush_buffer(struct file_writer *fw, bool partial)
+{
+	size_t   size = fw->buffer_used;
+	size_t   keep = 0;
+	uint64_t start, elapsed;
+
+	if (!size)
+		return;
+
+	/* direct writes must be whole blocks, the padding is written over by
+	 * the next write or truncated when the file is closed */
+	if (fw->direct_io && (size & (ALIGNMENT - 1))) {
+		size_t padded = (size + ALIGNMENT - 1) &
+			~(size_t)(ALIGNMENT - 1);
+		memset(fw->buffer + size, 0, padded - size);
+		size = padded;
+
+		if (partial)
+			keep = fw->buffer_used & (ALIGNMENT - 1);
+	}
+
+	start = os_gettime_ns();
+
+	if (!fw->error && !write_data(fw, fw->buffer, size)) {
+		warn("Write failed (%d), data is being discarded", errno);
+		fw->error = true;
+	}
+
+	elapsed = os_gettime_ns() - start;
+
+	fw->num_writes++;
+	fw->total_write_ns += elapsed;
+	if (elapsed > fw->max_write_ns)
+		fw->max_write_ns = elapsed;
+
+	fw->offset += fw->buffer_used - keep;
+	if (keep)
+		memmove(fw->buffer, fw->buffer + fw->buffer_used - keep, keep);
+	fw->buffer_used = keep;
+}
+
+void file_writer_write(file_writer_t *fw, const void *data, size_t size)
+{
+	const uint8_t *src = data;
+
+	while (size) {
+		size_t copy = fw->buffer_size - fw->buffer_used;
+		if (copy > size)
+			copy = size;
+
+		memcpy(fw->buffer + fw->buffer_used, src, copy);
+		fw->buffer_used += copy;
+		src  += copy;
+		size -= copy;
+
+		if (fw->buffer_used == fw->buffer_size)
+			flush_buffer(fw, false);
+	}
+}
+
+void file_writer_flush(file_writer_t *fw)
+{
+	flush_buffer(fw, true);
+}
+
+static void *writer_thread(void *data)
+{
+	struct file_writer *fw = data;
+
+	os_set_thread_name("file writer");
+
+	while (os_sem_wait(fw->used_sem) == 0) {
+		struct encoder_packet packet;
+
+		if (!spsc_ring_pop(&fw->queue, &packet)) {
+			if (fw->stop)
+				break;
+			continue;
+		}
+
+		fw->mux(fw->param, fw, &packet);
+		obs_encoder_packet_release(&packet);
+	}
+
+	fw->mux(fw->param, fw, NULL);
+	flush_buffer(fw, false);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void file_writer_push(file_writer_t *fw, struct encoder_packet *packet)
+{
+	if (!fw) {
+		obs_encoder_packet_release(packet);
+		return;
+	}
+
+	if (spsc_ring_full(&fw->queue) && !fw->warned_full) {
+		warn("Write queue is full, the disk cannot keep up");
+		fw->warned_full = true;
+	}
+
+	if (!spsc_ring_reserve(&fw->queue)) {
+		obs_encoder_packet_release(packet);
+		return;
+	}
+
+	*(struct encoder_packet*)spsc_ring_back(&fw->queue) = *packet;
+	spsc_ring_commit(&fw->queue);
+
+	os_sem_post(fw->used_sem);
+}
+
+static void file_writer_free(struct file_writer *fw)
+{
+	struct encoder_packet packet;
+
+	while (spsc_ring_pop(&fw->queue, &packet))
+		obs_encoder_packet_release(&packet);
+
+	close_file(fw);
+	spsc_ring_free(&fw->queue);
+	os_sem_destroy(fw->used_sem);
+	bfree(fw->buffer_alloc);
+	dstr_free(&fw->path);
+	bfree(fw);
+}
+
+file_writer_t *file_writer_create(const char *path,
+		const struct file_writer_options *options,
+		file_writer_mux_t mux, void *param)
+{
+	struct file_writer *fw = bzalloc(sizeof(struct file_writer));
+	size_t buffer_size = options->buffer_size ?
+		options->buffer_size : DEFAULT_BUFFER_SIZE;
+	size_t queue_size;
+
+	dstr_copy(&fw->path, path);
+	fw->mux              = mux;
+	fw->param            = param;
+	fw->direct_io        = options->direct_io;
+	fw->drop_cache       = options->drop_cache;
+	fw->preallocate_size = options->preallocate_size;
+#ifndef _WIN32
+	fw->fd               = -1;
+#endif
+
+	queue_size = options->queue_size ?
+		options->queue_size : DEFAULT_QUEUE_SIZE;
+
+	fw->buffer_size  = (buffer_size + ALIGNMENT - 1) &
+		~(size_t)(ALIGNMENT - 1);
+	fw->buffer_alloc = bmalloc(fw->buffer_size + ALIGNMENT);
+	fw->buffer       = (uint8_t*)(((uintptr_t)fw->buffer_alloc +
+				ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1));
+
+	if (!spsc_ring_init(&fw->queue, sizeof(struct encoder_packet),
+				queue_size))
+		goto fail;
+	if (os_sem_init(&fw->used_sem, 0) != 0)
+		goto fail;
+
+	if (!open_file(fw)) {
+		warn("Unable to open file");
+		goto fail;
+	}
+
+	if (pthread_create(&fw->thread, NULL, writer_thread, fw) != 0) {
+		warn("Failed to create writer thread");
+		goto fail;
+	}
+
+	fw->thread_created = true;
+	return fw;
+
+fail:
+	file_writer_free(fw);
+	return NULL;
+}
+
+bool file_writer_close(file_writer_t *fw, struct file_writer_stats *stats)
+{
+	bool success;
+
+	if (!fw)
+		return false;
+
+	if (fw->thread_created) {
+		fw->stop = true;
+		os_sem_post(fw->used_sem);
+		pthread_join(fw->thread, NULL);
+	}
+
+	if (stats)
+		file_writer_get_stats(fw, stats);
+
+	success = !fw->error;
+	file_writer_free(fw);
+	return success;
+}
+
+void file_writer_get_stats(file_writer_t *fw, struct file_writer_stats *stats)
+{
+	if (!fw || !stats)
+		return;
+
+	stats->queue_depth     = spsc_ring_count(&fw->queue);
+	stats->max_queue_depth = (size_t)fw->queue.max_count;
+	stats->bytes_written   = fw->offset;
+	stats->num_writes      = fw->num_writes;
+	stats->avg_write_ns    = fw->num_writes ?
+		fw->total_write_ns / fw->num_writes : 0;
+	stats->max_write_ns    = fw->max_write_ns;
+	stats->error           = fw->error;
+}
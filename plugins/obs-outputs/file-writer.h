@@ -0,0 +1,96 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+
+/*
+ *   Write-behind file writer.
+ *
+ *   Encoded packets are handed to the writer through a single producer,
+ * single consumer ring buffer, so the encoder thread never waits on the disk.
+ * The packets are muxed on a dedicated writer thread in to large aligned
+ * buffers, and each buffer is written to the file with a single call.
+ *
+ *   On Linux the file can optionally be preallocated, opened with O_DIRECT,
+ * and have written data dropped from the page cache.
+ */
+
+struct file_writer;
+typedef struct file_writer file_writer_t;
+
+/**
+ * Called on the writer thread for every queued packet.  The callback writes
+ * the muxed data with file_writer_write.  The packet reference is released by
+ * the writer after the callback returns.  When the writer is closed, the
+ * callback is called one last time with a NULL packet so that any data the
+ * muxer still holds can be written.
+ */
+typedef void (*file_writer_mux_t)(void *param, file_writer_t *fw,
+		struct encoder_packet *packet);
+
+struct file_writer_options {
+	/** Size of each write, rounded up to the alignment, 0 for default */
+	size_t   buffer_size;
+	/** Maximum number of queued packets, 0 for default */
+	size_t   queue_size;
+	/** Preallocates the file in chunks of this size, 0 to disable */
+	uint64_t preallocate_size;
+	/** Bypasses the page cache with O_DIRECT where supported */
+	bool     direct_io;
+	/** Drops written data from the page cache where supported */
+	bool     drop_cache;
+};
+
+struct file_writer_stats {
+	size_t   queue_depth;
+	size_t   max_queue_depth;
+	uint64_t bytes_written;
+	uint64_t num_writes;
+	uint64_t avg_write_ns;
+	uint64_t max_write_ns;
+	bool     error;
+};
+
+extern file_writer_t *file_writer_create(const char *path,
+		const struct file_writer_options *options,
+		file_writer_mux_t mux, void *param);
+
+/**
+ * Writes out everything still queued, closes the file and frees the writer.
+ * Returns false if any write failed.
+ */
+extern bool file_writer_close(file_writer_t *fw,
+		struct file_writer_stats *stats);
+
+/** Queues a reference to a packet, takes ownership of the reference */
+extern void file_writer_push(file_writer_t *fw,
+		struct encoder_packet *packet);
+
+/** Appends data to the file, only call from the mux callback */
+extern void file_writer_write(file_writer_t *fw, const void *data,
+		size_t size);
+
+/**
+ * Writes out the buffered data so that everything written so far is in the
+ * file, only call from the mux callback
+ */
+extern void file_writer_flush(file_writer_t *fw);
+
+extern void file_writer_get_stats(file_writer_t *fw,
+		struct file_writer_stats *stats);
@@ -177,19 +177,29 @@ bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 static int32_t last_time = 0;
 #endif
 
-static void flv_video(struct serializer *s, struct encoder_packet *packet,
-		bool is_header)
+static inline void put_be24(uint8_t *buf, uint32_t val)
 {
-	int64_t offset  = packet->pts - packet->dts;
-	int32_t time_ms = get_ms_time(packet, packet->dts);
+	buf[0] = (uint8_t)(val >> 16);
+	buf[1] = (uint8_t)(val >> 8);
+	buf[2] = (uint8_t)val;
+}
 
-	if (!packet->data || !packet->size)
-		return;
+static inline void put_be32(uint8_t *buf, uint32_t val)
+{
+	buf[0] = (uint8_t)(val >> 24);
+	buf[1] = (uint8_t)(val >> 16);
+	buf[2] = (uint8_t)(val >> 8);
+	buf[3] = (uint8_t)val;
+}
 
-	s_w8(s, RTMP_PACKET_TYPE_VIDEO);
+static void flv_tag_header(struct flv_tag *tag, uint8_t type, uint32_t size,
+		int32_t time_ms)
+{
+	uint8_t *header = tag->header;
 
 #ifdef DEBUG_TIMESTAMPS
-	blog(LOG_DEBUG, "Video: %lu", time_ms);
+	blog(LOG_DEBUG, "%s: %lu", type == RTMP_PACKET_TYPE_VIDEO ?
+			"Video" : "Audio", time_ms);
 
 	if (last_time > time_ms)
 		blog(LOG_DEBUG, "Non-monotonic");
@@ -197,67 +207,94 @@ static void flv_video(struct serializer *s, struct encoder_packet *packet,
 	last_time = time_ms;
 #endif
 
-	s_wb24(s, (uint32_t)packet->size + 5);
-	s_wb24(s, time_ms);
-	s_w8(s, (time_ms >> 24) & 0x7F);
-	s_wb24(s, 0);
+	header[0] = type;
+	put_be24(header + 1, size);
+	put_be24(header + 4, (uint32_t)time_ms);
+	header[7] = (time_ms >> 24) & 0x7F;
+	put_be24(header + 8, 0);
+
+	tag->type      = type;
+	tag->timestamp = (uint32_t)time_ms;
+}
+
+static void flv_video(struct flv_tag *tag, struct encoder_packet *packet,
+		bool is_header)
+{
+	int64_t offset  = packet->pts - packet->dts;
+	int32_t time_ms = get_ms_time(packet, packet->dts);
+	uint8_t *extra  = tag->header + FLV_TAG_HEADER_SIZE;
+
+	flv_tag_header(tag, RTMP_PACKET_TYPE_VIDEO,
+			(uint32_t)packet->size + 5, time_ms);
 
 	/* these are the 5 extra bytes mentioned above */
-	s_w8(s, packet->keyframe ? 0x17 : 0x27);
-	s_w8(s, is_header ? 0 : 1);
-	s_wb24(s, get_ms_time(packet, offset));
-	s_write(s, packet->data, packet->size);
+	extra[0] = packet->keyframe ? 0x17 : 0x27;
+	extra[1] = is_header ? 0 : 1;
+	put_be24(extra + 2, get_ms_time(packet, offset));
 
-	/* write tag size (starting byte doesnt count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) + 4 - 1);
+	tag->header_size = FLV_TAG_HEADER_SIZE + 5;
 }
 
-static void flv_audio(struct serializer *s, struct encoder_packet *packet,
+static void flv_audio(struct flv_tag *tag, struct encoder_packet *packet,
 		bool is_header)
 {
 	int32_t time_ms = get_ms_time(packet, packet->dts);
+	uint8_t *extra  = tag->header + FLV_TAG_HEADER_SIZE;
 
-	if (!packet->data || !packet->size)
-		return;
-
-	s_w8(s, RTMP_PACKET_TYPE_AUDIO);
+	flv_tag_header(tag, RTMP_PACKET_TYPE_AUDIO,
+			(uint32_t)packet->size + 2, time_ms);
 
-#ifdef DEBUG_TIMESTAMPS
-	blog(LOG_DEBUG, "Audio: %lu", time_ms);
+	/* these are the two extra bytes mentioned above */
+	extra[0] = 0xaf;
+	extra[1] = is_header ? 0 : 1;
 
-	if (last_time > time_ms)
-		blog(LOG_DEBUG, "Non-monotonic");
+	tag->header_size = FLV_TAG_HEADER_SIZE + 2;
+}
 
-	last_time = time_ms;
-#endif
+bool flv_packet_tag(struct encoder_packet *packet, struct flv_tag *tag,
+		bool is_header)
+{
+	if (!packet->data || !packet->size)
+		return false;
 
-	s_wb24(s, (uint32_t)packet->size + 2);
-	s_wb24(s, time_ms);
-	s_w8(s, (time_ms >> 24) & 0x7F);
-	s_wb24(s, 0);
+	if (packet->type == OBS_ENCODER_VIDEO)
+		flv_video(tag, packet, is_header);
+	else
+		flv_audio(tag, packet, is_header);
 
-	/* these are the two extra bytes mentioned above */
-	s_w8(s, 0xaf);
-	s_w8(s, is_header ? 0 : 1);
-	s_write(s, packet->data, packet->size);
+	tag->data = packet->data;
+	tag->size = packet->size;
 
 	/* write tag size (starting byte doesnt count) */
-	s_wb32(s, (uint32_t)serializer_get_pos(s) + 4 - 1);
+	put_be32(tag->footer, (uint32_t)(tag->header_size + tag->size) + 4 - 1);
+	return true;
+}
+
+void flv_write_tag(FILE *file, const struct flv_tag *tag)
+{
+	fwrite(tag->header, 1, tag->header_size, file);
+	fwrite(tag->data, 1, tag->size, file);
+	fwrite(tag->footer, 1, sizeof(tag->footer), file);
 }
 
 void flv_packet_mux(struct encoder_packet *packet,
 		uint8_t **output, size_t *size, bool is_header)
 {
-	struct array_output_data data;
-	struct serializer s;
+	struct flv_tag tag;
+	uint8_t        *data;
 
-	array_output_serializer_init(&s, &data);
+	if (!flv_packet_tag(packet, &tag, is_header)) {
+		*output = NULL;
+		*size   = 0;
+		return;
+	}
 
-	if (packet->type == OBS_ENCODER_VIDEO)
-		flv_video(&s, packet, is_header);
-	else
-		flv_audio(&s, packet, is_header);
+	*size = flv_tag_size(&tag);
+	*output = data = bmalloc(*size);
 
-	*output = data.bytes.array;
-	*size   = data.bytes.num;
+	memcpy(data, tag.header, tag.header_size);
+	data += tag.header_size;
+	memcpy(data, tag.data, tag.size);
+	data += tag.size;
+	memcpy(data, tag.footer, sizeof(tag.footer));
 }
@@ -26,9 +26,43 @@ static uint32_t get_ms_time(struct encoder_packet *packet, int64_t val)
 	return (uint32_t)(val * MILLISECOND_DEN / packet->timebase_den);
 }
 
+#define FLV_TAG_HEADER_SIZE 11
+
+/*
+ * An FLV tag split in to its parts, so that the payload can be written
+ * straight from the packet without being copied in to a muxed buffer.
+ *
+ * header holds the 11 byte tag header followed by the codec specific bytes
+ * (the RTMP message body starts after the tag header), data points at the
+ * packet payload, and footer holds the previous tag size that follows the
+ * tag in a file.
+ */
+struct flv_tag {
+	uint8_t  header[FLV_TAG_HEADER_SIZE + 5];
+	size_t   header_size;
+	uint8_t  *data;
+	size_t   size;
+	uint8_t  footer[4];
+
+	uint8_t  type;
+	uint32_t timestamp;
+};
+
+static inline size_t flv_tag_size(const struct flv_tag *tag)
+{
+	return tag->header_size + tag->size + sizeof(tag->footer);
+}
+
 extern void write_file_info(FILE *file, int64_t duration_ms, int64_t size);
 
 extern bool flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 		bool write_header, size_t audio_idx);
 extern void flv_packet_mux(struct encoder_packet *packet,
 		uint8_t **output, size_t *size, bool is_header);
+
+/** Returns false if the packet has no data and no tag should be written */
+extern bool flv_packet_tag(struct encoder_packet *packet,
+		struct flv_tag *tag, bool is_header);
+
+/** Writes an FLV tag to a file without copying the payload */
+extern void flv_write_tag(FILE *file, const struct flv_tag *tag);
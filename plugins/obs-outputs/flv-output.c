@@ -23,6 +23,7 @@
 #include <util/threading.h>
 #include <inttypes.h>
 #include "flv-mux.h"
+#include "file-writer.h"
 
 #define do_log(level, format, ...) \
 	blog(level, "[flv output: '%s'] " format, \
@@ -31,13 +32,18 @@
 #define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
 #define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
 
+#define OPT_PREALLOCATE "preallocate_mb"
+#define OPT_DIRECT_IO   "direct_io"
+#define OPT_DROP_CACHE  "drop_cache"
+
 struct flv_output {
-	obs_output_t *output;
-	struct dstr  path;
-	FILE         *file;
-	bool         active;
-	bool         sent_headers;
-	int64_t      last_packet_ts;
+	obs_output_t    *output;
+	struct dstr     path;
+	file_writer_t   *writer;
+	pthread_mutex_t writer_mutex;
+	bool            active;
+	bool            sent_headers;
+	int64_t         last_packet_ts;
 };
 
 static const char *flv_output_getname(void)
@@ -46,6 +52,7 @@ static const char *flv_output_getname(void)
 }
 
 static void flv_output_stop(void *data);
+static void flv_output_get_stats_proc(void *data, calldata_t *cd);
 
 static void flv_output_destroy(void *data)
 {
@@ -54,6 +61,7 @@ static void flv_output_destroy(void *data)
 	if (stream->active)
 		flv_output_stop(data);
 
+	pthread_mutex_destroy(&stream->writer_mutex);
 	dstr_free(&stream->path);
 	bfree(stream);
 }
@@ -62,57 +70,99 @@ static void *flv_output_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct flv_output *stream = bzalloc(sizeof(struct flv_output));
 	stream->output = output;
+	pthread_mutex_init_value(&stream->writer_mutex);
+
+	if (pthread_mutex_init(&stream->writer_mutex, NULL) != 0) {
+		bfree(stream);
+		return NULL;
+	}
+
+	proc_handler_add(obs_output_get_proc_handler(output),
+			"void get_writer_stats(out int queue_depth, "
+			"out int max_queue_depth, out int avg_write_us, "
+			"out int max_write_us)",
+			flv_output_get_stats_proc, stream);
 
 	UNUSED_PARAMETER(settings);
 	return stream;
 }
 
+/* the file info in the header can only be written once all the data is on
+ * disk, and the writer may have had the file open for direct I/O */
+static void update_file_info(struct flv_output *stream, uint64_t size)
+{
+	FILE *file = os_fopen(stream->path.array, "r+b");
+	if (!file) {
+		warn("Unable to reopen '%s' to update the file info",
+				stream->path.array);
+		return;
+	}
+
+	write_file_info(file, stream->last_packet_ts, (int64_t)size);
+	fclose(file);
+}
+
 static void flv_output_stop(void *data)
 {
 	struct flv_output *stream = data;
 
 	if (stream->active) {
-		if (stream->file)
-			write_file_info(stream->file, stream->last_packet_ts,
-					os_ftelli64(stream->file));
+		struct file_writer_stats stats;
+		file_writer_t *writer;
 
-		fclose(stream->file);
 		obs_output_end_data_capture(stream->output);
+
+		/* the stats proc can be called from any thread, so the writer
+		 * is detached before it's closed and freed */
+		pthread_mutex_lock(&stream->writer_mutex);
+		writer = stream->writer;
+		stream->writer = NULL;
+		pthread_mutex_unlock(&stream->writer_mutex);
+
+		if (!file_writer_close(writer, &stats))
+			warn("Errors occurred while writing the file");
+
+		if (stream->sent_headers)
+			update_file_info(stream, stats.bytes_written);
+
 		stream->active = false;
 		stream->sent_headers = false;
 
-		info("FLV file output complete");
+		info("FLV file output complete: %"PRIu64" writes, "
+				"write latency avg %"PRIu64" us, "
+				"max %"PRIu64" us, max queue depth %d",
+				stats.num_writes,
+				stats.avg_write_ns / 1000,
+				stats.max_write_ns / 1000,
+				(int)stats.max_queue_depth);
 	}
 }
 
-static int write_packet(struct flv_output *stream,
+static void write_packet(struct flv_output *stream, file_writer_t *fw,
 		struct encoder_packet *packet, bool is_header)
 {
-	uint8_t *data;
-	size_t  size;
-	int     ret = 0;
+	struct flv_tag tag;
 
 	stream->last_packet_ts = get_ms_time(packet, packet->dts);
 
-	flv_packet_mux(packet, &data, &size, is_header);
-	fwrite(data, 1, size, stream->file);
-	bfree(data);
-	obs_free_encoder_packet(packet);
-
-	return ret;
+	if (flv_packet_tag(packet, &tag, is_header)) {
+		file_writer_write(fw, tag.header, tag.header_size);
+		file_writer_write(fw, tag.data, tag.size);
+		file_writer_write(fw, tag.footer, sizeof(tag.footer));
+	}
 }
 
-static void write_meta_data(struct flv_output *stream)
+static void write_meta_data(struct flv_output *stream, file_writer_t *fw)
 {
 	uint8_t *meta_data;
 	size_t  meta_data_size;
 
 	flv_meta_data(stream->output, &meta_data, &meta_data_size, true, 0);
-	fwrite(meta_data, 1, meta_data_size, stream->file);
+	file_writer_write(fw, meta_data, meta_data_size);
 	bfree(meta_data);
 }
 
-static void write_audio_header(struct flv_output *stream)
+static void write_audio_header(struct flv_output *stream, file_writer_t *fw)
 {
 	obs_output_t  *context  = stream->output;
 	obs_encoder_t *aencoder = obs_output_get_audio_encoder(context, 0);
@@ -124,11 +174,11 @@ static void write_audio_header(struct flv_output *stream)
 	};
 
 	obs_encoder_get_extra_data(aencoder, &header, &packet.size);
-	packet.data = bmemdup(header, packet.size);
-	write_packet(stream, &packet, true);
+	packet.data = header;
+	write_packet(stream, fw, &packet, true);
 }
 
-static void write_video_header(struct flv_output *stream)
+static void write_video_header(struct flv_output *stream, file_writer_t *fw)
 {
 	obs_output_t  *context  = stream->output;
 	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
@@ -143,19 +193,45 @@ static void write_video_header(struct flv_output *stream)
 
 	obs_encoder_get_extra_data(vencoder, &header, &size);
 	packet.size = obs_parse_avc_header(&packet.data, header, size);
-	write_packet(stream, &packet, true);
+	write_packet(stream, fw, &packet, true);
+	bfree(packet.data);
 }
 
-static void write_headers(struct flv_output *stream)
+static void write_headers(struct flv_output *stream, file_writer_t *fw)
 {
-	write_meta_data(stream);
-	write_audio_header(stream);
-	write_video_header(stream);
+	write_meta_data(stream, fw);
+	write_audio_header(stream, fw);
+	write_video_header(stream, fw);
+}
+
+/* called on the writer thread */
+static void mux_packet(void *data, file_writer_t *fw,
+		struct encoder_packet *packet)
+{
+	struct flv_output     *stream = data;
+	struct encoder_packet parsed_packet;
+
+	if (!packet)
+		return;
+
+	if (!stream->sent_headers) {
+		write_headers(stream, fw);
+		stream->sent_headers = true;
+	}
+
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		obs_avc_packet_ref(&parsed_packet, packet);
+		write_packet(stream, fw, &parsed_packet, false);
+		obs_encoder_packet_release(&parsed_packet);
+	} else {
+		write_packet(stream, fw, packet, false);
+	}
 }
 
 static bool flv_output_start(void *data)
 {
 	struct flv_output *stream = data;
+	struct file_writer_options options = {0};
 	obs_data_t *settings;
 	const char *path;
 
@@ -168,10 +244,20 @@ static bool flv_output_start(void *data)
 	settings = obs_output_get_settings(stream->output);
 	path = obs_data_get_string(settings, "path");
 	dstr_copy(&stream->path, path);
+
+	options.preallocate_size =
+		(uint64_t)obs_data_get_int(settings, OPT_PREALLOCATE) *
+		1024 * 1024;
+	options.direct_io  = obs_data_get_bool(settings, OPT_DIRECT_IO);
+	options.drop_cache = obs_data_get_bool(settings, OPT_DROP_CACHE);
 	obs_data_release(settings);
 
-	stream->file = os_fopen(stream->path.array, "wb");
-	if (!stream->file) {
+	pthread_mutex_lock(&stream->writer_mutex);
+	stream->writer = file_writer_create(stream->path.array, &options,
+			mux_packet, stream);
+	pthread_mutex_unlock(&stream->writer_mutex);
+
+	if (!stream->writer) {
 		warn("Unable to open FLV file '%s'", stream->path.array);
 		return false;
 	}
@@ -187,20 +273,36 @@ static bool flv_output_start(void *data)
 static void flv_output_data(void *data, struct encoder_packet *packet)
 {
 	struct flv_output     *stream = data;
-	struct encoder_packet parsed_packet;
+	struct encoder_packet new_packet;
 
-	if (!stream->sent_headers) {
-		write_headers(stream);
-		stream->sent_headers = true;
-	}
+	/* muxing and writing happen on the writer thread */
+	obs_encoder_packet_ref(&new_packet, packet);
+	file_writer_push(stream->writer, &new_packet);
+}
 
-	if (packet->type == OBS_ENCODER_VIDEO) {
-		obs_parse_avc_packet(&parsed_packet, packet);
-		write_packet(stream, &parsed_packet, false);
-		obs_free_encoder_packet(&parsed_packet);
-	} else {
-		write_packet(stream, packet, false);
-	}
+static void flv_output_get_stats_proc(void *data, calldata_t *cd)
+{
+	struct flv_output        *stream = data;
+	struct file_writer_stats stats   = {0};
+
+	pthread_mutex_lock(&stream->writer_mutex);
+	file_writer_get_stats(stream->writer, &stats);
+	pthread_mutex_unlock(&stream->writer_mutex);
+
+	calldata_set_int(cd, "queue_depth", (long long)stats.queue_depth);
+	calldata_set_int(cd, "max_queue_depth",
+			(long long)stats.max_queue_depth);
+	calldata_set_int(cd, "avg_write_us",
+			(long long)(stats.avg_write_ns / 1000));
+	calldata_set_int(cd, "max_write_us",
+			(long long)(stats.max_write_ns / 1000));
+}
+
+static void flv_output_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_PREALLOCATE, 0);
+	obs_data_set_default_bool(defaults, OPT_DIRECT_IO, false);
+	obs_data_set_default_bool(defaults, OPT_DROP_CACHE, false);
 }
 
 static obs_properties_t *flv_output_properties(void *unused)
@@ -212,6 +314,13 @@ static obs_properties_t *flv_output_properties(void *unused)
 	obs_properties_add_text(props, "path",
 			obs_module_text("FLVOutput.FilePath"),
 			OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, OPT_PREALLOCATE,
+			obs_module_text("FLVOutput.Preallocate"),
+			0, 4096, 16);
+	obs_properties_add_bool(props, OPT_DIRECT_IO,
+			obs_module_text("FLVOutput.DirectIO"));
+	obs_properties_add_bool(props, OPT_DROP_CACHE,
+			obs_module_text("FLVOutput.DropCache"));
 	return props;
 }
 
@@ -224,5 +333,6 @@ struct obs_output_info flv_output_info = {
 	.start          = flv_output_start,
 	.stop           = flv_output_stop,
 	.encoded_packet = flv_output_data,
+	.get_defaults   = flv_output_defaults,
 	.get_properties = flv_output_properties
 };
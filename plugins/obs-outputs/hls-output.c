@@ -0,0 +1,513 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <stdio.h>
+#include <obs-module.h>
+#include <util/platform.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include <inttypes.h>
+#include "mp4-mux.h"
+
+#define do_log(level, format, ...) \
+	blog(level, "[hls output: '%s'] " format, \
+			obs_output_get_name(hls->output), ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+#define OPT_SEGMENT_DURATION "segment_duration_sec"
+#define OPT_PLAYLIST_SIZE    "playlist_size"
+#define OPT_DELETE_SEGMENTS  "delete_segments"
+
+/* segments stay on disk for a while after they leave the playlist, as
+ * clients may have just loaded the previous playlist */
+#define DELETE_DELAY_SEGMENTS 2
+
+#define SEGMENT_BUFFER_SIZE   (1024 * 1024)
+
+/*
+ *   Writes an HLS stream to disk: an fMP4 initialization segment, rolling
+ * fMP4 media segments cut at video keyframes, and a playlist of the most
+ * recent segments.
+ *
+ *   The encoder callback only queues packet references.  Muxing and all file
+ * I/O happen on a separate thread.  The playlist is written to a temporary
+ * file and then renamed over the old one, so a web server never serves a
+ * partial playlist.
+ */
+
+struct hls_segment {
+	uint64_t number;
+	double   duration;
+};
+
+struct hls_output {
+	obs_output_t     *output;
+	bool             active;
+
+	pthread_mutex_t  packets_mutex;
+	struct circlebuf packets;
+	os_sem_t         *send_sem;
+	os_event_t       *stop_event;
+	pthread_t        thread;
+
+	struct dstr      playlist_path;
+	struct dstr      base_path;
+	struct dstr      base_name;
+	int64_t          segment_duration_usec;
+	size_t           playlist_size;
+	bool             delete_segments;
+
+	/* only used on the I/O thread */
+	struct mp4_mux   mux;
+	FILE             *segment;
+	uint8_t          *segment_buf;
+	uint64_t         segment_number;
+	int64_t          segment_start_usec;
+	double           target_duration;
+	bool             write_error;
+	struct dstr      path_buf;
+	struct dstr      playlist;
+	DARRAY(struct hls_segment) segments;
+};
+
+static const char *hls_output_getname(void)
+{
+	return obs_module_text("HLSOutput");
+}
+
+/* ------------------------------------------------------------------------- */
+/* Segments and playlist, I/O thread only */
+
+static inline const char *get_segment_path(struct hls_output *hls,
+		uint64_t number)
+{
+	dstr_printf(&hls->path_buf, "%s_%05"PRIu64".m4s",
+			hls->base_path.array, number);
+	return hls->path_buf.array;
+}
+
+static void write_playlist(struct hls_output *hls, bool ended)
+{
+	struct hls_segment *segments = hls->segments.array;
+	size_t             num       = hls->segments.num;
+	size_t             first     = 0;
+	struct dstr        tmp_path  = {0};
+	int                target    = (int)hls->target_duration;
+
+	if (num > hls->playlist_size)
+		first = num - hls->playlist_size;
+
+	/* the target duration is the longest segment rounded up */
+	if ((double)target < hls->target_duration)
+		target++;
+
+	dstr_printf(&hls->playlist,
+			"#EXTM3U\n"
+			"#EXT-X-VERSION:7\n"
+			"#EXT-X-TARGETDURATION:%d\n"
+			"#EXT-X-MEDIA-SEQUENCE:%"PRIu64"\n"
+			"#EXT-X-INDEPENDENT-SEGMENTS\n"
+			"#EXT-X-MAP:URI=\"%s_init.mp4\"\n",
+			target,
+			num ? segments[first].number : 0,
+			hls->base_name.array);
+
+	for (size_t i = first; i < num; i++)
+		dstr_catf(&hls->playlist,
+				"#EXTINF:%.3f,\n%s_%05"PRIu64".m4s\n",
+				segments[i].duration, hls->base_name.array,
+				segments[i].number);
+
+	if (ended)
+		dstr_cat(&hls->playlist, "#EXT-X-ENDLIST\n");
+
+	dstr_printf(&tmp_path, "%s.tmp", hls->playlist_path.array);
+
+	if (!os_quick_write_utf8_file(tmp_path.array, hls->playlist.array,
+				hls->playlist.len, false) ||
+	    os_rename(tmp_path.array, hls->playlist_path.array) != 0)
+		warn("Failed to write playlist '%s'",
+				hls->playlist_path.array);
+
+	dstr_free(&tmp_path);
+}
+
+static void delete_old_segments(struct hls_output *hls)
+{
+	size_t keep = hls->playlist_size + DELETE_DELAY_SEGMENTS;
+
+	while (hls->segments.num > keep) {
+		if (hls->delete_segments)
+			os_unlink(get_segment_path(hls,
+					hls->segments.array[0].number));
+		da_erase(hls->segments, 0);
+	}
+}
+
+static void close_segment(struct hls_output *hls, int64_t end_usec)
+{
+	struct hls_segment segment;
+
+	if (!hls->segment)
+		return;
+
+	if (fclose(hls->segment) != 0 && !hls->write_error) {
+		warn("Failed to write segment %"PRIu64, hls->segment_number);
+		hls->write_error = true;
+	}
+	hls->segment = NULL;
+
+	segment.number   = hls->segment_number++;
+	segment.duration = (double)(end_usec - hls->segment_start_usec) /
+		1000000.0;
+
+	if (segment.duration > hls->target_duration)
+		hls->target_duration = segment.duration;
+
+	da_push_back(hls->segments, &segment);
+	delete_old_segments(hls);
+}
+
+static void write_segment_data(void *data, const void *buf, size_t size)
+{
+	struct hls_output *hls = data;
+
+	if (hls->segment && fwrite(buf, 1, size, hls->segment) != size &&
+	    !hls->write_error) {
+		warn("Failed to write segment %"PRIu64, hls->segment_number);
+		hls->write_error = true;
+	}
+}
+
+static void write_init_segment(struct hls_output *hls)
+{
+	FILE *file;
+
+	dstr_printf(&hls->path_buf, "%s_init.mp4", hls->base_path.array);
+
+	file = os_fopen(hls->path_buf.array, "wb");
+	if (!file) {
+		warn("Unable to open '%s'", hls->path_buf.array);
+		return;
+	}
+
+	hls->segment = file;
+	mp4_mux_write_init(&hls->mux, write_segment_data, hls);
+	hls->segment = NULL;
+
+	fclose(file);
+}
+
+/* each fragment of the muxer is one segment */
+static void begin_segment(void *data, int64_t start_usec)
+{
+	struct hls_output *hls = data;
+	const char        *path;
+
+	if (!hls->segments.num)
+		write_init_segment(hls);
+
+	path = get_segment_path(hls, hls->segment_number);
+	hls->segment = os_fopen(path, "wb");
+	if (!hls->segment) {
+		warn("Unable to open segment '%s'", path);
+		return;
+	}
+
+	setvbuf(hls->segment, (char*)hls->segment_buf, _IOFBF,
+			SEGMENT_BUFFER_SIZE);
+	hls->segment_start_usec = start_usec;
+}
+
+/* the segment is listed as soon as its last fragment data is on disk */
+static void end_segment(void *data, int64_t end_usec)
+{
+	struct hls_output *hls = data;
+
+	if (!hls->segment)
+		return;
+
+	close_segment(hls, end_usec);
+	write_playlist(hls, false);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline bool get_next_packet(struct hls_output *hls,
+		struct encoder_packet *packet)
+{
+	bool new_packet = false;
+
+	pthread_mutex_lock(&hls->packets_mutex);
+	if (hls->packets.size) {
+		circlebuf_pop_front(&hls->packets, packet,
+				sizeof(struct encoder_packet));
+		new_packet = true;
+	}
+	pthread_mutex_unlock(&hls->packets_mutex);
+
+	return new_packet;
+}
+
+static inline void mux_packet(struct hls_output *hls,
+		struct encoder_packet *packet)
+{
+	mp4_mux_packet(&hls->mux, packet);
+	obs_encoder_packet_release(packet);
+}
+
+static void *io_thread(void *data)
+{
+	struct hls_output     *hls = data;
+	struct encoder_packet packet;
+
+	os_set_thread_name("hls output");
+
+	while (os_sem_wait(hls->send_sem) == 0) {
+		if (os_event_try(hls->stop_event) != EAGAIN)
+			break;
+		if (get_next_packet(hls, &packet))
+			mux_packet(hls, &packet);
+	}
+
+	while (get_next_packet(hls, &packet))
+		mux_packet(hls, &packet);
+
+	mp4_mux_finish(&hls->mux);
+	write_playlist(hls, true);
+	return NULL;
+}
+
+static void free_packets(struct hls_output *hls)
+{
+	while (hls->packets.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&hls->packets, &packet, sizeof(packet));
+		obs_encoder_packet_release(&packet);
+	}
+}
+
+static void hls_output_stop(void *data)
+{
+	struct hls_output *hls = data;
+
+	if (!hls->active)
+		return;
+
+	obs_output_end_data_capture(hls->output);
+
+	os_event_signal(hls->stop_event);
+	os_sem_post(hls->send_sem);
+	pthread_join(hls->thread, NULL);
+	os_event_reset(hls->stop_event);
+
+	free_packets(hls);
+	mp4_mux_free(&hls->mux);
+	da_free(hls->segments);
+	hls->active = false;
+
+	info("HLS output stopped after %"PRIu64" segments",
+			hls->segment_number);
+}
+
+static void hls_output_destroy(void *data)
+{
+	struct hls_output *hls = data;
+
+	if (!hls)
+		return;
+
+	hls_output_stop(hls);
+
+	os_event_destroy(hls->stop_event);
+	os_sem_destroy(hls->send_sem);
+	pthread_mutex_destroy(&hls->packets_mutex);
+	circlebuf_free(&hls->packets);
+	dstr_free(&hls->playlist_path);
+	dstr_free(&hls->base_path);
+	dstr_free(&hls->base_name);
+	dstr_free(&hls->path_buf);
+	dstr_free(&hls->playlist);
+	bfree(hls->segment_buf);
+	bfree(hls);
+}
+
+static void *hls_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct hls_output *hls = bzalloc(sizeof(struct hls_output));
+	hls->output = output;
+	pthread_mutex_init_value(&hls->packets_mutex);
+
+	if (pthread_mutex_init(&hls->packets_mutex, NULL) != 0)
+		goto fail;
+	if (os_event_init(&hls->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+	if (os_sem_init(&hls->send_sem, 0) != 0)
+		goto fail;
+
+	hls->segment_buf = bmalloc(SEGMENT_BUFFER_SIZE);
+
+	UNUSED_PARAMETER(settings);
+	return hls;
+
+fail:
+	hls_output_destroy(hls);
+	return NULL;
+}
+
+/* segments are named after the playlist and placed next to it */
+static void set_paths(struct hls_output *hls, const char *path)
+{
+	const char *slash;
+	const char *name;
+	const char *ext;
+
+	dstr_copy(&hls->playlist_path, path);
+
+	slash = strrchr(path, '/');
+#ifdef _WIN32
+	if (strrchr(path, '\\') > slash)
+		slash = strrchr(path, '\\');
+#endif
+	name = slash ? slash + 1 : path;
+	ext  = strrchr(name, '.');
+
+	dstr_ncopy(&hls->base_name, name, ext ? (size_t)(ext - name) :
+			strlen(name));
+	dstr_ncopy(&hls->base_path, path, (size_t)(name - path));
+	dstr_cat_dstr(&hls->base_path, &hls->base_name);
+}
+
+static inline bool reset_semaphore(struct hls_output *hls)
+{
+	os_sem_destroy(hls->send_sem);
+	return os_sem_init(&hls->send_sem, 0) == 0;
+}
+
+static bool hls_output_start(void *data)
+{
+	struct hls_output *hls = data;
+	obs_data_t        *settings;
+	const char        *path;
+
+	if (!obs_output_can_begin_data_capture(hls->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(hls->output, 0))
+		return false;
+
+	settings = obs_output_get_settings(hls->output);
+	path     = obs_data_get_string(settings, "path");
+
+	if (!path || !*path) {
+		warn("No playlist path set");
+		obs_data_release(settings);
+		return false;
+	}
+
+	set_paths(hls, path);
+	hls->segment_duration_usec =
+		obs_data_get_int(settings, OPT_SEGMENT_DURATION) * 1000000;
+	hls->playlist_size =
+		(size_t)obs_data_get_int(settings, OPT_PLAYLIST_SIZE);
+	hls->delete_segments =
+		obs_data_get_bool(settings, OPT_DELETE_SEGMENTS);
+	obs_data_release(settings);
+
+	if (!hls->playlist_size)
+		hls->playlist_size = 1;
+
+	hls->segment_number  = 0;
+	hls->target_duration = 0.0;
+	hls->write_error     = false;
+
+	mp4_mux_init(&hls->mux, hls->output, hls->segment_duration_usec,
+			false, write_segment_data, begin_segment, end_segment,
+			hls);
+
+	if (!reset_semaphore(hls) ||
+	    pthread_create(&hls->thread, NULL, io_thread, hls) != 0) {
+		warn("Failed to create I/O thread");
+		mp4_mux_free(&hls->mux);
+		return false;
+	}
+
+	hls->active = true;
+	obs_output_begin_data_capture(hls->output, 0);
+
+	info("Writing HLS playlist '%s'...", hls->playlist_path.array);
+	return true;
+}
+
+static void hls_output_data(void *data, struct encoder_packet *packet)
+{
+	struct hls_output     *hls = data;
+	struct encoder_packet new_packet;
+
+	obs_encoder_packet_ref(&new_packet, packet);
+
+	pthread_mutex_lock(&hls->packets_mutex);
+	circlebuf_push_back(&hls->packets, &new_packet, sizeof(new_packet));
+	pthread_mutex_unlock(&hls->packets_mutex);
+
+	os_sem_post(hls->send_sem);
+}
+
+static void hls_output_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_SEGMENT_DURATION, 4);
+	obs_data_set_default_int(defaults, OPT_PLAYLIST_SIZE, 6);
+	obs_data_set_default_bool(defaults, OPT_DELETE_SEGMENTS, true);
+}
+
+static obs_properties_t *hls_output_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_text(props, "path",
+			obs_module_text("HLSOutput.PlaylistPath"),
+			OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, OPT_SEGMENT_DURATION,
+			obs_module_text("HLSOutput.SegmentDuration"),
+			1, 60, 1);
+	obs_properties_add_int(props, OPT_PLAYLIST_SIZE,
+			obs_module_text("HLSOutput.PlaylistSize"),
+			1, 1000, 1);
+	obs_properties_add_bool(props, OPT_DELETE_SEGMENTS,
+			obs_module_text("HLSOutput.DeleteSegments"));
+	return props;
+}
+
+struct obs_output_info hls_output_info = {
+	.id             = "hls_output",
+	.flags          = OBS_OUTPUT_AV |
+	                  OBS_OUTPUT_ENCODED |
+	                  OBS_OUTPUT_MULTI_TRACK,
+	.get_name       = hls_output_getname,
+	.create         = hls_output_create,
+	.destroy        = hls_output_destroy,
+	.start          = hls_output_start,
+	.stop           = hls_output_stop,
+	.encoded_packet = hls_output_data,
+	.get_defaults   = hls_output_defaults,
+	.get_properties = hls_output_properties
+};
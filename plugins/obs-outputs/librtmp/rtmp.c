@@ -5117,6 +5117,301 @@ fail:
 
 static const AVal av_setDataFrame = AVC("@setDataFrame");
 
+#ifdef _WIN32
+typedef WSABUF SysIOVec;
+#define SYSIOV_BASE(v) ((v)->buf)
+#define SYSIOV_LEN(v) ((v)->len)
+#define SYSIOV_SET(v, p, l) ((v)->buf = (CHAR *)(p), (v)->len = (ULONG)(l))
+#else
+typedef struct iovec SysIOVec;
+#define SYSIOV_BASE(v) ((char *)(v)->iov_base)
+#define SYSIOV_LEN(v) ((v)->iov_len)
+#define SYSIOV_SET(v, p, l) ((v)->iov_base = (void *)(p), (v)->iov_len = (size_t)(l))
+#endif
+
+/* stays well below IOV_MAX on every platform */
+#define RTMP_MAX_SEND_IOV 256
+
+static int
+SockBuf_SendV(RTMPSockBuf *sb, SysIOVec *iov, int iovcnt)
+{
+#ifdef _WIN32
+    DWORD sent = 0;
+    if (WSASend(sb->sb_socket, iov, (DWORD)iovcnt, &sent, 0, NULL, NULL) != 0)
+        return -1;
+    return (int)sent;
+#else
+    return (int)writev(sb->sb_socket, iov, iovcnt);
+#endif
+}
+
+/* writes all the pieces, resubmitting whatever remains after partial
+ * writes.  the iov array is modified */
+static int
+WriteV(RTMP *r, SysIOVec *iov, int iovcnt)
+{
+    while (iovcnt > 0)
+    {
+        int count = iovcnt > RTMP_MAX_SEND_IOV ? RTMP_MAX_SEND_IOV : iovcnt;
+        int nBytes = SockBuf_SendV(&r->m_sb, iov, count);
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        while (iovcnt > 0 && nBytes >= (int)SYSIOV_LEN(iov))
+        {
+            nBytes -= (int)SYSIOV_LEN(iov);
+            iov++;
+            iovcnt--;
+        }
+
+        if (nBytes)
+            SYSIOV_SET(iov, SYSIOV_BASE(iov) + nBytes,
+                       SYSIOV_LEN(iov) - nBytes);
+    }
+
+    return TRUE;
+}
+
+/* encodes the message header of a packet the same way as RTMP_SendPacket,
+ * returns the header size */
+static int
+EncodePacketHeader(RTMP *r, RTMPPacket *packet, char *header, char *c_out,
+                   int *cSize_out)
+{
+    const RTMPPacket *prevPacket = NULL;
+    uint32_t last = 0, t;
+    int nSize, hSize, cSize = 0;
+    char *hptr = header, *hend = header + RTMP_MAX_HEADER_SIZE, c;
+
+    if (packet->m_nChannel < r->m_channelsAllocatedOut)
+        prevPacket = r->m_vecChannelsOut[packet->m_nChannel];
+
+    if (prevPacket && packet->m_headerType != RTMP_PACKET_SIZE_LARGE)
+    {
+        if (prevPacket->m_nBodySize == packet->m_nBodySize
+                && prevPacket->m_packetType == packet->m_packetType
+                && packet->m_headerType == RTMP_PACKET_SIZE_MEDIUM)
+            packet->m_headerType = RTMP_PACKET_SIZE_SMALL;
+
+        if (prevPacket->m_nTimeStamp == packet->m_nTimeStamp
+                && packet->m_headerType == RTMP_PACKET_SIZE_SMALL)
+            packet->m_headerType = RTMP_PACKET_SIZE_MINIMUM;
+        last = prevPacket->m_nTimeStamp;
+    }
+
+    nSize = packetSize[packet->m_headerType];
+    hSize = nSize;
+    t = packet->m_nTimeStamp - last;
+
+    if (packet->m_nChannel > 319)
+        cSize = 2;
+    else if (packet->m_nChannel > 63)
+        cSize = 1;
+
+    c = packet->m_headerType << 6;
+    switch (cSize)
+    {
+    case 0:
+        c |= packet->m_nChannel;
+        break;
+    case 1:
+        break;
+    case 2:
+        c |= 1;
+        break;
+    }
+    *hptr++ = c;
+    if (cSize)
+    {
+        int tmp = packet->m_nChannel - 64;
+        *hptr++ = tmp & 0xff;
+        if (cSize == 2)
+            *hptr++ = tmp >> 8;
+        hSize += cSize;
+    }
+
+    if (nSize > 1)
+        hptr = AMF_EncodeInt24(hptr, hend, t > 0xffffff ? 0xffffff : t);
+
+    if (nSize > 4)
+    {
+        hptr = AMF_EncodeInt24(hptr, hend, packet->m_nBodySize);
+        *hptr++ = packet->m_packetType;
+    }
+
+    if (nSize > 8)
+        hptr += EncodeInt32LE(hptr, packet->m_nInfoField2);
+
+    if (nSize > 1 && t >= 0xffffff)
+    {
+        hptr = AMF_EncodeInt32(hptr, hend, t);
+        hSize += 4;
+    }
+
+    *c_out = c;
+    *cSize_out = cSize;
+    return hSize;
+}
+
+static int
+SendPacketV(RTMP *r, RTMPPacket *packet, const RTMPIOVec *body, int bodycnt)
+{
+    char header[RTMP_MAX_HEADER_SIZE + 8];
+    char cont[3];
+    int hSize, cSize, contSize;
+    int nChunkSize = r->m_outChunkSize;
+    int chunks = (packet->m_nBodySize + nChunkSize - 1) / nChunkSize;
+    int maxcnt = 1 + bodycnt + chunks * 2;
+    SysIOVec stack_iov[64];
+    SysIOVec *iov = maxcnt > 64 ? malloc(sizeof(SysIOVec) * maxcnt) : stack_iov;
+    int cnt = 0, chunkLeft = nChunkSize, ret, i;
+    char c;
+
+    if (!iov)
+        return FALSE;
+
+    hSize = EncodePacketHeader(r, packet, header, &c, &cSize);
+
+    /* continuation chunks use a type 3 header on the same channel */
+    contSize = 1 + cSize;
+    cont[0] = (char)(0xc0 | c);
+    if (cSize)
+    {
+        int tmp = packet->m_nChannel - 64;
+        cont[1] = tmp & 0xff;
+        if (cSize == 2)
+            cont[2] = tmp >> 8;
+    }
+
+    SYSIOV_SET(&iov[cnt++], header, hSize);
+
+    for (i = 0; i < bodycnt; i++)
+    {
+        const char *data = body[i].data;
+        int len = body[i].len;
+
+        while (len > 0)
+        {
+            int num;
+
+            if (!chunkLeft)
+            {
+                SYSIOV_SET(&iov[cnt++], cont, contSize);
+                chunkLeft = nChunkSize;
+            }
+
+            num = len < chunkLeft ? len : chunkLeft;
+            SYSIOV_SET(&iov[cnt++], data, num);
+            data += num;
+            len -= num;
+            chunkLeft -= num;
+        }
+    }
+
+    ret = WriteV(r, iov, cnt);
+
+    if (iov != stack_iov)
+        free(iov);
+    if (!ret)
+        return FALSE;
+
+    if (packet->m_nChannel >= r->m_channelsAllocatedOut)
+    {
+        int n = packet->m_nChannel + 10;
+        RTMPPacket **packets = realloc(r->m_vecChannelsOut, sizeof(RTMPPacket*) * n);
+        if (!packets)
+            return FALSE;
+        r->m_vecChannelsOut = packets;
+        memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
+        r->m_channelsAllocatedOut = n;
+    }
+
+    if (!r->m_vecChannelsOut[packet->m_nChannel])
+        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+    return TRUE;
+}
+
+static inline int
+CanSendV(RTMP *r)
+{
+    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+        return FALSE;
+    if (r->m_bCustomSend && r->m_customSendFunc)
+        return FALSE;
+#ifdef CRYPTO
+    if (r->Link.rc4keyOut)
+        return FALSE;
+#if !defined(NO_SSL)
+    if (r->m_sb.sb_ssl)
+        return FALSE;
+#endif
+#endif
+    return TRUE;
+}
+
+int
+RTMP_WriteV(RTMP *r, int packetType, uint32_t timestamp,
+            const RTMPIOVec *iov, int iovcnt, int streamIdx)
+{
+    RTMPPacket packet = {0};
+    int size = 0, ret, i;
+
+    for (i = 0; i < iovcnt; i++)
+        size += iov[i].len;
+
+    packet.m_nChannel = 0x04;	/* source channel */
+    packet.m_nInfoField2 = r->Link.streams[streamIdx].id;
+    packet.m_packetType = packetType;
+    packet.m_nTimeStamp = timestamp;
+    packet.m_nBodySize = size;
+    packet.m_hasAbsTimestamp = 0;
+    packet.m_headerType = ((packetType == RTMP_PACKET_TYPE_AUDIO
+                            || packetType == RTMP_PACKET_TYPE_VIDEO) && !timestamp)
+                          || packetType == RTMP_PACKET_TYPE_INFO
+                          ? RTMP_PACKET_SIZE_LARGE : RTMP_PACKET_SIZE_MEDIUM;
+
+    if (CanSendV(r))
+    {
+        ret = SendPacketV(r, &packet, iov, iovcnt);
+    }
+    else
+    {
+        /* the transport needs a contiguous buffer, so fall back to
+         * copying the body */
+        char *enc;
+
+        if (!RTMPPacket_Alloc(&packet, size))
+            return -1;
+
+        enc = packet.m_body;
+        for (i = 0; i < iovcnt; i++)
+        {
+            memcpy(enc, iov[i].data, iov[i].len);
+            enc += iov[i].len;
+        }
+
+        ret = RTMP_SendPacket(r, &packet, FALSE);
+        RTMPPacket_Free(&packet);
+    }
+
+    return ret ? size : -1;
+}
+
 int
 RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx)
 {
@@ -414,6 +414,20 @@ extern "C"
     int RTMP_Read(RTMP *r, char *buf, int size);
     int RTMP_Write(RTMP *r, const char *buf, int size, int streamIdx);
 
+    /* a single piece of an RTMP message body */
+    typedef struct RTMPIOVec
+    {
+        const char *data;
+        int len;
+    } RTMPIOVec;
+
+    /* sends an audio/video/info message whose body is made up of the given
+     * pieces, without copying them.  the chunk headers are interleaved with
+     * the body pieces and the whole message is sent with a single vectored
+     * socket write where possible.  returns the body size, or -1 on error */
+    int RTMP_WriteV(RTMP *r, int packetType, uint32_t timestamp,
+                    const RTMPIOVec *iov, int iovcnt, int streamIdx);
+
     /* hashswf.c */
     int RTMP_HashSWF(const char *url, unsigned int *size, unsigned char *hash,
                      int age);
@@ -62,6 +62,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/times.h>
+#include <sys/uio.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <netinet/in.h>
@@ -0,0 +1,709 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs.h>
+#include <obs-avc.h>
+#include <string.h>
+#include "mp4-mux.h"
+
+#define TFHD_DEFAULT_BASE_IS_MOOF  0x020000
+
+#define TRUN_DATA_OFFSET           0x000001
+#define TRUN_SAMPLE_DURATION       0x000100
+#define TRUN_SAMPLE_SIZE           0x000200
+#define TRUN_SAMPLE_FLAGS          0x000400
+#define TRUN_SAMPLE_CTO            0x000800
+
+#define SAMPLE_FLAGS_SYNC          0x02000000
+#define SAMPLE_FLAGS_NON_SYNC      0x01010000
+
+static const uint32_t unity_matrix[9] = {
+	0x00010000, 0, 0,
+	0, 0x00010000, 0,
+	0, 0, 0x40000000
+};
+
+/* ------------------------------------------------------------------------- */
+/* Box writing */
+
+static inline void start_box(struct mp4_mux *mux, const char *type)
+{
+	size_t pos = (size_t)serializer_get_pos(&mux->s);
+
+	da_push_back(mux->box_stack, &pos);
+	s_wb32(&mux->s, 0);
+	s_write(&mux->s, type, 4);
+}
+
+static inline void start_full_box(struct mp4_mux *mux, const char *type,
+		uint8_t version, uint32_t flags)
+{
+	start_box(mux, type);
+	s_w8(&mux->s, version);
+	s_wb24(&mux->s, flags);
+}
+
+static inline void set_wb32(struct mp4_mux *mux, size_t pos, uint32_t val)
+{
+	uint8_t *p = mux->buf.bytes.array + pos;
+
+	p[0] = (uint8_t)(val >> 24);
+	p[1] = (uint8_t)(val >> 16);
+	p[2] = (uint8_t)(val >> 8);
+	p[3] = (uint8_t)val;
+}
+
+static inline void end_box(struct mp4_mux *mux)
+{
+	size_t pos = mux->box_stack.array[mux->box_stack.num - 1];
+
+	da_pop_back(mux->box_stack);
+	set_wb32(mux, pos, (uint32_t)(mux->buf.bytes.num - pos));
+}
+
+static inline void reset_buffer(struct mp4_mux *mux)
+{
+	da_resize(mux->buf.bytes, 0);
+}
+
+static inline void write_zeros(struct mp4_mux *mux, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		s_w8(&mux->s, 0);
+}
+
+static inline void write_matrix(struct mp4_mux *mux)
+{
+	for (size_t i = 0; i < 9; i++)
+		s_wb32(&mux->s, unity_matrix[i]);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Initialization boxes */
+
+static void write_ftyp(struct mp4_mux *mux)
+{
+	start_box(mux, "ftyp");
+	s_write(&mux->s, "isom", 4);
+	s_wb32(&mux->s, 0x200);
+	s_write(&mux->s, "isom", 4);
+	s_write(&mux->s, "iso6", 4);
+	s_write(&mux->s, "avc1", 4);
+	s_write(&mux->s, "mp41", 4);
+	end_box(mux);
+}
+
+static void write_mvhd(struct mp4_mux *mux)
+{
+	start_full_box(mux, "mvhd", 0, 0);
+	s_wb32(&mux->s, 0);             /* creation time */
+	s_wb32(&mux->s, 0);             /* modification time */
+	s_wb32(&mux->s, 1000);          /* timescale */
+	s_wb32(&mux->s, 0);             /* duration, unknown */
+	s_wb32(&mux->s, 0x00010000);    /* rate */
+	s_wb16(&mux->s, 0x0100);        /* volume */
+	write_zeros(mux, 10);
+	write_matrix(mux);
+	write_zeros(mux, 24);
+	s_wb32(&mux->s, (uint32_t)mux->num_tracks + 1);
+	end_box(mux);
+}
+
+static void write_tkhd(struct mp4_mux *mux, struct mp4_track *track)
+{
+	bool     video  = track->type == OBS_ENCODER_VIDEO;
+	uint32_t width  = video ? obs_encoder_get_width(track->encoder) : 0;
+	uint32_t height = video ? obs_encoder_get_height(track->encoder) : 0;
+
+	/* enabled, in movie */
+	start_full_box(mux, "tkhd", 0, 0x3);
+	s_wb32(&mux->s, 0);
+	s_wb32(&mux->s, 0);
+	s_wb32(&mux->s, track->track_id);
+	s_wb32(&mux->s, 0);
+	s_wb32(&mux->s, 0);             /* duration, unknown */
+	write_zeros(mux, 8);
+	s_wb16(&mux->s, 0);             /* layer */
+	s_wb16(&mux->s, video ? 0 : 1); /* alternate group */
+	s_wb16(&mux->s, video ? 0 : 0x0100);
+	s_wb16(&mux->s, 0);
+	write_matrix(mux);
+	s_wb32(&mux->s, width << 16);
+	s_wb32(&mux->s, height << 16);
+	end_box(mux);
+}
+
+static void write_mdhd(struct mp4_mux *mux, struct mp4_track *track)
+{
+	start_full_box(mux, "mdhd", 0, 0);
+	s_wb32(&mux->s, 0);
+	s_wb32(&mux->s, 0);
+	s_wb32(&mux->s, track->timescale);
+	s_wb32(&mux->s, 0);
+	s_wb16(&mux->s, 0x55c4);        /* "und" */
+	s_wb16(&mux->s, 0);
+	end_box(mux);
+}
+
+static void write_hdlr(struct mp4_mux *mux, struct mp4_track *track)
+{
+	bool       video = track->type == OBS_ENCODER_VIDEO;
+	const char *name = video ? "VideoHandler" : "SoundHandler";
+
+	start_full_box(mux, "hdlr", 0, 0);
+	s_wb32(&mux->s, 0);
+	s_write(&mux->s, video ? "vide" : "soun", 4);
+	write_zeros(mux, 12);
+	s_write(&mux->s, name, strlen(name) + 1);
+	end_box(mux);
+}
+
+static void write_dinf(struct mp4_mux *mux)
+{
+	start_box(mux, "dinf");
+	start_full_box(mux, "dref", 0, 0);
+	s_wb32(&mux->s, 1);
+	start_full_box(mux, "url ", 0, 0x1); /* data is in this file */
+	end_box(mux);
+	end_box(mux);
+	end_box(mux);
+}
+
+static void write_avc1(struct mp4_mux *mux, struct mp4_track *track)
+{
+	uint8_t *extra_data = NULL;
+	uint8_t *avcc       = NULL;
+	size_t  extra_size  = 0;
+	size_t  avcc_size;
+
+	obs_encoder_get_extra_data(track->encoder, &extra_data, &extra_size);
+	avcc_size = obs_parse_avc_header(&avcc, extra_data, extra_size);
+
+	start_box(mux, "avc1");
+	write_zeros(mux, 6);
+	s_wb16(&mux->s, 1);             /* data reference index */
+	write_zeros(mux, 16);
+	s_wb16(&mux->s, (uint16_t)obs_encoder_get_width(track->encoder));
+	s_wb16(&mux->s, (uint16_t)obs_encoder_get_height(track->encoder));
+	s_wb32(&mux->s, 0x00480000);    /* 72 dpi */
+	s_wb32(&mux->s, 0x00480000);
+	s_wb32(&mux->s, 0);
+	s_wb16(&mux->s, 1);             /* frame count */
+	write_zeros(mux, 32);           /* compressor name */
+	s_wb16(&mux->s, 0x0018);        /* depth */
+	s_wb16(&mux->s, 0xffff);
+
+	start_box(mux, "avcC");
+	s_write(&mux->s, avcc, avcc_size);
+	end_box(mux);
+
+	end_box(mux);
+
+	bfree(avcc);
+}
+
+static inline void write_descriptor(struct mp4_mux *mux, uint8_t tag,
+		size_t size)
+{
+	s_w8(&mux->s, tag);
+	s_w8(&mux->s, 0x80);
+	s_w8(&mux->s, 0x80);
+	s_w8(&mux->s, 0x80);
+	s_w8(&mux->s, (uint8_t)size);
+}
+
+static void write_mp4a(struct mp4_mux *mux, struct mp4_track *track)
+{
+	audio_t    *audio      = obs_encoder_audio(track->encoder);
+	obs_data_t *settings   = obs_encoder_get_settings(track->encoder);
+	uint32_t   bitrate     = (uint32_t)obs_data_get_int(settings,
+			"bitrate") * 1000;
+	uint8_t    *extra_data = NULL;
+	size_t     extra_size  = 0;
+
+	obs_data_release(settings);
+	obs_encoder_get_extra_data(track->encoder, &extra_data, &extra_size);
+
+	start_box(mux, "mp4a");
+	write_zeros(mux, 6);
+	s_wb16(&mux->s, 1);             /* data reference index */
+	write_zeros(mux, 8);
+	s_wb16(&mux->s, (uint16_t)audio_output_get_channels(audio));
+	s_wb16(&mux->s, 16);            /* sample size */
+	write_zeros(mux, 4);
+	s_wb32(&mux->s, track->timescale << 16);
+
+	start_full_box(mux, "esds", 0, 0);
+
+	write_descriptor(mux, 0x03, 3 + 5 + 13 + 5 + extra_size + 5 + 1);
+	s_wb16(&mux->s, 0);             /* ES ID */
+	s_w8(&mux->s, 0);
+
+	write_descriptor(mux, 0x04, 13 + 5 + extra_size);
+	s_w8(&mux->s, 0x40);            /* MPEG-4 audio */
+	s_w8(&mux->s, 0x15);            /* audio stream */
+	s_wb24(&mux->s, 0);             /* buffer size */
+	s_wb32(&mux->s, bitrate);       /* max bitrate */
+	s_wb32(&mux->s, bitrate);       /* average bitrate */
+
+	write_descriptor(mux, 0x05, extra_size);
+	s_write(&mux->s, extra_data, extra_size);
+
+	write_descriptor(mux, 0x06, 1);
+	s_w8(&mux->s, 0x02);
+
+	end_box(mux);
+	end_box(mux);
+}
+
+static void write_stbl(struct mp4_mux *mux, struct mp4_track *track)
+{
+	start_box(mux, "stbl");
+
+	start_full_box(mux, "stsd", 0, 0);
+	s_wb32(&mux->s, 1);
+	if (track->type == OBS_ENCODER_VIDEO)
+		write_avc1(mux, track);
+	else
+		write_mp4a(mux, track);
+	end_box(mux);
+
+	/* the samples are all in the fragments, so the tables are empty */
+	start_full_box(mux, "stts", 0, 0);
+	s_wb32(&mux->s, 0);
+	end_box(mux);
+
+	start_full_box(mux, "stsc", 0, 0);
+	s_wb32(&mux->s, 0);
+	end_box(mux);
+
+	start_full_box(mux, "stsz", 0, 0);
+	s_wb32(&mux->s, 0);
+	s_wb32(&mux->s, 0);
+	end_box(mux);
+
+	start_full_box(mux, "stco", 0, 0);
+	s_wb32(&mux->s, 0);
+	end_box(mux);
+
+	end_box(mux);
+}
+
+static void write_trak(struct mp4_mux *mux, struct mp4_track *track)
+{
+	start_box(mux, "trak");
+	write_tkhd(mux, track);
+
+	start_box(mux, "mdia");
+	write_mdhd(mux, track);
+	write_hdlr(mux, track);
+
+	start_box(mux, "minf");
+	if (track->type == OBS_ENCODER_VIDEO) {
+		start_full_box(mux, "vmhd", 0, 0x1);
+		write_zeros(mux, 8);
+		end_box(mux);
+	} else {
+		start_full_box(mux, "smhd", 0, 0);
+		write_zeros(mux, 4);
+		end_box(mux);
+	}
+	write_dinf(mux);
+	write_stbl(mux, track);
+	end_box(mux);
+
+	end_box(mux);
+	end_box(mux);
+}
+
+static void write_moov(struct mp4_mux *mux)
+{
+	start_box(mux, "moov");
+	write_mvhd(mux);
+
+	for (size_t i = 0; i < mux->num_tracks; i++)
+		write_trak(mux, &mux->tracks[i]);
+
+	start_box(mux, "mvex");
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		start_full_box(mux, "trex", 0, 0);
+		s_wb32(&mux->s, mux->tracks[i].track_id);
+		s_wb32(&mux->s, 1);     /* sample description index */
+		s_wb32(&mux->s, 0);
+		s_wb32(&mux->s, 0);
+		s_wb32(&mux->s, 0);
+		end_box(mux);
+	}
+	end_box(mux);
+
+	end_box(mux);
+}
+
+void mp4_mux_write_init(struct mp4_mux *mux, mp4_write_t write, void *param)
+{
+	reset_buffer(mux);
+	write_ftyp(mux);
+	write_moov(mux);
+	write(param, mux->buf.bytes.array, mux->buf.bytes.num);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Fragments */
+
+static inline int64_t to_track_time(struct mp4_track *track,
+		struct encoder_packet *packet, int64_t val)
+{
+	return val * packet->timebase_num * (int64_t)track->timescale /
+		packet->timebase_den;
+}
+
+static inline int64_t get_decode_time(struct mp4_track *track,
+		struct encoder_packet *packet)
+{
+	return to_track_time(track, packet, packet->dts) + track->dts_offset;
+}
+
+static inline bool has_samples(struct mp4_mux *mux)
+{
+	for (size_t i = 0; i < mux->num_tracks; i++)
+		if (mux->tracks[i].samples.num)
+			return true;
+	return false;
+}
+
+/* the end of the last sample of any track, in dts time */
+static int64_t get_fragment_end(struct mp4_mux *mux)
+{
+	int64_t end_usec = mux->fragment_start_usec;
+
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct mp4_track  *track = &mux->tracks[i];
+		struct mp4_sample *last;
+		int64_t           sample_end;
+
+		if (!track->samples.num)
+			continue;
+
+		last = da_end(track->samples);
+		sample_end = last->packet.dts_usec +
+			(int64_t)last->duration * 1000000 / track->timescale;
+
+		if (sample_end > end_usec)
+			end_usec = sample_end;
+	}
+
+	return end_usec;
+}
+
+static inline uint32_t get_sample_flags(struct encoder_packet *packet)
+{
+	if (packet->type == OBS_ENCODER_AUDIO || packet->keyframe)
+		return SAMPLE_FLAGS_SYNC;
+	return SAMPLE_FLAGS_NON_SYNC;
+}
+
+static void write_traf(struct mp4_mux *mux, struct mp4_track *track,
+		size_t *data_offset_pos)
+{
+	bool     video = track->type == OBS_ENCODER_VIDEO;
+	uint32_t flags = TRUN_DATA_OFFSET | TRUN_SAMPLE_DURATION |
+		TRUN_SAMPLE_SIZE | TRUN_SAMPLE_FLAGS;
+
+	if (video)
+		flags |= TRUN_SAMPLE_CTO;
+
+	start_box(mux, "traf");
+
+	start_full_box(mux, "tfhd", 0, TFHD_DEFAULT_BASE_IS_MOOF);
+	s_wb32(&mux->s, track->track_id);
+	end_box(mux);
+
+	start_full_box(mux, "tfdt", 1, 0);
+	s_wb64(&mux->s, (uint64_t)get_decode_time(track,
+				&track->samples.array[0].packet));
+	end_box(mux);
+
+	start_full_box(mux, "trun", 0, flags);
+	s_wb32(&mux->s, (uint32_t)track->samples.num);
+	*data_offset_pos = mux->buf.bytes.num;
+	s_wb32(&mux->s, 0);
+
+	for (size_t i = 0; i < track->samples.num; i++) {
+		struct mp4_sample     *sample = &track->samples.array[i];
+		struct encoder_packet *packet = &sample->packet;
+
+		s_wb32(&mux->s, sample->duration);
+		s_wb32(&mux->s, (uint32_t)packet->size);
+		s_wb32(&mux->s, get_sample_flags(packet));
+
+		if (video) {
+			int64_t cto = to_track_time(track, packet,
+					packet->pts - packet->dts);
+			s_wb32(&mux->s, cto > 0 ? (uint32_t)cto : 0);
+		}
+	}
+
+	end_box(mux);
+	end_box(mux);
+}
+
+static void write_fragment(struct mp4_mux *mux)
+{
+	size_t   data_offset_pos[MP4_MAX_TRACKS];
+	size_t   moof_size;
+	uint64_t data_size = 0;
+	int64_t  end_usec;
+
+	if (!has_samples(mux))
+		return;
+
+	end_usec = get_fragment_end(mux);
+
+	if (mux->begin_fragment)
+		mux->begin_fragment(mux->param, mux->fragment_start_usec);
+
+	if (!mux->initialized) {
+		if (mux->write_init)
+			mp4_mux_write_init(mux, mux->write, mux->param);
+		mux->initialized = true;
+	}
+
+	reset_buffer(mux);
+
+	start_box(mux, "moof");
+
+	start_full_box(mux, "mfhd", 0, 0);
+	s_wb32(&mux->s, ++mux->sequence);
+	end_box(mux);
+
+	for (size_t i = 0; i < mux->num_tracks; i++)
+		if (mux->tracks[i].samples.num)
+			write_traf(mux, &mux->tracks[i], &data_offset_pos[i]);
+
+	end_box(mux);
+
+	/* sample data offsets are relative to the start of the moof, and the
+	 * data of each track follows the mdat header in track order */
+	moof_size = mux->buf.bytes.num;
+
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct mp4_track *track = &mux->tracks[i];
+
+		if (!track->samples.num)
+			continue;
+
+		set_wb32(mux, data_offset_pos[i],
+				(uint32_t)(moof_size + 8 + data_size));
+
+		for (size_t j = 0; j < track->samples.num; j++)
+			data_size += track->samples.array[j].packet.size;
+	}
+
+	s_wb32(&mux->s, (uint32_t)(data_size + 8));
+	s_write(&mux->s, "mdat", 4);
+
+	mux->write(mux->param, mux->buf.bytes.array, mux->buf.bytes.num);
+
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct mp4_track *track = &mux->tracks[i];
+
+		for (size_t j = 0; j < track->samples.num; j++) {
+			struct encoder_packet *packet =
+				&track->samples.array[j].packet;
+
+			mux->write(mux->param, packet->data, packet->size);
+			obs_encoder_packet_release(packet);
+		}
+
+		da_resize(track->samples, 0);
+	}
+
+	if (mux->end_fragment)
+		mux->end_fragment(mux->param, end_usec);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static struct mp4_track *find_track(struct mp4_mux *mux,
+		struct encoder_packet *packet)
+{
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct mp4_track *track = &mux->tracks[i];
+
+		if (track->type != packet->type)
+			continue;
+		if (track->type == OBS_ENCODER_VIDEO ||
+		    track->mix_idx == packet->track_idx)
+			return track;
+	}
+
+	return NULL;
+}
+
+static void start_track(struct mp4_mux *mux, struct mp4_track *track,
+		struct encoder_packet *packet)
+{
+	if (!mux->started) {
+		mux->started             = true;
+		mux->start_usec          = packet->dts_usec;
+		mux->fragment_start_usec = packet->dts_usec;
+	}
+
+	/* decode times start at 0 for the earliest packet while keeping the
+	 * tracks in sync */
+	track->dts_offset = -to_track_time(track, packet, packet->dts);
+	if (packet->dts_usec > mux->start_usec)
+		track->dts_offset += (packet->dts_usec - mux->start_usec) *
+			(int64_t)track->timescale / 1000000;
+
+	track->started = true;
+}
+
+/* the duration of a sample is only known once the next sample of the track
+ * arrives, so each track holds back one packet */
+static void add_pending(struct mp4_track *track, uint32_t duration)
+{
+	struct mp4_sample *sample = da_push_back_new(track->samples);
+
+	if (!duration)
+		duration = track->last_duration ? track->last_duration : 1;
+
+	sample->packet      = track->pending;
+	sample->duration    = duration;
+	track->last_duration = duration;
+	track->has_pending  = false;
+}
+
+static bool has_video_track(struct mp4_mux *mux)
+{
+	return mux->num_tracks &&
+		mux->tracks[0].type == OBS_ENCODER_VIDEO;
+}
+
+void mp4_mux_packet(struct mp4_mux *mux, struct encoder_packet *packet)
+{
+	struct mp4_track *track = find_track(mux, packet);
+	bool             cut_point;
+
+	if (!track || !packet->size)
+		return;
+
+	if (!track->started)
+		start_track(mux, track, packet);
+
+	if (track->has_pending) {
+		int64_t duration = get_decode_time(track, packet) -
+			get_decode_time(track, &track->pending);
+		add_pending(track, duration > 0 ? (uint32_t)duration : 0);
+	}
+
+	cut_point = has_video_track(mux) ?
+		(packet->type == OBS_ENCODER_VIDEO && packet->keyframe) : true;
+
+	if (cut_point && packet->dts_usec - mux->fragment_start_usec >=
+			mux->fragment_duration_usec) {
+		write_fragment(mux);
+		mux->fragment_start_usec = packet->dts_usec;
+	}
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		obs_avc_packet_ref(&track->pending, packet);
+	else
+		obs_encoder_packet_ref(&track->pending, packet);
+	track->has_pending = true;
+}
+
+void mp4_mux_finish(struct mp4_mux *mux)
+{
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct mp4_track *track = &mux->tracks[i];
+		if (track->has_pending)
+			add_pending(track, 0);
+	}
+
+	write_fragment(mux);
+}
+
+static void add_track(struct mp4_mux *mux, obs_encoder_t *encoder,
+		size_t mix_idx)
+{
+	struct mp4_track *track = &mux->tracks[mux->num_tracks++];
+
+	track->encoder  = encoder;
+	track->type     = obs_encoder_get_type(encoder);
+	track->mix_idx  = mix_idx;
+	track->track_id = (uint32_t)mux->num_tracks;
+
+	if (track->type == OBS_ENCODER_VIDEO) {
+		const struct video_output_info *voi =
+			video_output_get_info(obs_encoder_video(encoder));
+		track->timescale = voi->fps_num;
+	} else {
+		track->timescale = audio_output_get_sample_rate(
+				obs_encoder_audio(encoder));
+	}
+}
+
+void mp4_mux_init(struct mp4_mux *mux, obs_output_t *output,
+		int64_t fragment_duration_usec, bool write_init,
+		mp4_write_t write, mp4_fragment_t begin_fragment,
+		mp4_fragment_t end_fragment, void *param)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(output);
+
+	memset(mux, 0, sizeof(*mux));
+	mux->output                 = output;
+	mux->fragment_duration_usec = fragment_duration_usec;
+	mux->write_init             = write_init;
+	mux->write                  = write;
+	mux->begin_fragment         = begin_fragment;
+	mux->end_fragment           = end_fragment;
+	mux->param                  = param;
+
+	array_output_serializer_init(&mux->s, &mux->buf);
+
+	if (vencoder)
+		add_track(mux, vencoder, 0);
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_encoder_t *aencoder = obs_output_get_audio_encoder(output,
+				i);
+		if (!aencoder)
+			break;
+
+		add_track(mux, aencoder, i);
+	}
+}
+
+void mp4_mux_free(struct mp4_mux *mux)
+{
+	for (size_t i = 0; i < mux->num_tracks; i++) {
+		struct mp4_track *track = &mux->tracks[i];
+
+		for (size_t j = 0; j < track->samples.num; j++)
+			obs_encoder_packet_release(
+					&track->samples.array[j].packet);
+		if (track->has_pending)
+			obs_encoder_packet_release(&track->pending);
+
+		da_free(track->samples);
+	}
+
+	array_output_serializer_free(&mux->buf);
+	da_free(mux->box_stack);
+	mux->num_tracks = 0;
+}
@@ -0,0 +1,125 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+#include <util/darray.h>
+#include <util/serializer.h>
+#include <util/array-serializer.h>
+
+/*
+ *   Fragmented MP4 muxer for H.264 and AAC.
+ *
+ *   Packets are collected per track and written out as a self-contained
+ * fragment (moof + mdat) once a video keyframe arrives after the fragment
+ * duration has passed.  Every fragment that has been written is playable
+ * even if the file is never finished, as the moov box at the start of the
+ * file does not depend on the samples.
+ *
+ *   The muxer keeps references to the packets rather than copying them, and
+ * the sample tables and box buffers are reused from fragment to fragment.
+ * Video packets that have not been converted to AVC format yet are converted
+ * when referenced, which allocates a new packet, so memory is still allocated
+ * per packet in that case.
+ *
+ *   Like the FLV muxer, the sample descriptions are hard-coded: the video
+ * track is always written as H.264 (avc1) and the audio tracks as AAC (mp4a),
+ * so other codecs are not supported.
+ */
+
+#define MP4_MAX_TRACKS (1 + MAX_AUDIO_MIXES)
+
+typedef void (*mp4_write_t)(void *param, const void *data, size_t size);
+
+/**
+ * Called before each fragment is written with the dts time of its start, and
+ * after its data has been written with the end time of its last sample
+ */
+typedef void (*mp4_fragment_t)(void *param, int64_t time_usec);
+
+struct mp4_sample {
+	struct encoder_packet packet;
+	uint32_t              duration;
+};
+
+struct mp4_track {
+	enum obs_encoder_type type;
+	obs_encoder_t         *encoder;
+	size_t                mix_idx;
+	uint32_t              track_id;
+	uint32_t              timescale;
+
+	bool                  started;
+	int64_t               dts_offset;
+	uint32_t              last_duration;
+
+	bool                  has_pending;
+	struct encoder_packet pending;
+	DARRAY(struct mp4_sample) samples;
+};
+
+struct mp4_mux {
+	obs_output_t             *output;
+	struct mp4_track         tracks[MP4_MAX_TRACKS];
+	size_t                   num_tracks;
+
+	int64_t                  fragment_duration_usec;
+	int64_t                  fragment_start_usec;
+	int64_t                  start_usec;
+	bool                     started;
+	uint32_t                 sequence;
+	bool                     initialized;
+	bool                     write_init;
+
+	mp4_write_t              write;
+	mp4_fragment_t           begin_fragment;
+	mp4_fragment_t           end_fragment;
+	void                     *param;
+
+	struct serializer        s;
+	struct array_output_data buf;
+	DARRAY(size_t)           box_stack;
+};
+
+/**
+ * Sets up a muxer for the encoders of an output.  If write_init is set, the
+ * initialization boxes (ftyp + moov) are written before the first fragment,
+ * otherwise they are only written by mp4_mux_write_init.
+ */
+extern void mp4_mux_init(struct mp4_mux *mux, obs_output_t *output,
+		int64_t fragment_duration_usec, bool write_init,
+		mp4_write_t write, mp4_fragment_t begin_fragment,
+		mp4_fragment_t end_fragment, void *param);
+extern void mp4_mux_free(struct mp4_mux *mux);
+
+/**
+ * Adds a reference to a packet, which may write out a fragment.  Video
+ * packets are converted to length prefixed NAL units.
+ */
+extern void mp4_mux_packet(struct mp4_mux *mux,
+		struct encoder_packet *packet);
+
+/** Writes out all remaining packets as a final fragment */
+extern void mp4_mux_finish(struct mp4_mux *mux);
+
+/**
+ * Writes the initialization boxes through the given writer, only valid once
+ * the first fragment has begun
+ */
+extern void mp4_mux_write_init(struct mp4_mux *mux, mp4_write_t write,
+		void *param);
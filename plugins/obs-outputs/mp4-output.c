@@ -0,0 +1,206 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <util/dstr.h>
+#include <inttypes.h>
+#include "file-writer.h"
+#include "mp4-mux.h"
+
+#define do_log(level, format, ...) \
+	blog(level, "[mp4 output: '%s'] " format, \
+			obs_output_get_name(stream->output), ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+#define OPT_FRAGMENT_DURATION "fragment_duration_sec"
+
+/*
+ *   Records to a fragmented MP4 file.  Each fragment is written to the file
+ * as soon as it is complete, so if the program or the system goes down, the
+ * file can still be played up to the last finished fragment, without any
+ * remuxing.
+ */
+
+struct mp4_output {
+	obs_output_t   *output;
+	struct dstr    path;
+	file_writer_t  *writer;
+	bool           active;
+
+	/* only used on the writer thread */
+	struct mp4_mux mux;
+	file_writer_t  *cur_writer;
+};
+
+static const char *mp4_output_getname(void)
+{
+	return obs_module_text("MP4Output");
+}
+
+static void mp4_output_stop(void *data);
+
+static void mp4_output_destroy(void *data)
+{
+	struct mp4_output *stream = data;
+
+	if (stream->active)
+		mp4_output_stop(data);
+
+	dstr_free(&stream->path);
+	bfree(stream);
+}
+
+static void *mp4_output_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct mp4_output *stream = bzalloc(sizeof(struct mp4_output));
+	stream->output = output;
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+}
+
+static void mp4_output_stop(void *data)
+{
+	struct mp4_output *stream = data;
+
+	if (stream->active) {
+		struct file_writer_stats stats;
+
+		obs_output_end_data_capture(stream->output);
+
+		if (!file_writer_close(stream->writer, &stats))
+			warn("Errors occurred while writing the file");
+		stream->writer = NULL;
+
+		mp4_mux_free(&stream->mux);
+		stream->active = false;
+
+		info("MP4 file output complete: %u fragments, "
+				"write latency avg %"PRIu64" us, "
+				"max %"PRIu64" us",
+				stream->mux.sequence,
+				stats.avg_write_ns / 1000,
+				stats.max_write_ns / 1000);
+	}
+}
+
+static void write_data(void *data, const void *buf, size_t size)
+{
+	struct mp4_output *stream = data;
+	file_writer_write(stream->cur_writer, buf, size);
+}
+
+/* called on the writer thread */
+static void mux_packet(void *data, file_writer_t *fw,
+		struct encoder_packet *packet)
+{
+	struct mp4_output *stream   = data;
+	uint32_t          sequence = stream->mux.sequence;
+
+	stream->cur_writer = fw;
+
+	if (packet)
+		mp4_mux_packet(&stream->mux, packet);
+	else
+		mp4_mux_finish(&stream->mux);
+
+	/* get every finished fragment in to the file right away */
+	if (stream->mux.sequence != sequence)
+		file_writer_flush(fw);
+}
+
+static bool mp4_output_start(void *data)
+{
+	struct mp4_output *stream = data;
+	struct file_writer_options options = {0};
+	obs_data_t *settings;
+	int64_t fragment_duration;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	settings = obs_output_get_settings(stream->output);
+	dstr_copy(&stream->path, obs_data_get_string(settings, "path"));
+	fragment_duration =
+		obs_data_get_int(settings, OPT_FRAGMENT_DURATION) * 1000000;
+	obs_data_release(settings);
+
+	mp4_mux_init(&stream->mux, stream->output, fragment_duration, true,
+			write_data, NULL, NULL, stream);
+
+	stream->writer = file_writer_create(stream->path.array, &options,
+			mux_packet, stream);
+	if (!stream->writer) {
+		warn("Unable to open MP4 file '%s'", stream->path.array);
+		mp4_mux_free(&stream->mux);
+		return false;
+	}
+
+	stream->active = true;
+	obs_output_begin_data_capture(stream->output, 0);
+
+	info("Writing MP4 file '%s'...", stream->path.array);
+	return true;
+}
+
+static void mp4_output_data(void *data, struct encoder_packet *packet)
+{
+	struct mp4_output     *stream = data;
+	struct encoder_packet new_packet;
+
+	obs_encoder_packet_ref(&new_packet, packet);
+	file_writer_push(stream->writer, &new_packet);
+}
+
+static void mp4_output_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_FRAGMENT_DURATION, 2);
+}
+
+static obs_properties_t *mp4_output_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_text(props, "path",
+			obs_module_text("MP4Output.FilePath"),
+			OBS_TEXT_DEFAULT);
+	obs_properties_add_int(props, OPT_FRAGMENT_DURATION,
+			obs_module_text("MP4Output.FragmentDuration"),
+			1, 60, 1);
+	return props;
+}
+
+struct obs_output_info mp4_output_info = {
+	.id             = "mp4_output",
+	.flags          = OBS_OUTPUT_AV |
+	                  OBS_OUTPUT_ENCODED |
+	                  OBS_OUTPUT_MULTI_TRACK,
+	.get_name       = mp4_output_getname,
+	.create         = mp4_output_create,
+	.destroy        = mp4_output_destroy,
+	.start          = mp4_output_start,
+	.stop           = mp4_output_stop,
+	.encoded_packet = mp4_output_data,
+	.get_defaults   = mp4_output_defaults,
+	.get_properties = mp4_output_properties
+};
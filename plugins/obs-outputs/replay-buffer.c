@@ -0,0 +1,523 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <stdio.h>
+#include <time.h>
+#include <obs-module.h>
+#include <obs-avc.h>
+#include <util/platform.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include <inttypes.h>
+#include "flv-mux.h"
+
+#define do_log(level, format, ...) \
+	blog(level, "[replay buffer: '%s'] " format, \
+			obs_output_get_name(rb->output), ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+/*
+ *   Keeps the last few seconds of encoded packets in memory.  Packets are
+ * referenced rather than copied, and the sequence numbers of video keyframes
+ * are indexed so that whole GOPs can be pruned from the front of the buffer
+ * and a save always starts on a keyframe.  Saving references the buffered
+ * packets and muxes them to an FLV file on a separate thread, so the
+ * encoders never stop.
+ */
+
+struct replay_buffer {
+	obs_output_t          *output;
+	bool                  active;
+
+	pthread_mutex_t       mutex;
+	struct circlebuf      packets;
+	struct circlebuf      keyframes;
+	uint64_t              first_seq;
+	uint64_t              next_seq;
+	size_t                total_bytes;
+
+	int64_t               max_time_usec;
+	size_t                max_size;
+	struct dstr           directory;
+
+	/* saves can be requested from any thread through the save proc, and
+	 * save_mutex serializes them */
+	pthread_mutex_t       save_mutex;
+	pthread_t             save_thread;
+	bool                  save_thread_active;
+	volatile bool         saving;
+	struct dstr           save_path;
+	DARRAY(struct encoder_packet) save_packets;
+};
+
+static const char *replay_buffer_getname(void)
+{
+	return obs_module_text("ReplayBuffer");
+}
+
+static inline struct encoder_packet *get_packet(struct replay_buffer *rb,
+		uint64_t seq)
+{
+	size_t pos = rb->packets.start_pos +
+		(size_t)(seq - rb->first_seq) * sizeof(struct encoder_packet);
+
+	if (pos >= rb->packets.capacity)
+		pos -= rb->packets.capacity;
+
+	return (struct encoder_packet*)((uint8_t*)rb->packets.data + pos);
+}
+
+static inline size_t num_packets(struct replay_buffer *rb)
+{
+	return rb->packets.size / sizeof(struct encoder_packet);
+}
+
+static inline size_t num_keyframes(struct replay_buffer *rb)
+{
+	return rb->keyframes.size / sizeof(uint64_t);
+}
+
+static inline uint64_t get_keyframe(struct replay_buffer *rb, size_t idx)
+{
+	size_t pos = rb->keyframes.start_pos + idx * sizeof(uint64_t);
+
+	if (pos >= rb->keyframes.capacity)
+		pos -= rb->keyframes.capacity;
+
+	return *(uint64_t*)((uint8_t*)rb->keyframes.data + pos);
+}
+
+static void pop_packet(struct replay_buffer *rb)
+{
+	struct encoder_packet packet;
+
+	circlebuf_pop_front(&rb->packets, &packet, sizeof(packet));
+	rb->total_bytes -= packet.size;
+	rb->first_seq++;
+
+	if (num_keyframes(rb) && get_keyframe(rb, 0) < rb->first_seq)
+		circlebuf_pop_front(&rb->keyframes, NULL, sizeof(uint64_t));
+
+	obs_encoder_packet_release(&packet);
+}
+
+static void free_packets(struct replay_buffer *rb)
+{
+	while (num_packets(rb))
+		pop_packet(rb);
+
+	circlebuf_free(&rb->packets);
+	circlebuf_free(&rb->keyframes);
+	rb->total_bytes = 0;
+}
+
+static inline bool buffer_exceeded(struct replay_buffer *rb)
+{
+	struct encoder_packet *first;
+	struct encoder_packet *last;
+
+	if (rb->max_size && rb->total_bytes > rb->max_size)
+		return true;
+
+	first = get_packet(rb, rb->first_seq);
+	last  = get_packet(rb, rb->next_seq - 1);
+	return last->dts_usec - first->dts_usec > rb->max_time_usec;
+}
+
+/* drops whole GOPs from the front while the buffer is over its limits, but
+ * always keeps at least the most recent one */
+static void prune_packets(struct replay_buffer *rb)
+{
+	while (num_keyframes(rb) > 1 && buffer_exceeded(rb)) {
+		uint64_t next_keyframe = get_keyframe(rb, 1);
+
+		while (rb->first_seq < next_keyframe)
+			pop_packet(rb);
+	}
+}
+
+static void replay_buffer_update(void *data, obs_data_t *settings)
+{
+	struct replay_buffer *rb = data;
+	int64_t max_time = obs_data_get_int(settings, "max_time_sec");
+	int64_t max_size = obs_data_get_int(settings, "max_size_mb");
+
+	pthread_mutex_lock(&rb->mutex);
+	rb->max_time_usec = max_time * 1000000;
+	rb->max_size      = (size_t)max_size * 1024 * 1024;
+	dstr_copy(&rb->directory, obs_data_get_string(settings, "directory"));
+	pthread_mutex_unlock(&rb->mutex);
+}
+
+static void replay_buffer_stop(void *data);
+static void replay_buffer_save_proc(void *data, calldata_t *cd);
+
+static void replay_buffer_destroy(void *data)
+{
+	struct replay_buffer *rb = data;
+
+	if (rb->active)
+		replay_buffer_stop(data);
+	if (rb->save_thread_active)
+		pthread_join(rb->save_thread, NULL);
+
+	free_packets(rb);
+	dstr_free(&rb->directory);
+	dstr_free(&rb->save_path);
+	pthread_mutex_destroy(&rb->mutex);
+	pthread_mutex_destroy(&rb->save_mutex);
+	bfree(rb);
+}
+
+static void *replay_buffer_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct replay_buffer *rb = bzalloc(sizeof(struct replay_buffer));
+	proc_handler_t       *ph = obs_output_get_proc_handler(output);
+	signal_handler_t     *sh = obs_output_get_signal_handler(output);
+
+	rb->output = output;
+	pthread_mutex_init_value(&rb->mutex);
+	pthread_mutex_init_value(&rb->save_mutex);
+
+	if (pthread_mutex_init(&rb->mutex, NULL) != 0) {
+		bfree(rb);
+		return NULL;
+	}
+	if (pthread_mutex_init(&rb->save_mutex, NULL) != 0) {
+		pthread_mutex_destroy(&rb->mutex);
+		bfree(rb);
+		return NULL;
+	}
+
+	proc_handler_add(ph, "void save(in string path)",
+			replay_buffer_save_proc, rb);
+	signal_handler_add(sh, "void saved(ptr output, string path)");
+
+	replay_buffer_update(rb, settings);
+	return rb;
+}
+
+static void replay_buffer_defaults(obs_data_t *settings)
+{
+	obs_data_set_default_int(settings, "max_time_sec", 20);
+	obs_data_set_default_int(settings, "max_size_mb",  512);
+}
+
+static bool replay_buffer_start(void *data)
+{
+	struct replay_buffer *rb = data;
+
+	if (!obs_output_can_begin_data_capture(rb->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(rb->output, 0))
+		return false;
+
+	rb->active = true;
+	obs_output_begin_data_capture(rb->output, 0);
+
+	info("Replay buffer started");
+	return true;
+}
+
+static void replay_buffer_stop(void *data)
+{
+	struct replay_buffer *rb = data;
+
+	if (rb->active) {
+		obs_output_end_data_capture(rb->output);
+		rb->active = false;
+
+		pthread_mutex_lock(&rb->mutex);
+		free_packets(rb);
+		pthread_mutex_unlock(&rb->mutex);
+
+		info("Replay buffer stopped");
+	}
+}
+
+static void replay_buffer_data(void *data, struct encoder_packet *packet)
+{
+	struct replay_buffer  *rb = data;
+	struct encoder_packet ref;
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		obs_avc_packet_ref(&ref, packet);
+	else
+		obs_encoder_packet_ref(&ref, packet);
+
+	pthread_mutex_lock(&rb->mutex);
+
+	/* nothing is buffered until the first keyframe */
+	if (!num_keyframes(rb) && !(ref.type == OBS_ENCODER_VIDEO &&
+				ref.keyframe)) {
+		pthread_mutex_unlock(&rb->mutex);
+		obs_encoder_packet_release(&ref);
+		return;
+	}
+
+	if (ref.type == OBS_ENCODER_VIDEO && ref.keyframe)
+		circlebuf_push_back(&rb->keyframes, &rb->next_seq,
+				sizeof(uint64_t));
+
+	if (!num_packets(rb))
+		rb->first_seq = rb->next_seq;
+
+	circlebuf_push_back(&rb->packets, &ref, sizeof(ref));
+	rb->total_bytes += ref.size;
+	rb->next_seq++;
+
+	prune_packets(rb);
+
+	pthread_mutex_unlock(&rb->mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void write_packet(FILE *file, struct encoder_packet *packet,
+		bool is_header)
+{
+	struct flv_tag tag;
+
+	if (flv_packet_tag(packet, &tag, is_header))
+		flv_write_tag(file, &tag);
+}
+
+static void write_headers(struct replay_buffer *rb, FILE *file)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(rb->output);
+	obs_encoder_t *aencoder = obs_output_get_audio_encoder(rb->output, 0);
+	uint8_t       *meta_data;
+	size_t        meta_data_size;
+	uint8_t       *header;
+	size_t        size;
+
+	struct encoder_packet audio = {
+		.type         = OBS_ENCODER_AUDIO,
+		.timebase_den = 1
+	};
+	struct encoder_packet video = {
+		.type         = OBS_ENCODER_VIDEO,
+		.timebase_den = 1,
+		.keyframe     = true
+	};
+
+	flv_meta_data(rb->output, &meta_data, &meta_data_size, true, 0);
+	fwrite(meta_data, 1, meta_data_size, file);
+	bfree(meta_data);
+
+	obs_encoder_get_extra_data(aencoder, &header, &audio.size);
+	audio.data = header;
+	write_packet(file, &audio, true);
+
+	obs_encoder_get_extra_data(vencoder, &header, &size);
+	video.size = obs_parse_avc_header(&video.data, header, size);
+	write_packet(file, &video, true);
+	bfree(video.data);
+}
+
+/* rebases a packet so that the saved file starts at the first keyframe */
+static inline void offset_packet(struct encoder_packet *packet,
+		int64_t start_usec)
+{
+	int64_t offset = start_usec * packet->timebase_den /
+		((int64_t)packet->timebase_num * 1000000);
+
+	packet->dts -= offset;
+	packet->pts -= offset;
+}
+
+static void *save_thread(void *data)
+{
+	struct replay_buffer  *rb = data;
+	struct encoder_packet *packets = rb->save_packets.array;
+	size_t                count = rb->save_packets.num;
+	int64_t               start_usec = packets[0].dts_usec;
+	int64_t               last_ms = 0;
+	struct calldata       params = {0};
+	FILE                  *file;
+
+	os_set_thread_name("replay buffer: save thread");
+
+	file = os_fopen(rb->save_path.array, "wb");
+	if (!file) {
+		warn("Unable to open replay file '%s'", rb->save_path.array);
+		goto free;
+	}
+
+	write_headers(rb, file);
+
+	for (size_t i = 0; i < count; i++) {
+		struct encoder_packet packet = packets[i];
+
+		/* skip audio from before the first keyframe */
+		if (packet.dts_usec < start_usec)
+			continue;
+
+		offset_packet(&packet, start_usec);
+		last_ms = get_ms_time(&packet, packet.dts);
+		write_packet(file, &packet, false);
+	}
+
+	write_file_info(file, last_ms, os_ftelli64(file));
+	fclose(file);
+
+	info("Saved replay to '%s'", rb->save_path.array);
+
+	calldata_set_ptr(&params, "output", rb->output);
+	calldata_set_string(&params, "path", rb->save_path.array);
+	signal_handler_signal(obs_output_get_signal_handler(rb->output),
+			"saved", &params);
+	calldata_free(&params);
+
+free:
+	for (size_t i = 0; i < count; i++)
+		obs_encoder_packet_release(&packets[i]);
+	da_free(rb->save_packets);
+
+	rb->saving = false;
+	return NULL;
+}
+
+static void generate_save_path(struct replay_buffer *rb, struct dstr *path)
+{
+	char      name[64];
+	time_t    now = time(NULL);
+	struct tm *cur_time = localtime(&now);
+
+	strftime(name, sizeof(name), "Replay %Y-%m-%d %H-%M-%S.flv",
+			cur_time);
+
+	dstr_copy_dstr(path, &rb->directory);
+	dstr_replace(path, "\\", "/");
+	if (path->len && dstr_end(path) != '/')
+		dstr_cat_ch(path, '/');
+	dstr_cat(path, name);
+}
+
+/* called with save_mutex locked */
+static bool start_save(struct replay_buffer *rb, const char *path)
+{
+	if (!rb->active || rb->saving) {
+		warn("Cannot save replay: %s", rb->saving ?
+				"a save is already in progress" :
+				"the replay buffer is not active");
+		return false;
+	}
+
+	if (rb->save_thread_active) {
+		pthread_join(rb->save_thread, NULL);
+		rb->save_thread_active = false;
+	}
+
+	pthread_mutex_lock(&rb->mutex);
+
+	if (!num_keyframes(rb)) {
+		pthread_mutex_unlock(&rb->mutex);
+		warn("Cannot save replay: nothing has been buffered yet");
+		return false;
+	}
+
+	if (path && *path) {
+		dstr_copy(&rb->save_path, path);
+	} else if (!dstr_is_empty(&rb->directory)) {
+		generate_save_path(rb, &rb->save_path);
+	} else {
+		pthread_mutex_unlock(&rb->mutex);
+		warn("Cannot save replay: no path was given and no directory "
+		     "is set");
+		return false;
+	}
+
+	/* the buffer always starts on a keyframe, and the packets are only
+	 * referenced, so this only costs a copy of the packet array */
+	da_reserve(rb->save_packets, num_packets(rb));
+	for (uint64_t seq = rb->first_seq; seq < rb->next_seq; seq++) {
+		struct encoder_packet *ref = da_push_back_new(rb->save_packets);
+		obs_encoder_packet_ref(ref, get_packet(rb, seq));
+	}
+
+	pthread_mutex_unlock(&rb->mutex);
+
+	rb->saving = true;
+	if (pthread_create(&rb->save_thread, NULL, save_thread, rb) != 0) {
+		warn("Failed to create save thread");
+
+		for (size_t i = 0; i < rb->save_packets.num; i++)
+			obs_encoder_packet_release(rb->save_packets.array + i);
+		da_free(rb->save_packets);
+
+		rb->saving = false;
+		return false;
+	}
+
+	rb->save_thread_active = true;
+	return true;
+}
+
+/**
+ * Saves the buffered packets to a file.  If path is NULL or empty, a file
+ * name is generated from the current time in the configured directory.
+ */
+static bool replay_buffer_save(struct replay_buffer *rb, const char *path)
+{
+	bool success;
+
+	pthread_mutex_lock(&rb->save_mutex);
+	success = start_save(rb, path);
+	pthread_mutex_unlock(&rb->save_mutex);
+
+	return success;
+}
+
+static void replay_buffer_save_proc(void *data, calldata_t *cd)
+{
+	replay_buffer_save(data, calldata_string(cd, "path"));
+}
+
+static obs_properties_t *replay_buffer_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_int(props, "max_time_sec",
+			obs_module_text("ReplayBuffer.MaxTime"), 1, 3600, 1);
+	obs_properties_add_int(props, "max_size_mb",
+			obs_module_text("ReplayBuffer.MaxSize"), 0, 8192, 1);
+	obs_properties_add_path(props, "directory",
+			obs_module_text("ReplayBuffer.Directory"),
+			OBS_PATH_DIRECTORY, NULL, NULL);
+	return props;
+}
+
+struct obs_output_info replay_buffer_info = {
+	.id             = "replay_buffer",
+	.flags          = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED,
+	.get_name       = replay_buffer_getname,
+	.create         = replay_buffer_create,
+	.destroy        = replay_buffer_destroy,
+	.start          = replay_buffer_start,
+	.stop           = replay_buffer_stop,
+	.encoded_packet = replay_buffer_data,
+	.update         = replay_buffer_update,
+	.get_defaults   = replay_buffer_defaults,
+	.get_properties = replay_buffer_properties
+};
@@ -0,0 +1,656 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <obs-avc.h>
+#include <util/platform.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include <inttypes.h>
+#include "librtmp/rtmp.h"
+#include "librtmp/log.h"
+#include "rtmp-send.h"
+
+#define do_log(level, format, ...) \
+	blog(level, "[rtmp multi: '%s'] " format, \
+			obs_output_get_name(multi->output), ##__VA_ARGS__)
+
+#define warn(format, ...)  do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...)  do_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+#define target_log(level, format, ...) \
+	do_log(level, "[%d: %s] " format, (int)target->idx, \
+			target->path.array, ##__VA_ARGS__)
+
+#define target_warn(format, ...) \
+	target_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define target_info(format, ...) \
+	target_log(LOG_INFO,    format, ##__VA_ARGS__)
+
+#define OPT_DESTINATIONS   "destinations"
+#define OPT_DROP_THRESHOLD "drop_threshold_ms"
+#define OPT_RETRY_DELAY    "retry_delay_sec"
+#define OPT_MAX_RETRIES    "max_retries"
+
+/*
+ *   Sends the same encoded stream to several RTMP servers.
+ *
+ *   Every destination has its own connection, send thread, packet queue and
+ * frame drop state, so a slow or disconnected destination never holds back
+ * the others.  Video packets are parsed once and the parsed data is shared by
+ * reference between all the destination queues.
+ *
+ *   A destination that disconnects is reconnected on its own after a delay,
+ * and resumes at the next video keyframe.  The output itself only stops once
+ * every destination has run out of retries.
+ */
+
+struct rtmp_multi;
+
+struct rtmp_target {
+	struct rtmp_multi *multi;
+	size_t            idx;
+
+	struct dstr       path, key;
+	struct dstr       username, password;
+
+	pthread_t         thread;
+	bool              thread_created;
+	os_sem_t          *send_sem;
+
+	pthread_mutex_t   packets_mutex;
+	struct rtmp_packet_queue queue;
+	volatile bool     connected;
+	bool              wait_keyframe;
+	bool              sent_headers;
+
+	/* statistics */
+	uint64_t          total_bytes_sent;
+	int               reconnects;
+
+	RTMP              rtmp;
+};
+
+struct rtmp_multi {
+	obs_output_t       *output;
+
+	/* the targets array is only changed by start and stop, targets_mutex
+	 * protects it from the stats procs, which can be called any time */
+	pthread_mutex_t    targets_mutex;
+	struct rtmp_target *targets;
+	size_t             num_targets;
+	volatile long      running_targets;
+	volatile long      connections;
+
+	os_event_t         *stop_event;
+
+	unsigned long      retry_delay_ms;
+	int                max_retries;
+};
+
+static const char *rtmp_multi_getname(void)
+{
+	return obs_module_text("RTMPMulti");
+}
+
+static void log_rtmp(int level, const char *format, va_list args)
+{
+	if (level > RTMP_LOGWARNING)
+		return;
+
+	blogva(LOG_INFO, format, args);
+}
+
+static inline void set_rtmp_str(AVal *val, const char *str)
+{
+	bool valid  = (str && *str);
+	val->av_val = valid ? (char*)str       : NULL;
+	val->av_len = valid ? (int)strlen(str) : 0;
+}
+
+static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
+{
+	bool valid  = !dstr_is_empty(str);
+	val->av_val = valid ? str->array    : NULL;
+	val->av_len = valid ? (int)str->len : 0;
+}
+
+/* ------------------------------------------------------------------------- */
+/* Destination packet queues */
+
+static void free_packets(struct rtmp_target *target)
+{
+	pthread_mutex_lock(&target->packets_mutex);
+	rtmp_queue_clear(&target->queue);
+	pthread_mutex_unlock(&target->packets_mutex);
+}
+
+static inline bool get_next_packet(struct rtmp_target *target,
+		struct encoder_packet *packet)
+{
+	bool new_packet;
+
+	pthread_mutex_lock(&target->packets_mutex);
+	new_packet = rtmp_queue_pop(&target->queue, packet);
+	pthread_mutex_unlock(&target->packets_mutex);
+
+	return new_packet;
+}
+
+static bool add_packet(struct rtmp_target *target,
+		struct encoder_packet *packet)
+{
+	/* a destination that just (re)connected starts at a video keyframe */
+	if (target->wait_keyframe) {
+		if (packet->type != OBS_ENCODER_VIDEO || !packet->keyframe)
+			return false;
+		target->wait_keyframe = false;
+	}
+
+	return rtmp_queue_push(&target->queue, packet);
+}
+
+/* ------------------------------------------------------------------------- */
+/* Destination send threads */
+
+static inline int send_packet(struct rtmp_target *target,
+		struct encoder_packet *packet)
+{
+	return rtmp_send_packet(&target->rtmp, packet, false,
+			packet->track_idx, &target->total_bytes_sent);
+}
+
+static inline void send_headers(struct rtmp_target *target)
+{
+	target->sent_headers = true;
+	rtmp_send_headers(&target->rtmp, target->multi->output,
+			&target->total_bytes_sent);
+}
+
+static bool connect_target(struct rtmp_target *target)
+{
+	struct rtmp_multi *multi = target->multi;
+	size_t idx = 0;
+
+	RTMP_Init(&target->rtmp);
+
+	if (!RTMP_SetupURL(&target->rtmp, target->path.array))
+		return false;
+
+	RTMP_EnableWrite(&target->rtmp);
+
+	set_rtmp_dstr(&target->rtmp.Link.pubUser,   &target->username);
+	set_rtmp_dstr(&target->rtmp.Link.pubPasswd, &target->password);
+	target->rtmp.Link.swfUrl = target->rtmp.Link.tcUrl;
+	set_rtmp_str(&target->rtmp.Link.flashVer,
+			"FMLE/3.0 (compatible; FMSc/1.0)");
+
+	RTMP_AddStream(&target->rtmp, target->key.array);
+
+	for (size_t i = 1;; i++) {
+		obs_encoder_t *encoder = obs_output_get_audio_encoder(
+				multi->output, i);
+		if (!encoder)
+			break;
+
+		RTMP_AddStream(&target->rtmp, obs_encoder_get_name(encoder));
+	}
+
+	target->rtmp.m_outChunkSize       = 4096;
+	target->rtmp.m_bSendChunkSizeInfo = true;
+	target->rtmp.m_bUseNagle          = true;
+
+	if (!RTMP_Connect(&target->rtmp, NULL) ||
+	    !RTMP_ConnectStream(&target->rtmp, 0)) {
+		RTMP_Close(&target->rtmp);
+		return false;
+	}
+
+	while (rtmp_send_meta_data(&target->rtmp, multi->output, idx++));
+	return true;
+}
+
+static inline bool stopping(struct rtmp_multi *multi)
+{
+	return os_event_try(multi->stop_event) != EAGAIN;
+}
+
+/* returns false if the connection was lost */
+static bool send_loop(struct rtmp_target *target)
+{
+	struct rtmp_multi *multi = target->multi;
+
+	while (os_sem_wait(target->send_sem) == 0) {
+		struct encoder_packet packet;
+
+		if (stopping(multi))
+			break;
+		if (!get_next_packet(target, &packet))
+			continue;
+
+		if (!target->sent_headers)
+			send_headers(target);
+
+		if (send_packet(target, &packet) < 0)
+			return false;
+	}
+
+	/* flush whatever is left when the user stops the output */
+	if (target->sent_headers) {
+		struct encoder_packet packet;
+
+		while (get_next_packet(target, &packet))
+			if (send_packet(target, &packet) < 0)
+				return false;
+	}
+
+	return true;
+}
+
+static void set_connected(struct rtmp_target *target, bool connected)
+{
+	pthread_mutex_lock(&target->packets_mutex);
+	target->connected     = connected;
+	target->wait_keyframe = true;
+	target->sent_headers  = false;
+
+	target->queue.min_priority      = 0;
+	target->queue.min_drop_dts_usec = 0;
+	pthread_mutex_unlock(&target->packets_mutex);
+}
+
+static void *target_thread(void *data)
+{
+	struct rtmp_target *target = data;
+	struct rtmp_multi  *multi  = target->multi;
+	int                retries = 0;
+
+	for (;;) {
+		target_info("Connecting...");
+
+		if (connect_target(target)) {
+			target_info("Connection successful");
+			retries = 0;
+
+			/* capture begins with the first connection */
+			if (os_atomic_inc_long(&multi->connections) == 1)
+				obs_output_begin_data_capture(multi->output, 0);
+
+			set_connected(target, true);
+			bool lost = !send_loop(target);
+			set_connected(target, false);
+
+			RTMP_Close(&target->rtmp);
+			free_packets(target);
+
+			if (!lost)
+				break;
+
+			target_info("Disconnected");
+		} else {
+			target_warn("Connection failed");
+		}
+
+		if (multi->max_retries && retries++ >= multi->max_retries) {
+			target_warn("Giving up after %d retries",
+					multi->max_retries);
+			break;
+		}
+
+		if (os_event_timedwait(multi->stop_event,
+					multi->retry_delay_ms) != ETIMEDOUT)
+			break;
+
+		target->reconnects++;
+	}
+
+	/* the last destination to give up stops the output.  every
+	 * destination has already used up its own retries, so this must not
+	 * make the output reconnect again */
+	if (os_atomic_dec_long(&multi->running_targets) == 0 &&
+	    !stopping(multi)) {
+		obs_output_signal_stop(multi->output, multi->connections ?
+				OBS_OUTPUT_ERROR :
+				OBS_OUTPUT_CONNECT_FAILED);
+	}
+
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void free_targets(struct rtmp_multi *multi)
+{
+	struct rtmp_target *targets;
+	size_t             num_targets;
+
+	pthread_mutex_lock(&multi->targets_mutex);
+	targets            = multi->targets;
+	num_targets        = multi->num_targets;
+	multi->targets     = NULL;
+	multi->num_targets = 0;
+	pthread_mutex_unlock(&multi->targets_mutex);
+
+	for (size_t i = 0; i < num_targets; i++) {
+		struct rtmp_target *target = &targets[i];
+
+		if (target->thread_created)
+			pthread_join(target->thread, NULL);
+
+		rtmp_queue_free(&target->queue);
+		pthread_mutex_destroy(&target->packets_mutex);
+		os_sem_destroy(target->send_sem);
+		dstr_free(&target->path);
+		dstr_free(&target->key);
+		dstr_free(&target->username);
+		dstr_free(&target->password);
+	}
+
+	bfree(targets);
+}
+
+/* tells every destination thread to stop, they're joined in free_targets.
+ * the destination threads never stop the output themselves, they only
+ * signal it to stop, so this is never called from one of them */
+static void stop_targets(struct rtmp_multi *multi)
+{
+	os_event_signal(multi->stop_event);
+
+	for (size_t i = 0; i < multi->num_targets; i++)
+		if (multi->targets[i].send_sem)
+			os_sem_post(multi->targets[i].send_sem);
+}
+
+static void rtmp_multi_stop(void *data)
+{
+	struct rtmp_multi *multi = data;
+
+	stop_targets(multi);
+	obs_output_end_data_capture(multi->output);
+
+	/* the packet queues are only released once the output is not sending
+	 * packets any more */
+	free_targets(multi);
+	os_event_reset(multi->stop_event);
+}
+
+static void rtmp_multi_destroy(void *data)
+{
+	struct rtmp_multi *multi = data;
+
+	if (multi) {
+		rtmp_multi_stop(multi);
+		os_event_destroy(multi->stop_event);
+		pthread_mutex_destroy(&multi->targets_mutex);
+		bfree(multi);
+	}
+}
+
+static void rtmp_multi_get_stats_proc(void *data, calldata_t *cd);
+
+static void *rtmp_multi_create(obs_data_t *settings, obs_output_t *output)
+{
+	struct rtmp_multi *multi = bzalloc(sizeof(struct rtmp_multi));
+	proc_handler_t    *ph    = obs_output_get_proc_handler(output);
+
+	multi->output = output;
+
+	RTMP_LogSetCallback(log_rtmp);
+	RTMP_LogSetLevel(RTMP_LOGWARNING);
+
+	pthread_mutex_init_value(&multi->targets_mutex);
+
+	if (pthread_mutex_init(&multi->targets_mutex, NULL) != 0) {
+		bfree(multi);
+		return NULL;
+	}
+	if (os_event_init(&multi->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		pthread_mutex_destroy(&multi->targets_mutex);
+		bfree(multi);
+		return NULL;
+	}
+
+	proc_handler_add(ph, "void get_destination_stats(in int index, "
+			"out int total_bytes, out int dropped_frames, "
+			"out int reconnects, out bool connected)",
+			rtmp_multi_get_stats_proc, multi);
+
+	UNUSED_PARAMETER(settings);
+	return multi;
+}
+
+static bool init_target(struct rtmp_multi *multi, struct rtmp_target *target,
+		size_t idx, obs_data_t *dest, int64_t drop_threshold_usec)
+{
+	target->multi = multi;
+	target->idx   = idx;
+
+	rtmp_queue_reset(&target->queue, multi->output, drop_threshold_usec);
+
+	dstr_copy(&target->path,     obs_data_get_string(dest, "server"));
+	dstr_copy(&target->key,      obs_data_get_string(dest, "key"));
+	dstr_copy(&target->username, obs_data_get_string(dest, "username"));
+	dstr_copy(&target->password, obs_data_get_string(dest, "password"));
+
+	if (dstr_is_empty(&target->path)) {
+		warn("Destination %d has no URL", (int)idx);
+		return false;
+	}
+
+	if (pthread_mutex_init(&target->packets_mutex, NULL) != 0)
+		return false;
+	if (os_sem_init(&target->send_sem, 0) != 0)
+		return false;
+
+	return true;
+}
+
+static bool rtmp_multi_start(void *data)
+{
+	struct rtmp_multi *multi = data;
+	obs_data_t        *settings;
+	obs_data_array_t  *dests;
+	int64_t           drop_threshold_usec;
+	bool              success = true;
+
+	if (!obs_output_can_begin_data_capture(multi->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(multi->output, 0))
+		return false;
+
+	/* threads left over from a previous session that stopped itself */
+	free_targets(multi);
+
+	settings = obs_output_get_settings(multi->output);
+	dests    = obs_data_get_array(settings, OPT_DESTINATIONS);
+
+	drop_threshold_usec =
+		(int64_t)obs_data_get_int(settings, OPT_DROP_THRESHOLD) * 1000;
+	multi->retry_delay_ms =
+		(unsigned long)obs_data_get_int(settings, OPT_RETRY_DELAY) *
+		1000;
+	multi->max_retries =
+		(int)obs_data_get_int(settings, OPT_MAX_RETRIES);
+
+	multi->connections     = 0;
+
+	pthread_mutex_lock(&multi->targets_mutex);
+	multi->num_targets     = obs_data_array_count(dests);
+	multi->targets         = bzalloc(sizeof(struct rtmp_target) *
+			multi->num_targets);
+	pthread_mutex_unlock(&multi->targets_mutex);
+
+	if (!multi->num_targets) {
+		warn("No destinations");
+		success = false;
+	}
+
+	for (size_t i = 0; success && i < multi->num_targets; i++) {
+		obs_data_t *dest = obs_data_array_item(dests, i);
+		success = init_target(multi, &multi->targets[i], i, dest,
+				drop_threshold_usec);
+		obs_data_release(dest);
+	}
+
+	obs_data_array_release(dests);
+	obs_data_release(settings);
+
+	multi->running_targets = (long)multi->num_targets;
+
+	for (size_t i = 0; success && i < multi->num_targets; i++) {
+		struct rtmp_target *target = &multi->targets[i];
+
+		if (pthread_create(&target->thread, NULL, target_thread,
+					target) != 0) {
+			warn("Failed to create send thread");
+			success = false;
+			break;
+		}
+
+		target->thread_created = true;
+	}
+
+	if (!success) {
+		stop_targets(multi);
+		free_targets(multi);
+		os_event_reset(multi->stop_event);
+	}
+
+	return success;
+}
+
+static void rtmp_multi_data(void *data, struct encoder_packet *packet)
+{
+	struct rtmp_multi     *multi = data;
+	struct encoder_packet parsed;
+
+	/* parse once, every destination references the same parsed data */
+	if (packet->type == OBS_ENCODER_VIDEO)
+		obs_avc_packet_ref(&parsed, packet);
+	else
+		obs_encoder_packet_ref(&parsed, packet);
+
+	for (size_t i = 0; i < multi->num_targets; i++) {
+		struct rtmp_target    *target = &multi->targets[i];
+		struct encoder_packet new_packet;
+		bool                  added = false;
+
+		if (!target->connected)
+			continue;
+
+		obs_encoder_packet_ref(&new_packet, &parsed);
+
+		pthread_mutex_lock(&target->packets_mutex);
+		if (target->connected)
+			added = add_packet(target, &new_packet);
+		pthread_mutex_unlock(&target->packets_mutex);
+
+		if (added)
+			os_sem_post(target->send_sem);
+		else
+			obs_encoder_packet_release(&new_packet);
+	}
+
+	obs_encoder_packet_release(&parsed);
+}
+
+static void rtmp_multi_get_stats_proc(void *data, calldata_t *cd)
+{
+	struct rtmp_multi  *multi = data;
+	struct rtmp_target *target;
+	size_t             idx = (size_t)calldata_int(cd, "index");
+
+	pthread_mutex_lock(&multi->targets_mutex);
+
+	if (idx < multi->num_targets) {
+		target = &multi->targets[idx];
+		calldata_set_int(cd, "total_bytes",
+				(long long)target->total_bytes_sent);
+		calldata_set_int(cd, "dropped_frames",
+				target->queue.dropped_frames);
+		calldata_set_int(cd, "reconnects", target->reconnects);
+		calldata_set_bool(cd, "connected", target->connected);
+	}
+
+	pthread_mutex_unlock(&multi->targets_mutex);
+}
+
+static void rtmp_multi_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 600);
+	obs_data_set_default_int(defaults, OPT_RETRY_DELAY, 10);
+	obs_data_set_default_int(defaults, OPT_MAX_RETRIES, 20);
+}
+
+static obs_properties_t *rtmp_multi_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+
+	obs_properties_add_int(props, OPT_DROP_THRESHOLD,
+			obs_module_text("RTMPStream.DropThreshold"),
+			200, 10000, 100);
+	obs_properties_add_int(props, OPT_RETRY_DELAY,
+			obs_module_text("RTMPMulti.RetryDelay"), 1, 60, 1);
+	obs_properties_add_int(props, OPT_MAX_RETRIES,
+			obs_module_text("RTMPMulti.MaxRetries"), 0, 10000, 1);
+	return props;
+}
+
+static uint64_t rtmp_multi_total_bytes_sent(void *data)
+{
+	struct rtmp_multi *multi = data;
+	uint64_t          total  = 0;
+
+	pthread_mutex_lock(&multi->targets_mutex);
+	for (size_t i = 0; i < multi->num_targets; i++)
+		total += multi->targets[i].total_bytes_sent;
+	pthread_mutex_unlock(&multi->targets_mutex);
+
+	return total;
+}
+
+static int rtmp_multi_dropped_frames(void *data)
+{
+	struct rtmp_multi *multi = data;
+	int               total  = 0;
+
+	pthread_mutex_lock(&multi->targets_mutex);
+	for (size_t i = 0; i < multi->num_targets; i++)
+		total += multi->targets[i].queue.dropped_frames;
+	pthread_mutex_unlock(&multi->targets_mutex);
+
+	return total;
+}
+
+struct obs_output_info rtmp_multi_info = {
+	.id                 = "rtmp_multi_output",
+	.flags              = OBS_OUTPUT_AV |
+	                      OBS_OUTPUT_ENCODED |
+	                      OBS_OUTPUT_MULTI_TRACK,
+	.get_name           = rtmp_multi_getname,
+	.create             = rtmp_multi_create,
+	.destroy            = rtmp_multi_destroy,
+	.start              = rtmp_multi_start,
+	.stop               = rtmp_multi_stop,
+	.encoded_packet     = rtmp_multi_data,
+	.get_defaults       = rtmp_multi_defaults,
+	.get_properties     = rtmp_multi_properties,
+	.get_total_bytes    = rtmp_multi_total_bytes_sent,
+	.get_dropped_frames = rtmp_multi_dropped_frames
+};
@@ -0,0 +1,385 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <obs-avc.h>
+#include <util/darray.h>
+#include <inttypes.h>
+#include "rtmp-send.h"
+#include "flv-mux.h"
+
+#define debug(format, ...) \
+	blog(LOG_DEBUG, "[rtmp: '%s'] " format, \
+			obs_output_get_name(queue->output), ##__VA_ARGS__)
+
+/* when frames are dropped, enough are dropped to bring the time it takes to
+ * send the buffer down to this percentage of the drop threshold */
+#define DROP_TARGET_PERCENT 50
+
+void rtmp_queue_reset(struct rtmp_packet_queue *queue, obs_output_t *output,
+		int64_t drop_threshold_usec)
+{
+	queue->output              = output;
+	queue->drop_threshold_usec = drop_threshold_usec;
+	queue->min_drop_dts_usec   = 0;
+	queue->min_priority        = 0;
+	queue->last_dts_usec       = 0;
+	queue->dropped_frames      = 0;
+	queue->dropped_bytes       = 0;
+	queue->drop_events         = 0;
+	memset(queue->dropped_priority_frames, 0,
+			sizeof(queue->dropped_priority_frames));
+}
+
+void rtmp_queue_clear(struct rtmp_packet_queue *queue)
+{
+	while (queue->packets.size) {
+		struct encoder_packet packet;
+		circlebuf_pop_front(&queue->packets, &packet, sizeof(packet));
+		obs_encoder_packet_release(&packet);
+	}
+}
+
+void rtmp_queue_free(struct rtmp_packet_queue *queue)
+{
+	rtmp_queue_clear(queue);
+	circlebuf_free(&queue->packets);
+}
+
+bool rtmp_queue_pop(struct rtmp_packet_queue *queue,
+		struct encoder_packet *packet)
+{
+	if (!queue->packets.size)
+		return false;
+
+	circlebuf_pop_front(&queue->packets, packet,
+			sizeof(struct encoder_packet));
+	return true;
+}
+
+int64_t rtmp_queue_duration_usec(struct rtmp_packet_queue *queue)
+{
+	struct encoder_packet first;
+
+	if (!queue->packets.size)
+		return 0;
+
+	circlebuf_peek_front(&queue->packets, &first, sizeof(first));
+	return queue->last_dts_usec - first.dts_usec;
+}
+
+static inline bool add_packet(struct rtmp_packet_queue *queue,
+		struct encoder_packet *packet)
+{
+	circlebuf_push_back(&queue->packets, packet,
+			sizeof(struct encoder_packet));
+	queue->last_dts_usec = packet->dts_usec;
+	return true;
+}
+
+/* Frame dropping
+ *
+ *   When the buffered packets span more than the drop threshold, the smallest
+ * set of video frames that brings the time it takes to send the buffer under
+ * the drop target is removed.  That time is taken to be proportional to the
+ * size of the buffer, so the number of bytes to remove follows from the ratio
+ * of the target to the buffered duration.
+ *
+ *   Frames are removed in order of their NAL priority, lowest first.  A frame
+ * can be referenced by the frames of the same or lower priority that follow it
+ * in its GOP, so when a frame is dropped, those are dropped as well.  To keep
+ * that to a minimum, each GOP is worked from its end backwards, oldest GOP
+ * first.  If frames are dropped from the GOP that is still being received,
+ * incoming frames of the same or lower priority are dropped until the next
+ * keyframe.  Audio and keyframes are never dropped.
+ */
+
+struct drop_frame {
+	struct encoder_packet packet;
+	size_t                gop;
+	bool                  dropped;
+};
+
+static inline int get_frame_priority(const struct encoder_packet *packet)
+{
+	if (packet->priority < OBS_NAL_PRIORITY_DISPOSABLE)
+		return OBS_NAL_PRIORITY_DISPOSABLE;
+	if (packet->priority > OBS_NAL_PRIORITY_HIGHEST)
+		return OBS_NAL_PRIORITY_HIGHEST;
+	return packet->priority;
+}
+
+static inline bool can_drop(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO && !packet->keyframe;
+}
+
+static inline void drop_frame(struct rtmp_packet_queue *queue,
+		const struct encoder_packet *packet)
+{
+	queue->dropped_priority_frames[get_frame_priority(packet)]++;
+	queue->dropped_bytes += packet->size;
+	queue->dropped_frames++;
+}
+
+/* drops frames of the priority or lower from the end of the GOP backwards,
+ * until enough bytes are removed */
+static void drop_gop_frames(struct rtmp_packet_queue *queue,
+		struct drop_frame *frames, size_t start, size_t end,
+		int priority, size_t *bytes_needed)
+{
+	for (size_t i = end; i > start && *bytes_needed; i--) {
+		struct drop_frame *frame = frames + i - 1;
+		size_t size = frame->packet.size;
+
+		if (frame->dropped || !can_drop(&frame->packet))
+			continue;
+		if (get_frame_priority(&frame->packet) > priority)
+			continue;
+
+		frame->dropped = true;
+		drop_frame(queue, &frame->packet);
+
+		*bytes_needed -= (size < *bytes_needed) ? size : *bytes_needed;
+	}
+}
+
+static void drop_frames(struct rtmp_packet_queue *queue,
+		int64_t buffer_duration_usec)
+{
+	DARRAY(struct drop_frame) frames;
+	DARRAY(size_t)            gop_starts;
+	int64_t  target_usec = queue->drop_threshold_usec *
+		DROP_TARGET_PERCENT / 100;
+	uint64_t total_bytes = 0;
+	size_t   bytes_needed;
+	int      prev_dropped = queue->dropped_frames;
+	int      priority;
+
+	debug("Previous packet count: %d", (int)rtmp_queue_count(queue));
+
+	da_init(frames);
+	da_init(gop_starts);
+	da_reserve(frames, rtmp_queue_count(queue));
+	da_push_back(gop_starts, &frames.num);
+
+	while (queue->packets.size) {
+		struct drop_frame frame = {0};
+
+		circlebuf_pop_front(&queue->packets, &frame.packet,
+				sizeof(frame.packet));
+
+		if (frame.packet.type == OBS_ENCODER_VIDEO &&
+		    frame.packet.keyframe && frames.num)
+			da_push_back(gop_starts, &frames.num);
+
+		frame.gop = gop_starts.num - 1;
+		total_bytes += frame.packet.size;
+		da_push_back(frames, &frame);
+	}
+
+	queue->min_drop_dts_usec =
+		frames.array[frames.num - 1].packet.dts_usec;
+
+	bytes_needed = (size_t)(total_bytes - total_bytes *
+			(uint64_t)target_usec / (uint64_t)buffer_duration_usec);
+
+	for (priority = OBS_NAL_PRIORITY_DISPOSABLE;
+	     priority <= OBS_NAL_PRIORITY_HIGHEST && bytes_needed;
+	     priority++) {
+		for (size_t gop = 0; gop < gop_starts.num && bytes_needed;
+				gop++) {
+			size_t start = gop_starts.array[gop];
+			size_t end   = (gop + 1 < gop_starts.num) ?
+				gop_starts.array[gop + 1] : frames.num;
+			bool   open  = (gop + 1 == gop_starts.num);
+			int    prev  = queue->dropped_frames;
+
+			drop_gop_frames(queue, frames.array, start, end,
+					priority, &bytes_needed);
+
+			/* frames of this priority that are still to come may
+			 * reference the dropped frames */
+			if (open && priority > OBS_NAL_PRIORITY_DISPOSABLE &&
+			    queue->dropped_frames != prev &&
+			    queue->min_priority <= priority)
+				queue->min_priority = priority + 1;
+		}
+	}
+
+	for (size_t i = 0; i < frames.num; i++) {
+		struct drop_frame *frame = frames.array + i;
+
+		if (frame->dropped)
+			obs_encoder_packet_release(&frame->packet);
+		else
+			circlebuf_push_back(&queue->packets, &frame->packet,
+					sizeof(frame->packet));
+	}
+
+	da_free(frames);
+	da_free(gop_starts);
+
+	queue->drop_events++;
+	debug("Dropped %d frames up to priority %d, new packet count: %d",
+			queue->dropped_frames - prev_dropped, priority - 1,
+			(int)rtmp_queue_count(queue));
+}
+
+static void check_to_drop_frames(struct rtmp_packet_queue *queue)
+{
+	struct encoder_packet first;
+	int64_t buffer_duration_usec;
+
+	if (rtmp_queue_count(queue) < 5)
+		return;
+
+	circlebuf_peek_front(&queue->packets, &first, sizeof(first));
+
+	/* do not drop frames if frames were just dropped within this time */
+	if (first.dts_usec < queue->min_drop_dts_usec)
+		return;
+
+	/* if the amount of time stored in the buffered packets waiting to be
+	 * sent is higher than threshold, drop frames */
+	buffer_duration_usec = queue->last_dts_usec - first.dts_usec;
+
+	if (buffer_duration_usec > queue->drop_threshold_usec) {
+		debug("%" PRId64 " usec of data buffered, dropping frames",
+				buffer_duration_usec);
+		drop_frames(queue, buffer_duration_usec);
+	}
+}
+
+static bool add_video_packet(struct rtmp_packet_queue *queue,
+		struct encoder_packet *packet)
+{
+	check_to_drop_frames(queue);
+
+	/* if frames were dropped from the current GOP, drop the frames that
+	 * may reference them until the next keyframe */
+	if (packet->keyframe) {
+		queue->min_priority = 0;
+	} else if (get_frame_priority(packet) < queue->min_priority) {
+		drop_frame(queue, packet);
+		return false;
+	}
+
+	return add_packet(queue, packet);
+}
+
+bool rtmp_queue_push(struct rtmp_packet_queue *queue,
+		struct encoder_packet *packet)
+{
+	return (packet->type == OBS_ENCODER_VIDEO) ?
+		add_video_packet(queue, packet) :
+		add_packet(queue, packet);
+}
+
+/* ------------------------------------------------------------------------- */
+
+int rtmp_send_packet(RTMP *rtmp, struct encoder_packet *packet,
+		bool is_header, size_t idx, uint64_t *bytes_sent)
+{
+	struct flv_tag tag;
+	int            ret = 0;
+
+	/* the message body is sent straight from the packet data, only the
+	 * few bytes of tag and chunk headers are generated */
+	if (flv_packet_tag(packet, &tag, is_header)) {
+		RTMPIOVec body[2] = {
+			{(const char*)tag.header + FLV_TAG_HEADER_SIZE,
+				(int)(tag.header_size - FLV_TAG_HEADER_SIZE)},
+			{(const char*)tag.data, (int)tag.size}
+		};
+
+		ret = RTMP_WriteV(rtmp, tag.type, tag.timestamp, body, 2,
+				(int)idx);
+		*bytes_sent += flv_tag_size(&tag);
+	}
+
+	if (is_header)
+		bfree(packet->data);
+	else
+		obs_encoder_packet_release(packet);
+
+	return ret;
+}
+
+bool rtmp_send_meta_data(RTMP *rtmp, obs_output_t *output, size_t idx)
+{
+	uint8_t *meta_data;
+	size_t  meta_data_size;
+	bool success = flv_meta_data(output, &meta_data, &meta_data_size,
+			false, idx);
+
+	if (success) {
+		RTMP_Write(rtmp, (char*)meta_data, (int)meta_data_size,
+				(int)idx);
+		bfree(meta_data);
+	}
+
+	return success;
+}
+
+static bool send_audio_header(RTMP *rtmp, obs_output_t *output, size_t idx,
+		uint64_t *bytes_sent)
+{
+	obs_encoder_t *aencoder = obs_output_get_audio_encoder(output, idx);
+	uint8_t       *header;
+
+	struct encoder_packet packet   = {
+		.type         = OBS_ENCODER_AUDIO,
+		.timebase_den = 1
+	};
+
+	if (!aencoder)
+		return false;
+
+	obs_encoder_get_extra_data(aencoder, &header, &packet.size);
+	packet.data = bmemdup(header, packet.size);
+	rtmp_send_packet(rtmp, &packet, true, idx, bytes_sent);
+	return true;
+}
+
+static void send_video_header(RTMP *rtmp, obs_output_t *output,
+		uint64_t *bytes_sent)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(output);
+	uint8_t       *header;
+	size_t        size;
+
+	struct encoder_packet packet   = {
+		.type         = OBS_ENCODER_VIDEO,
+		.timebase_den = 1,
+		.keyframe     = true
+	};
+
+	obs_encoder_get_extra_data(vencoder, &header, &size);
+	packet.size = obs_parse_avc_header(&packet.data, header, size);
+	rtmp_send_packet(rtmp, &packet, true, 0, bytes_sent);
+}
+
+void rtmp_send_headers(RTMP *rtmp, obs_output_t *output, uint64_t *bytes_sent)
+{
+	size_t i = 0;
+
+	send_audio_header(rtmp, output, i++, bytes_sent);
+	send_video_header(rtmp, output, bytes_sent);
+
+	while (send_audio_header(rtmp, output, i++, bytes_sent));
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+    Copyright (C) 2015 by Hugh Bailey <obs.jim@gmail.com>
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+#include <util/circlebuf.h>
+#include "librtmp/rtmp.h"
+
+/*
+ * Queue of packets waiting to be sent over an RTMP connection, shared by the
+ * RTMP outputs.  Video frames are dropped when the queue backs up.  The queue
+ * does no locking of its own.
+ */
+struct rtmp_packet_queue {
+	obs_output_t     *output;
+	struct circlebuf packets;
+
+	/* frame drop variables */
+	int64_t          drop_threshold_usec;
+	int64_t          min_drop_dts_usec;
+	int              min_priority;
+	int64_t          last_dts_usec;
+
+	/* frame drop statistics */
+	int              dropped_frames;
+	int              dropped_priority_frames[OBS_NAL_PRIORITY_HIGHEST + 1];
+	uint64_t         dropped_bytes;
+	int              drop_events;
+};
+
+/** Resets the frame drop state and statistics for a new session */
+extern void rtmp_queue_reset(struct rtmp_packet_queue *queue,
+		obs_output_t *output, int64_t drop_threshold_usec);
+
+/** Releases the queued packets */
+extern void rtmp_queue_clear(struct rtmp_packet_queue *queue);
+
+/** Releases the queued packets and the queue itself */
+extern void rtmp_queue_free(struct rtmp_packet_queue *queue);
+
+/**
+ * Queues a packet, dropping frames first if the queue has backed up.
+ * Returns false if the packet itself has to be dropped, in which case the
+ * caller still owns it.
+ */
+extern bool rtmp_queue_push(struct rtmp_packet_queue *queue,
+		struct encoder_packet *packet);
+
+extern bool rtmp_queue_pop(struct rtmp_packet_queue *queue,
+		struct encoder_packet *packet);
+
+/** Gets the time spanned by the queued packets */
+extern int64_t rtmp_queue_duration_usec(struct rtmp_packet_queue *queue);
+
+static inline size_t rtmp_queue_count(const struct rtmp_packet_queue *queue)
+{
+	return queue->packets.size / sizeof(struct encoder_packet);
+}
+
+/**
+ * Sends a packet as an FLV tag and releases it.  Header packets own their
+ * data, which is freed.  The number of bytes sent is added to bytes_sent.
+ */
+extern int rtmp_send_packet(RTMP *rtmp, struct encoder_packet *packet,
+		bool is_header, size_t idx, uint64_t *bytes_sent);
+
+/** Sends the meta data of a track, returns false if there is no such track */
+extern bool rtmp_send_meta_data(RTMP *rtmp, obs_output_t *output, size_t idx);
+
+/** Sends the audio and video headers of every track */
+extern void rtmp_send_headers(RTMP *rtmp, obs_output_t *output,
+		uint64_t *bytes_sent);
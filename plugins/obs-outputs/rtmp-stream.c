@@ -25,6 +25,12 @@
 #include "librtmp/rtmp.h"
 #include "librtmp/log.h"
 #include "flv-mux.h"
+#include "rtmp-send.h"
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/sockios.h>
+#endif
 
 #define do_log(level, format, ...) \
 	blog(level, "[rtmp stream: '%s'] " format, \
@@ -35,6 +41,18 @@
 #define debug(format, ...) do_log(LOG_DEBUG,   format, ##__VA_ARGS__)
 
 #define OPT_DROP_THRESHOLD "drop_threshold_ms"
+#define OPT_ADAPTIVE_BITRATE "adaptive_bitrate"
+#define OPT_MIN_BITRATE "min_bitrate"
+
+/* bandwidth is estimated over this interval */
+#define ABR_INTERVAL_NS          1000000000ULL
+/* minimum time between two bitrate reductions, gives the encoder time to
+ * apply the previous reduction before the queue is judged again */
+#define ABR_DECREASE_COOLDOWN_NS 3000000000ULL
+/* number of uncongested intervals before the bitrate is raised again */
+#define ABR_STABLE_INTERVALS     10
+/* the bitrate is raised in steps of this percentage of the maximum */
+#define ABR_INCREASE_PERCENT     5
 
 //#define TEST_FRAMEDROPS
 
@@ -42,7 +60,7 @@ struct rtmp_stream {
 	obs_output_t     *output;
 
 	pthread_mutex_t  packets_mutex;
-	struct circlebuf packets;
+	struct rtmp_packet_queue queue;
 	bool             sent_headers;
 
 	bool             connecting;
@@ -57,15 +75,18 @@ struct rtmp_stream {
 	struct dstr      path, key;
 	struct dstr      username, password;
 
-	/* frame drop variables */
-	int64_t          drop_threshold_usec;
-	int64_t          min_drop_dts_usec;
-	int              min_priority;
-
-	int64_t          last_dts_usec;
+	/* adaptive bitrate variables, only used by the send thread */
+	bool             adaptive_bitrate;
+	int              min_bitrate;
+	int              max_bitrate;
+	int              cur_bitrate;
+	uint64_t         abr_interval_start_ns;
+	uint64_t         abr_last_decrease_ns;
+	uint64_t         abr_video_bytes;
+	uint64_t         abr_audio_bytes;
+	int              abr_stable_intervals;
 
 	uint64_t         total_bytes_sent;
-	int              dropped_frames;
 
 	RTMP             rtmp;
 };
@@ -83,15 +104,6 @@ static void log_rtmp(int level, const char *format, va_list args)
 	blogva(LOG_INFO, format, args);
 }
 
-static inline void free_packets(struct rtmp_stream *stream)
-{
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
-		obs_free_encoder_packet(&packet);
-	}
-}
-
 static void rtmp_stream_stop(void *data);
 
 static void rtmp_stream_destroy(void *data)
@@ -102,7 +114,7 @@ static void rtmp_stream_destroy(void *data)
 		rtmp_stream_stop(data);
 
 	if (stream) {
-		free_packets(stream);
+		rtmp_queue_free(&stream->queue);
 		dstr_free(&stream->path);
 		dstr_free(&stream->key);
 		dstr_free(&stream->username);
@@ -110,17 +122,40 @@ static void rtmp_stream_destroy(void *data)
 		os_event_destroy(stream->stop_event);
 		os_sem_destroy(stream->send_sem);
 		pthread_mutex_destroy(&stream->packets_mutex);
-		circlebuf_free(&stream->packets);
 		bfree(stream);
 	}
 }
 
+static void rtmp_stream_get_drop_stats_proc(void *data, calldata_t *cd)
+{
+	struct rtmp_stream *stream = data;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	calldata_set_int(cd, "disposable", stream->queue.dropped_priority_frames[
+			OBS_NAL_PRIORITY_DISPOSABLE]);
+	calldata_set_int(cd, "low", stream->queue.dropped_priority_frames[
+			OBS_NAL_PRIORITY_LOW]);
+	calldata_set_int(cd, "high", stream->queue.dropped_priority_frames[
+			OBS_NAL_PRIORITY_HIGH]);
+	calldata_set_int(cd, "highest", stream->queue.dropped_priority_frames[
+			OBS_NAL_PRIORITY_HIGHEST]);
+	calldata_set_int(cd, "bytes", (long long)stream->queue.dropped_bytes);
+	calldata_set_int(cd, "events", stream->queue.drop_events);
+	pthread_mutex_unlock(&stream->packets_mutex);
+}
+
 static void *rtmp_stream_create(obs_data_t *settings, obs_output_t *output)
 {
 	struct rtmp_stream *stream = bzalloc(sizeof(struct rtmp_stream));
 	stream->output = output;
 	pthread_mutex_init_value(&stream->packets_mutex);
 
+	proc_handler_add(obs_output_get_proc_handler(output),
+			"void get_drop_stats(out int disposable, out int low, "
+			"out int high, out int highest, out int bytes, "
+			"out int events)",
+			rtmp_stream_get_drop_stats_proc, stream);
+
 	RTMP_Init(&stream->rtmp);
 	RTMP_LogSetCallback(log_rtmp);
 	RTMP_LogSetLevel(RTMP_LOGWARNING);
@@ -177,14 +212,10 @@ static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
 static inline bool get_next_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet)
 {
-	bool new_packet = false;
+	bool new_packet;
 
 	pthread_mutex_lock(&stream->packets_mutex);
-	if (stream->packets.size) {
-		circlebuf_pop_front(&stream->packets, packet,
-				sizeof(struct encoder_packet));
-		new_packet = true;
-	}
+	new_packet = rtmp_queue_pop(&stream->queue, packet);
 	pthread_mutex_unlock(&stream->packets_mutex);
 
 	return new_packet;
@@ -193,24 +224,213 @@ static inline bool get_next_packet(struct rtmp_stream *stream,
 static int send_packet(struct rtmp_stream *stream,
 		struct encoder_packet *packet, bool is_header, size_t idx)
 {
-	uint8_t *data;
-	size_t  size;
-	int     ret = 0;
+	enum obs_encoder_type type = packet->type;
+	uint64_t              size = 0;
+	int                   ret;
 
-	flv_packet_mux(packet, &data, &size, is_header);
 #ifdef TEST_FRAMEDROPS
 	os_sleep_ms(rand() % 40);
 #endif
-	ret = RTMP_Write(&stream->rtmp, (char*)data, (int)size, (int)idx);
-	bfree(data);
+	ret = rtmp_send_packet(&stream->rtmp, packet, is_header, idx, &size);
 
-	obs_free_encoder_packet(packet);
+	if (type == OBS_ENCODER_VIDEO)
+		stream->abr_video_bytes += size;
+	else
+		stream->abr_audio_bytes += size;
 
 	stream->total_bytes_sent += size;
 	return ret;
 }
 
-static inline void send_headers(struct rtmp_stream *stream);
+/* ------------------------------------------------------------------------- */
+/* Adaptive bitrate
+ *
+ *   The send thread measures how fast data actually leaves through the socket,
+ * and how much data is waiting to be sent: the duration of the packets queued
+ * in the output plus the data still sitting in the socket send buffer.  When
+ * the queue grows, the link is saturated and the measured throughput is a
+ * good estimate of the available bandwidth, so the video bitrate is lowered
+ * to fit in it.  Once the queue stays drained for a while, the bitrate is
+ * raised again in small steps.  Frame dropping remains as a last resort for
+ * when the queue still reaches the drop threshold. */
+
+static inline int64_t get_buffered_usec(struct rtmp_stream *stream)
+{
+	int64_t buffered_usec;
+
+	pthread_mutex_lock(&stream->packets_mutex);
+	buffered_usec = rtmp_queue_duration_usec(&stream->queue);
+	pthread_mutex_unlock(&stream->packets_mutex);
+
+	return buffered_usec;
+}
+
+static int64_t get_socket_queue_usec(struct rtmp_stream *stream,
+		uint64_t throughput_bps)
+{
+#ifdef __linux__
+	int queued_bytes = 0;
+
+	if (!throughput_bps)
+		return 0;
+	if (ioctl(stream->rtmp.m_sb.sb_socket, SIOCOUTQ, &queued_bytes) < 0)
+		return 0;
+
+	return (int64_t)((uint64_t)queued_bytes * 8 * 1000000 /
+			throughput_bps);
+#else
+	UNUSED_PARAMETER(stream);
+	UNUSED_PARAMETER(throughput_bps);
+	return 0;
+#endif
+}
+
+static void set_video_bitrate(struct rtmp_stream *stream, int bitrate)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t    *settings = obs_data_create();
+
+	obs_data_set_int(settings, "bitrate", bitrate);
+	obs_encoder_update(vencoder, settings);
+	obs_data_release(settings);
+
+	stream->cur_bitrate = bitrate;
+}
+
+static void init_adaptive_bitrate(struct rtmp_stream *stream)
+{
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(stream->output);
+	obs_data_t    *settings = obs_encoder_get_settings(vencoder);
+
+	stream->max_bitrate = (int)obs_data_get_int(settings, "bitrate");
+	stream->cur_bitrate = stream->max_bitrate;
+	obs_data_release(settings);
+
+	/* the bitrate is changed through the encoder settings, which would
+	 * also lower the quality of recordings made with the same encoder */
+	if (obs_encoder_get_num_outputs(vencoder) > 1) {
+		info("Adaptive bitrate disabled: the video encoder is shared "
+				"with other outputs");
+		stream->adaptive_bitrate = false;
+		return;
+	}
+
+	stream->abr_interval_start_ns = os_gettime_ns();
+	stream->abr_last_decrease_ns  = 0;
+	stream->abr_video_bytes       = 0;
+	stream->abr_audio_bytes       = 0;
+	stream->abr_stable_intervals  = 0;
+
+	if (stream->max_bitrate <= stream->min_bitrate) {
+		info("Adaptive bitrate disabled: encoder bitrate %d kbps is "
+				"not above the minimum of %d kbps",
+				stream->max_bitrate, stream->min_bitrate);
+		stream->adaptive_bitrate = false;
+	}
+}
+
+static void lower_bitrate(struct rtmp_stream *stream, uint64_t ts,
+		uint64_t throughput_kbps, uint64_t audio_kbps,
+		int64_t queued_usec)
+{
+	int bitrate = stream->cur_bitrate * 9 / 10;
+
+	/* leave some headroom below the measured bandwidth so that the queue
+	 * can drain */
+	if (throughput_kbps > audio_kbps) {
+		int estimate = (int)((throughput_kbps - audio_kbps) * 85 / 100);
+		if (estimate < bitrate)
+			bitrate = estimate;
+	}
+
+	if (bitrate < stream->min_bitrate)
+		bitrate = stream->min_bitrate;
+
+	stream->abr_last_decrease_ns = ts;
+	if (bitrate == stream->cur_bitrate)
+		return;
+
+	info("Congestion detected (throughput: %d kbps, queued: %d ms), "
+			"lowering video bitrate from %d to %d kbps",
+			(int)throughput_kbps, (int)(queued_usec / 1000),
+			stream->cur_bitrate, bitrate);
+	set_video_bitrate(stream, bitrate);
+}
+
+static void raise_bitrate(struct rtmp_stream *stream)
+{
+	int bitrate = stream->cur_bitrate +
+		stream->max_bitrate * ABR_INCREASE_PERCENT / 100;
+
+	if (bitrate > stream->max_bitrate)
+		bitrate = stream->max_bitrate;
+
+	info("Raising video bitrate from %d to %d kbps",
+			stream->cur_bitrate, bitrate);
+	set_video_bitrate(stream, bitrate);
+}
+
+static void update_bitrate(struct rtmp_stream *stream)
+{
+	uint64_t ts      = os_gettime_ns();
+	uint64_t elapsed = ts - stream->abr_interval_start_ns;
+	uint64_t throughput_bps, audio_bps;
+	int64_t  queued_usec, congested_usec;
+
+	if (elapsed < ABR_INTERVAL_NS)
+		return;
+
+	throughput_bps = (stream->abr_video_bytes + stream->abr_audio_bytes) *
+		8 * 1000000000ULL / elapsed;
+	audio_bps = stream->abr_audio_bytes * 8 * 1000000000ULL / elapsed;
+
+	stream->abr_interval_start_ns = ts;
+	stream->abr_video_bytes       = 0;
+	stream->abr_audio_bytes       = 0;
+
+	queued_usec = get_buffered_usec(stream) +
+		get_socket_queue_usec(stream, throughput_bps);
+
+	/* react well before the drop threshold is reached */
+	congested_usec = stream->queue.drop_threshold_usec / 3;
+
+	if (queued_usec > congested_usec) {
+		stream->abr_stable_intervals = 0;
+
+		if (ts - stream->abr_last_decrease_ns >=
+				ABR_DECREASE_COOLDOWN_NS)
+			lower_bitrate(stream, ts, throughput_bps / 1000,
+					audio_bps / 1000, queued_usec);
+
+	} else if (queued_usec < congested_usec / 4 &&
+	           stream->cur_bitrate < stream->max_bitrate) {
+		if (++stream->abr_stable_intervals >= ABR_STABLE_INTERVALS) {
+			stream->abr_stable_intervals = 0;
+			raise_bitrate(stream);
+		}
+
+	} else {
+		stream->abr_stable_intervals = 0;
+	}
+}
+
+static void reset_bitrate(struct rtmp_stream *stream)
+{
+	if (stream->cur_bitrate != stream->max_bitrate) {
+		info("Restoring video bitrate to %d kbps",
+				stream->max_bitrate);
+		set_video_bitrate(stream, stream->max_bitrate);
+	}
+}
+
+/* ------------------------------------------------------------------------- */
+
+static inline void send_headers(struct rtmp_stream *stream)
+{
+	stream->sent_headers = true;
+	rtmp_send_headers(&stream->rtmp, stream->output,
+			&stream->total_bytes_sent);
+}
 
 static bool send_remaining_packets(struct rtmp_stream *stream)
 {
@@ -231,6 +451,9 @@ static void *send_thread(void *data)
 	struct rtmp_stream *stream = data;
 	bool disconnected = false;
 
+	if (stream->adaptive_bitrate)
+		init_adaptive_bitrate(stream);
+
 	while (os_sem_wait(stream->send_sem) == 0) {
 		struct encoder_packet packet;
 
@@ -246,6 +469,9 @@ static void *send_thread(void *data)
 			disconnected = true;
 			break;
 		}
+
+		if (stream->adaptive_bitrate)
+			update_bitrate(stream);
 	}
 
 	if (!disconnected && !send_remaining_packets(stream))
@@ -253,11 +479,28 @@ static void *send_thread(void *data)
 
 	if (disconnected) {
 		info("Disconnected from %s", stream->path.array);
-		free_packets(stream);
+		pthread_mutex_lock(&stream->packets_mutex);
+		rtmp_queue_clear(&stream->queue);
+		pthread_mutex_unlock(&stream->packets_mutex);
 	} else {
 		info("User stopped the stream");
 	}
 
+	if (stream->adaptive_bitrate)
+		reset_bitrate(stream);
+
+	if (stream->queue.dropped_frames)
+		info("Dropped %d frames (%d disposable, %d low, %d high, "
+				"%d highest priority, %"PRIu64" bytes) "
+				"in %d drops",
+				stream->queue.dropped_frames,
+				stream->queue.dropped_priority_frames[0],
+				stream->queue.dropped_priority_frames[1],
+				stream->queue.dropped_priority_frames[2],
+				stream->queue.dropped_priority_frames[3],
+				stream->queue.dropped_bytes,
+				stream->queue.drop_events);
+
 	if (os_event_try(stream->stop_event) == EAGAIN) {
 		pthread_detach(stream->send_thread);
 		obs_output_signal_stop(stream->output, OBS_OUTPUT_DISCONNECTED);
@@ -268,71 +511,6 @@ static void *send_thread(void *data)
 	return NULL;
 }
 
-static bool send_meta_data(struct rtmp_stream *stream, size_t idx)
-{
-	uint8_t *meta_data;
-	size_t  meta_data_size;
-	bool success = flv_meta_data(stream->output, &meta_data,
-			&meta_data_size, false, idx);
-
-	if (success) {
-		RTMP_Write(&stream->rtmp, (char*)meta_data,
-				(int)meta_data_size, (int)idx);
-		bfree(meta_data);
-	}
-
-	return success;
-}
-
-static bool send_audio_header(struct rtmp_stream *stream, size_t idx)
-{
-	obs_output_t  *context  = stream->output;
-	obs_encoder_t *aencoder = obs_output_get_audio_encoder(context, idx);
-	uint8_t       *header;
-
-	struct encoder_packet packet   = {
-		.type         = OBS_ENCODER_AUDIO,
-		.timebase_den = 1
-	};
-
-	if (!aencoder)
-		return false;
-
-	obs_encoder_get_extra_data(aencoder, &header, &packet.size);
-	packet.data = bmemdup(header, packet.size);
-	send_packet(stream, &packet, true, idx);
-	return true;
-}
-
-static void send_video_header(struct rtmp_stream *stream)
-{
-	obs_output_t  *context  = stream->output;
-	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
-	uint8_t       *header;
-	size_t        size;
-
-	struct encoder_packet packet   = {
-		.type         = OBS_ENCODER_VIDEO,
-		.timebase_den = 1,
-		.keyframe     = true
-	};
-
-	obs_encoder_get_extra_data(vencoder, &header, &size);
-	packet.size = obs_parse_avc_header(&packet.data, header, size);
-	send_packet(stream, &packet, true, 0);
-}
-
-static inline void send_headers(struct rtmp_stream *stream)
-{
-	stream->sent_headers = true;
-	size_t i = 0;
-
-	send_audio_header(stream, i++);
-	send_video_header(stream);
-
-	while (send_audio_header(stream, i++));
-}
-
 static inline bool reset_semaphore(struct rtmp_stream *stream)
 {
 	os_sem_destroy(stream->send_sem);
@@ -379,7 +557,7 @@ static int init_send(struct rtmp_stream *stream)
 	}
 
 	stream->active = true;
-	while (send_meta_data(stream, idx++));
+	while (rtmp_send_meta_data(&stream->rtmp, stream->output, idx++));
 	obs_output_begin_data_capture(stream->output, 0);
 
 	return OBS_OUTPUT_SUCCESS;
@@ -462,119 +640,24 @@ static bool rtmp_stream_start(void *data)
 		return false;
 
 	stream->total_bytes_sent = 0;
-	stream->dropped_frames   = 0;
-	stream->min_drop_dts_usec= 0;
-	stream->min_priority     = 0;
 
 	settings = obs_output_get_settings(stream->output);
 	dstr_copy(&stream->path,     obs_service_get_url(service));
 	dstr_copy(&stream->key,      obs_service_get_key(service));
 	dstr_copy(&stream->username, obs_service_get_username(service));
 	dstr_copy(&stream->password, obs_service_get_password(service));
-	stream->drop_threshold_usec =
-		(int64_t)obs_data_get_int(settings, OPT_DROP_THRESHOLD) * 1000;
+	rtmp_queue_reset(&stream->queue, stream->output,
+		(int64_t)obs_data_get_int(settings, OPT_DROP_THRESHOLD) * 1000);
+	stream->adaptive_bitrate =
+		obs_data_get_bool(settings, OPT_ADAPTIVE_BITRATE);
+	stream->min_bitrate =
+		(int)obs_data_get_int(settings, OPT_MIN_BITRATE);
 	obs_data_release(settings);
 
 	return pthread_create(&stream->connect_thread, NULL, connect_thread,
 			stream) == 0;
 }
 
-static inline bool add_packet(struct rtmp_stream *stream,
-		struct encoder_packet *packet)
-{
-	circlebuf_push_back(&stream->packets, packet,
-			sizeof(struct encoder_packet));
-	stream->last_dts_usec = packet->dts_usec;
-	return true;
-}
-
-static inline size_t num_buffered_packets(struct rtmp_stream *stream)
-{
-	return stream->packets.size / sizeof(struct encoder_packet);
-}
-
-static void drop_frames(struct rtmp_stream *stream)
-{
-	struct circlebuf new_buf            = {0};
-	int              drop_priority      = 0;
-	uint64_t         last_drop_dts_usec = 0;
-	int              num_frames_dropped = 0;
-
-	debug("Previous packet count: %d", (int)num_buffered_packets(stream));
-
-	circlebuf_reserve(&new_buf, sizeof(struct encoder_packet) * 8);
-
-	while (stream->packets.size) {
-		struct encoder_packet packet;
-		circlebuf_pop_front(&stream->packets, &packet, sizeof(packet));
-
-		last_drop_dts_usec = packet.dts_usec;
-
-		/* do not drop audio data or video keyframes */
-		if (packet.type          == OBS_ENCODER_AUDIO ||
-		    packet.drop_priority == OBS_NAL_PRIORITY_HIGHEST) {
-			circlebuf_push_back(&new_buf, &packet, sizeof(packet));
-
-		} else {
-			if (drop_priority < packet.drop_priority)
-				drop_priority = packet.drop_priority;
-
-			num_frames_dropped++;
-			obs_free_encoder_packet(&packet);
-		}
-	}
-
-	circlebuf_free(&stream->packets);
-	stream->packets           = new_buf;
-	stream->min_priority      = drop_priority;
-	stream->min_drop_dts_usec = last_drop_dts_usec;
-
-	stream->dropped_frames += num_frames_dropped;
-	debug("New packet count: %d", (int)num_buffered_packets(stream));
-}
-
-static void check_to_drop_frames(struct rtmp_stream *stream)
-{
-	struct encoder_packet first;
-	int64_t buffer_duration_usec;
-
-	if (num_buffered_packets(stream) < 5)
-		return;
-
-	circlebuf_peek_front(&stream->packets, &first, sizeof(first));
-
-	/* do not drop frames if frames were just dropped within this time */
-	if (first.dts_usec < stream->min_drop_dts_usec)
-		return;
-
-	/* if the amount of time stored in the buffered packets waiting to be
-	 * sent is higher than threshold, drop frames */
-	buffer_duration_usec = stream->last_dts_usec - first.dts_usec;
-
-	if (buffer_duration_usec > stream->drop_threshold_usec) {
-		drop_frames(stream);
-		debug("dropping %" PRId64 " worth of frames",
-				buffer_duration_usec);
-	}
-}
-
-static bool add_video_packet(struct rtmp_stream *stream,
-		struct encoder_packet *packet)
-{
-	check_to_drop_frames(stream);
-
-	/* if currently dropping frames, drop packets until it reaches the
-	 * desired priority */
-	if (packet->priority < stream->min_priority) {
-		stream->dropped_frames++;
-		return false;
-	} else {
-		stream->min_priority = 0;
-	}
-
-	return add_packet(stream, packet);
-}
-
 static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 {
 	struct rtmp_stream    *stream = data;
@@ -582,27 +665,27 @@ static void rtmp_stream_data(void *data, struct encoder_packet *packet)
 	bool                  added_packet;
 
 	if (packet->type == OBS_ENCODER_VIDEO)
-		obs_parse_avc_packet(&new_packet, packet);
+		obs_avc_packet_ref(&new_packet, packet);
 	else
-		obs_duplicate_encoder_packet(&new_packet, packet);
+		obs_encoder_packet_ref(&new_packet, packet);
 
 	pthread_mutex_lock(&stream->packets_mutex);
 
-	added_packet = (packet->type == OBS_ENCODER_VIDEO) ?
-		add_video_packet(stream, &new_packet) :
-		add_packet(stream, &new_packet);
+	added_packet = rtmp_queue_push(&stream->queue, &new_packet);
 
 	pthread_mutex_unlock(&stream->packets_mutex);
 
 	if (added_packet)
 		os_sem_post(stream->send_sem);
 	else
-		obs_free_encoder_packet(&new_packet);
+		obs_encoder_packet_release(&new_packet);
 }
 
 static void rtmp_stream_defaults(obs_data_t *defaults)
 {
 	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 600);
+	obs_data_set_default_bool(defaults, OPT_ADAPTIVE_BITRATE, false);
+	obs_data_set_default_int(defaults, OPT_MIN_BITRATE, 300);
 }
 
 static obs_properties_t *rtmp_stream_properties(void *unused)
@@ -614,6 +697,11 @@ static obs_properties_t *rtmp_stream_properties(void *unused)
 	obs_properties_add_int(props, OPT_DROP_THRESHOLD,
 			obs_module_text("RTMPStream.DropThreshold"),
 			200, 10000, 100);
+	obs_properties_add_bool(props, OPT_ADAPTIVE_BITRATE,
+			obs_module_text("RTMPStream.AdaptiveBitrate"));
+	obs_properties_add_int(props, OPT_MIN_BITRATE,
+			obs_module_text("RTMPStream.MinBitrate"),
+			50, 100000, 50);
 	return props;
 }
 
@@ -626,7 +714,7 @@ static uint64_t rtmp_stream_total_bytes_sent(void *data)
 static int rtmp_stream_dropped_frames(void *data)
 {
 	struct rtmp_stream *stream = data;
-	return stream->dropped_frames;
+	return stream->queue.dropped_frames;
 }
 
 struct obs_output_info rtmp_output_info = {
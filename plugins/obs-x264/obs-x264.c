@@ -52,8 +52,37 @@ struct obs_x264 {
 	size_t                 sei_size;
 
 	os_performance_token_t *performance_token;
+
+	/* overload detection and preset degradation */
+	x264_param_t           base_params;
+	char                   *tune;
+	bool                   adaptive_preset;
+	int                    base_preset;
+	int                    cur_preset;
+
+	uint64_t               frame_interval_ns;
+	uint64_t               avg_encode_ns;
+	int                    overload_frames;
+	int                    recover_frames;
+	int                    underload_frames;
+	bool                   overloaded;
+
+	bool                   keyframe_requested;
 };
 
+/* the average encode time is an exponential moving average over roughly the
+ * last 16 frames */
+#define ENCODE_TIME_SMOOTHING    16
+
+/* overloaded once the average encode time exceeds 90% of the frame interval
+ * for a second, recovered once it is below 70% for a second, and the preset
+ * is only stepped back up once it has stayed below 50% for ten seconds */
+#define OVERLOAD_THRESHOLD       90
+#define RECOVER_THRESHOLD        70
+#define UNDERLOAD_THRESHOLD      50
+#define OVERLOAD_SECONDS         1
+#define UNDERLOAD_SECONDS        10
+
 /* ------------------------------------------------------------------------- */
 
 static const char *obs_x264_getname(void)
@@ -84,6 +113,7 @@ static void obs_x264_destroy(void *data)
 		os_end_high_performance(obsx264->performance_token);
 		clear_data(obsx264);
 		da_free(obsx264->packet_data);
+		bfree(obsx264->tune);
 		bfree(obsx264);
 	}
 }
@@ -96,6 +126,7 @@ static void obs_x264_defaults(obs_data_t *settings)
 	obs_data_set_default_int   (settings, "keyint_sec",  0);
 	obs_data_set_default_int   (settings, "crf",         23);
 	obs_data_set_default_bool  (settings, "cbr",         true);
+	obs_data_set_default_bool  (settings, "adaptive_preset", false);
 
 	obs_data_set_default_string(settings, "preset",      "veryfast");
 	obs_data_set_default_string(settings, "profile",     "");
@@ -122,6 +153,7 @@ static inline void add_strings(obs_property_t *list, const char *const *strings)
 #define TEXT_TUNE       obs_module_text("Tune")
 #define TEXT_NONE       obs_module_text("None")
 #define TEXT_X264_OPTS  obs_module_text("EncoderOptions")
+#define TEXT_ADAPTIVE   obs_module_text("AdaptivePreset")
 
 static bool use_bufsize_modified(obs_properties_t *ppts, obs_property_t *p,
 		obs_data_t *settings)
@@ -166,6 +198,8 @@ static obs_properties_t *obs_x264_props(void *unused)
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 	add_strings(list, x264_preset_names);
 
+	obs_properties_add_bool(props, "adaptive_preset", TEXT_ADAPTIVE);
+
 	list = obs_properties_add_list(props, "profile", TEXT_PROFILE,
 			OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
 	obs_property_list_add_string(list, TEXT_NONE, "");
@@ -301,12 +335,21 @@ static inline const char *validate_preset(struct obs_x264 *obsx264,
 	return new_preset ? new_preset : "veryfast";
 }
 
+static int get_preset_idx(const char *preset)
+{
+	for (int i = 0; x264_preset_names[i]; i++) {
+		if (strcmp(x264_preset_names[i], preset) == 0)
+			return i;
+	}
+
+	return 0;
+}
+
+/* preset and tune must already have been validated */
 static bool reset_x264_params(struct obs_x264 *obsx264,
 		const char *preset, const char *tune)
 {
-	int ret = x264_param_default_preset(&obsx264->params,
-			validate_preset(obsx264, preset),
-			validate(obsx264, tune, "tune", x264_tune_names));
+	int ret = x264_param_default_preset(&obsx264->params, preset, tune);
 	return ret == 0;
 }
 
@@ -370,6 +413,11 @@ static void update_params(struct obs_x264 *obsx264, obs_data_t *settings,
 	bool use_bufsize = obs_data_get_bool(settings, "use_bufsize");
 	bool cbr         = obs_data_get_bool(settings, "cbr");
 
+	obsx264->adaptive_preset   = obs_data_get_bool(settings,
+			"adaptive_preset");
+	obsx264->frame_interval_ns = 1000000000ULL * voi->fps_den /
+		voi->fps_num;
+
 	if (keyint_sec)
 		obsx264->params.i_keyint_max =
 			keyint_sec * voi->fps_num / voi->fps_den;
@@ -456,6 +504,9 @@ static bool update_settings(struct obs_x264 *obsx264, obs_data_t *settings)
 	paramlist = strlist_split(opts, ' ', false);
 
 	if (!obsx264->context) {
+		const char *valid_preset;
+		const char *valid_tune;
+
 		override_base_params(obsx264, paramlist,
 				&preset, &profile, &tune);
 
@@ -463,7 +514,15 @@ static bool update_settings(struct obs_x264 *obsx264, obs_data_t *settings)
 		if (profile && *profile) info("profile: %s", profile);
 		if (tune    && *tune)    info("tune: %s",    tune);
 
-		success = reset_x264_params(obsx264, preset, tune);
+		valid_preset = validate_preset(obsx264, preset);
+		valid_tune   = validate(obsx264, tune, "tune", x264_tune_names);
+
+		success = reset_x264_params(obsx264, valid_preset, valid_tune);
+
+		bfree(obsx264->tune);
+		obsx264->tune        = bstrdup(valid_tune);
+		obsx264->base_preset = get_preset_idx(valid_preset);
+		obsx264->cur_preset  = obsx264->base_preset;
 	}
 
 	if (success) {
@@ -485,6 +544,12 @@ static bool update_settings(struct obs_x264 *obsx264, obs_data_t *settings)
 	return success;
 }
 
+static bool set_analysis_preset(struct obs_x264 *obsx264, int preset);
+
+/* called on the encoding thread if the encoder is active.  the rate control
+ * settings (bitrate, buffer size, crf) are changed in place by
+ * x264_encoder_reconfig, everything else that x264 can't reconfigure keeps
+ * the value the encoder was opened with */
 static bool obs_x264_update(void *data, obs_data_t *settings)
 {
 	struct obs_x264 *obsx264 = data;
@@ -495,6 +560,11 @@ static bool obs_x264_update(void *data, obs_data_t *settings)
 		ret = x264_encoder_reconfig(obsx264->context, &obsx264->params);
 		if (ret != 0)
 			warn("Failed to reconfigure: %d", ret);
+
+		if (ret == 0 && !obsx264->adaptive_preset &&
+		    obsx264->cur_preset != obsx264->base_preset)
+			set_analysis_preset(obsx264, obsx264->base_preset);
+
 		return ret == 0;
 	}
 
@@ -541,6 +611,8 @@ static void *obs_x264_create(obs_data_t *settings, obs_encoder_t *encoder)
 			warn("x264 failed to load");
 		else
 			load_headers(obsx264);
+
+		obsx264->base_params = obsx264->params;
 	} else {
 		warn("bad settings specified");
 	}
@@ -599,6 +671,133 @@ static inline void init_pic_data(struct obs_x264 *obsx264, x264_picture_t *pic,
 	}
 }
 
+/* only the analysis settings of a preset can be changed with
+ * x264_encoder_reconfig; threads, lookahead and b-frames stay as they were
+ * when the encoder was opened */
+static void copy_analysis_params(x264_param_t *dst, const x264_param_t *src)
+{
+	dst->analyse.intra              = src->analyse.intra;
+	dst->analyse.inter              = src->analyse.inter;
+	dst->analyse.i_direct_mv_pred   = src->analyse.i_direct_mv_pred;
+	dst->analyse.i_me_method        = src->analyse.i_me_method;
+	dst->analyse.i_me_range         = src->analyse.i_me_range;
+	dst->analyse.i_subpel_refine    = src->analyse.i_subpel_refine;
+	dst->analyse.i_trellis          = src->analyse.i_trellis;
+	dst->analyse.b_chroma_me        = src->analyse.b_chroma_me;
+	dst->analyse.b_mixed_references = src->analyse.b_mixed_references;
+	dst->analyse.b_fast_pskip       = src->analyse.b_fast_pskip;
+	dst->analyse.b_dct_decimate     = src->analyse.b_dct_decimate;
+	dst->analyse.b_psy              = src->analyse.b_psy;
+	dst->analyse.f_psy_rd           = src->analyse.f_psy_rd;
+	dst->analyse.f_psy_trellis      = src->analyse.f_psy_trellis;
+	dst->b_deblocking_filter        = src->b_deblocking_filter;
+	dst->i_deblocking_filter_alphac0 = src->i_deblocking_filter_alphac0;
+	dst->i_deblocking_filter_beta   = src->i_deblocking_filter_beta;
+
+	/* x264 cannot use more reference frames than it was opened with */
+	if (src->i_frame_reference < dst->i_frame_reference)
+		dst->i_frame_reference = src->i_frame_reference;
+}
+
+static bool set_analysis_preset(struct obs_x264 *obsx264, int preset)
+{
+	x264_param_t params = obsx264->params;
+	int ret;
+
+	/* returning to the configured preset also restores any analysis
+	 * settings that were overridden with custom x264 options */
+	if (preset == obsx264->base_preset) {
+		params.i_frame_reference =
+			obsx264->base_params.i_frame_reference;
+		copy_analysis_params(&params, &obsx264->base_params);
+	} else {
+		x264_param_t preset_params;
+
+		if (x264_param_default_preset(&preset_params,
+					x264_preset_names[preset],
+					obsx264->tune) != 0)
+			return false;
+
+		copy_analysis_params(&params, &preset_params);
+	}
+
+	ret = x264_encoder_reconfig(obsx264->context, &params);
+	if (ret != 0) {
+		warn("Failed to change preset to '%s': %d",
+				x264_preset_names[preset], ret);
+		return false;
+	}
+
+	obsx264->params     = params;
+	obsx264->cur_preset = preset;
+	return true;
+}
+
+static inline int get_fps(struct obs_x264 *obsx264)
+{
+	int fps = obsx264->params.i_fps_num / obsx264->params.i_fps_den;
+	return fps ? fps : 1;
+}
+
+static void update_encode_time(struct obs_x264 *obsx264, uint64_t encode_ns)
+{
+	uint64_t interval = obsx264->frame_interval_ns;
+	uint64_t avg;
+	int      fps = get_fps(obsx264);
+
+	if (!interval)
+		return;
+
+	if (!obsx264->avg_encode_ns)
+		obsx264->avg_encode_ns = encode_ns;
+	else
+		obsx264->avg_encode_ns += (int64_t)(encode_ns -
+				obsx264->avg_encode_ns) / ENCODE_TIME_SMOOTHING;
+
+	avg = obsx264->avg_encode_ns;
+
+	obsx264->overload_frames  = (avg * 100 > interval * OVERLOAD_THRESHOLD)
+		? obsx264->overload_frames + 1 : 0;
+	obsx264->recover_frames   = (avg * 100 < interval * RECOVER_THRESHOLD)
+		? obsx264->recover_frames + 1 : 0;
+	obsx264->underload_frames = (avg * 100 < interval * UNDERLOAD_THRESHOLD)
+		? obsx264->underload_frames + 1 : 0;
+
+	if (obsx264->overload_frames >= fps * OVERLOAD_SECONDS) {
+		obsx264->overload_frames = 0;
+
+		if (!obsx264->overloaded) {
+			warn("encoder overloaded: average encode time "
+			     "%.2fms, frame interval %.2fms",
+			     (double)avg / 1000000.0,
+			     (double)interval / 1000000.0);
+			obsx264->overloaded = true;
+			obs_encoder_signal_overload(obsx264->encoder, true);
+		}
+
+		if (obsx264->adaptive_preset && obsx264->cur_preset > 0 &&
+		    set_analysis_preset(obsx264, obsx264->cur_preset - 1)) {
+			info("lowered preset to '%s'",
+					x264_preset_names[obsx264->cur_preset]);
+		}
+
+	} else if (obsx264->overloaded &&
+	           obsx264->recover_frames >= fps * OVERLOAD_SECONDS) {
+		info("encoder recovered from overload");
+		obsx264->overloaded = false;
+		obs_encoder_signal_overload(obsx264->encoder, false);
+	}
+
+	if (obsx264->cur_preset < obsx264->base_preset &&
+	    obsx264->underload_frames >= fps * UNDERLOAD_SECONDS) {
+		obsx264->underload_frames = 0;
+
+		if (set_analysis_preset(obsx264, obsx264->cur_preset + 1))
+			info("raised preset to '%s'",
+					x264_preset_names[obsx264->cur_preset]);
+	}
+}
+
 static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 		struct encoder_packet *packet, bool *received_packet)
 {
@@ -607,6 +806,7 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 	int             nal_count;
 	int             ret;
 	x264_picture_t  pic, pic_out;
+	uint64_t        start_ns;
 
 	if (!frame || !packet || !received_packet)
 		return false;
@@ -614,6 +814,13 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 	if (frame)
 		init_pic_data(obsx264, &pic, frame);
 
+	if (frame && obsx264->keyframe_requested) {
+		pic.i_type = X264_TYPE_IDR;
+		obsx264->keyframe_requested = false;
+	}
+
+	start_ns = os_gettime_ns();
+
 	ret = x264_encoder_encode(obsx264->context, &nals, &nal_count,
 			(frame ? &pic : NULL), &pic_out);
 	if (ret < 0) {
@@ -621,12 +828,20 @@ static bool obs_x264_encode(void *data, struct encoder_frame *frame,
 		return false;
 	}
 
+	update_encode_time(obsx264, os_gettime_ns() - start_ns);
+
 	*received_packet = (nal_count != 0);
 	parse_packet(obsx264, packet, nals, nal_count, &pic_out);
 
 	return true;
 }
 
+static void obs_x264_request_keyframe(void *data)
+{
+	struct obs_x264 *obsx264 = data;
+	obsx264->keyframe_requested = true;
+}
+
 static bool obs_x264_extra_data(void *data, uint8_t **extra_data, size_t *size)
 {
 	struct obs_x264 *obsx264 = data;
@@ -686,5 +901,6 @@ struct obs_encoder_info obs_x264_encoder = {
 	.get_defaults   = obs_x264_defaults,
 	.get_extra_data = obs_x264_extra_data,
 	.get_sei_data   = obs_x264_sei,
-	.get_video_info = obs_x264_video_info
+	.get_video_info = obs_x264_video_info,
+	.request_keyframe = obs_x264_request_keyframe
 };
@@ -34,7 +34,7 @@ uint32_t texbuf_w = 2048, texbuf_h = 2048;
 static struct obs_source_info freetype2_source_info = {
 	.id = "text_ft2_source",
 	.type = OBS_SOURCE_TYPE_INPUT,
-	.output_flags = OBS_SOURCE_VIDEO,
+	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_STATIC_VIDEO,
 	.get_name = ft2_source_get_name,
 	.create = ft2_source_create,
 	.destroy = ft2_source_destroy,
@@ -220,6 +220,7 @@ static void ft2_video_tick(void *data, float seconds)
 				load_text_from_file(srcdata,
 					srcdata->text_file);
 			set_up_vertex_buffer(srcdata);
+			obs_source_invalidate(srcdata->src);
 		}
 	}
 
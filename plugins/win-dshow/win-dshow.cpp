@@ -1743,9 +1743,12 @@ void RegisterDShowSource()
 	obs_source_info info = {};
 	info.id              = "dshow_input";
 	info.type            = OBS_SOURCE_TYPE_INPUT;
+	/* ARGB devices aren't treated as opaque, libobs checks the format of
+	 * each frame */
 	info.output_flags    = OBS_SOURCE_VIDEO |
 	                       OBS_SOURCE_AUDIO |
-	                       OBS_SOURCE_ASYNC;
+	                       OBS_SOURCE_ASYNC |
+	                       OBS_SOURCE_OPAQUE_VIDEO;
 	info.get_name        = GetDShowInputName;
 	info.create          = CreateDShowInput;
 	info.destroy         = DestroyDShowInput;